@@ -7,14 +7,19 @@
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -26,10 +31,20 @@
 //      fillseq       -- write N values in sequential key order in async mode
 //      fillrandom    -- write N values in random key order in async mode
 //      overwrite     -- overwrite N values in random key order in async mode
+//      overwritehot  -- overwrite N values in random key order in async mode,
+//                       90% of them in a 10% section of the DB
 //      fillsync      -- write N/100 values in random key order in sync mode
+//      fillsyncwhilewriting -- fillsync while an extra thread keeps writing
+//                              in async mode, which keeps compactions busy
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      filltombstones -- write N entries where most keys only have
+//                        obsolete versions and deletion markers
+//      readtombstones -- read sequentially over the filltombstones data
+//      mergerandom   -- increment N counters in random key order with Merge
+//      readmodifywrite -- increment N counters in random key order with
+//                         a Get followed by a Put
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
@@ -39,9 +54,14 @@
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      xxh3          -- repeated xxh3 of 4K of data
 //   Meta operations:
 //      compact     -- Compact the entire DB
+//      compactrate -- Compact the entire DB and report the rate at which
+//                     compactions read and wrote table files
 //      stats       -- Print DB stats
+//      writeamp    -- Print table bytes written per byte of user data
+//      writestalls -- Print the number and duration of write stalls
 //      sstables    -- Print sstable info
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
@@ -59,6 +79,7 @@ static const char* FLAGS_benchmarks =
     "readreverse,"
     "fill100K,"
     "crc32c,"
+    "xxh3,"
     "snappycomp,"
     "snappyuncomp,"
     "zstdcomp,"
@@ -109,6 +130,14 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Comma-separated bloom filter bits per key of each level (0: no filters),
+// overriding --bloom_bits when writing.  The last one applies to the
+// levels below.
+static const char* FLAGS_bloom_bits_per_level = nullptr;
+
+// If true, write no filters for the bottommost data of each key.
+static bool FLAGS_optimize_filters_for_hits = false;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
@@ -123,17 +152,135 @@ static bool FLAGS_reuse_logs = false;
 // If true, use compression.
 static bool FLAGS_compression = true;
 
+// Comma-separated compression types of each level (0: none, 1: snappy,
+// 2: zstd, 3: lz4, 4: lz4hc), overriding --compression.  The last one
+// applies to the levels below.
+static const char* FLAGS_compression_per_level = nullptr;
+
+// Comma-separated zstd compression levels of each level.
+static const char* FLAGS_zstd_compression_level_per_level = nullptr;
+
+// Size of the zstd dictionary trained for each table (0: no dictionary).
+static int FLAGS_zstd_max_dict_bytes = 0;
+
+// Bytes of data blocks sampled to train it (0: 100 times the dictionary).
+static int FLAGS_zstd_max_train_bytes = 0;
+
+// Number of threads compressing the data blocks of table files
+// (0: compress on the thread building the file).
+static int FLAGS_parallel_compression_threads = 0;
+
+// If true, compactions read their inputs and compress their outputs off
+// the compaction thread.
+static bool FLAGS_pipelined_compaction = false;
+
+// Checksum of the blocks of table files (1: crc32c, 2: xxh3).
+static int FLAGS_checksum = leveldb::kCRC32c;
+
+// Values of at least this many bytes are kept in blob files (0: never).
+static int FLAGS_min_blob_size = 0;
+
+// Fraction of the oldest blob files whose values compactions relocate.
+static double FLAGS_blob_gc_age_cutoff = 0.25;
+
+// If true, use universal (tiered) compaction instead of leveled compaction.
+static bool FLAGS_universal_compaction = false;
+
+// If true, derive leveled compaction level sizes from the largest level.
+static bool FLAGS_dynamic_level_bytes = false;
+
+// Leveled compaction priority: 0 = round robin, 1 = min overlapping ratio,
+// 2 = oldest file first.
+static int FLAGS_compaction_priority = 0;
+
+// Compact files in which at least this percentage of entries are
+// deletions.  0 disables these compactions.
+static int FLAGS_deletion_compaction_percent = 0;
+
+// Rate in bytes per second that writes are throttled to while compactions
+// fall behind.  Negative means use the default leveldb value.
+static int FLAGS_delayed_write_rate = -1;
+
+// Limit flush and compaction writes to this many bytes per second.
+// 0 means no limit.
+static int FLAGS_rate_limiter_bytes_per_sec = 0;
+
+// Tune the rate limit to demand, up to --rate_limiter_bytes_per_sec.
+static bool FLAGS_rate_limiter_auto_tuned = false;
+
+// Write table files back to storage every this many bytes.  0 means only
+// when they are synced.
+static int FLAGS_bytes_per_sync = 0;
+
+// Write log files back to storage every this many bytes.
+static int FLAGS_wal_bytes_per_sync = 0;
+
+// Write table files, and read compaction inputs, with direct I/O
+static bool FLAGS_use_direct_io_for_flush_and_compaction = false;
+
+// Read table files with direct I/O
+static bool FLAGS_use_direct_reads = false;
+
+// Read table files through memory mappings of at most this many bytes.
+// 0 reads them with system calls; negative leaves the choice to the Env.
+static int64_t FLAGS_max_mmap_read_bytes = -1;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
 // ZSTD compression level to try out
 static int FLAGS_zstd_compression_level = 1;
 
+// LZ4HC compression level to try out
+static int FLAGS_lz4hc_compression_level = 9;
+
+// Number of Put/Delete pairs written per deleted key by filltombstones
+static int FLAGS_tombstones_per_key = 100;
+
+// Consecutive hidden entries an iterator steps over before reseeking
+// (initialized to default value by "main")
+static int FLAGS_max_sequential_skip = 0;
+
 namespace leveldb {
 
 namespace {
 leveldb::Env* g_env = nullptr;
 
+// Counters are stored as fixed64 values; a missing or malformed value
+// counts as zero.
+uint64_t DecodeCounter(const Slice* value) {
+  if (value == nullptr || value->size() != sizeof(uint64_t)) {
+    return 0;
+  }
+  return DecodeFixed64(value->data());
+}
+
+class UInt64AddOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "leveldb.UInt64AddOperator"; }
+
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    uint64_t sum = DecodeCounter(existing_value);
+    for (const Slice& operand : operands) {
+      sum += DecodeCounter(&operand);
+    }
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+
+  bool PartialMerge(const Slice& key, const Slice& older_operand,
+                    const Slice& newer_operand,
+                    std::string* new_operand) const override {
+    new_operand->clear();
+    PutFixed64(new_operand,
+               DecodeCounter(&older_operand) + DecodeCounter(&newer_operand));
+    return true;
+  }
+};
+
 class CountComparator : public Comparator {
  public:
   CountComparator(const Comparator* wrapped) : wrapped_(wrapped) {}
@@ -227,6 +374,18 @@ static Slice TrimSpace(Slice s) {
 }
 #endif
 
+// Parse a comma-separated list of integers, such as "0,0,1,2".  Returns an
+// empty list for nullptr.
+static std::vector<int> ParseIntList(const char* list) {
+  std::vector<int> result;
+  while (list != nullptr && *list != '\0') {
+    char* end;
+    result.push_back(static_cast<int>(std::strtol(list, &end, 10)));
+    list = (*end == ',') ? end + 1 : nullptr;
+  }
+  return result;
+}
+
 static void AppendWithSpace(std::string* str, Slice msg) {
   if (msg.empty()) return;
   if (!str->empty()) {
@@ -429,6 +588,8 @@ class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  std::vector<const FilterPolicy*> filter_policy_per_level_;
+  RateLimiter* rate_limiter_;
   DB* db_;
   int num_;
   int value_size_;
@@ -437,6 +598,8 @@ class Benchmark {
   int reads_;
   int heap_counter_;
   CountComparator count_comparator_;
+  UInt64AddOperator merge_operator_;
+  port::Mutex counter_mutex_;  // Serializes ReadModifyWrite updates
   int total_thread_count_;
 
   void PrintHeader() {
@@ -523,6 +686,11 @@ class Benchmark {
         filter_policy_(FLAGS_bloom_bits >= 0
                            ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                            : nullptr),
+        rate_limiter_(FLAGS_rate_limiter_bytes_per_sec > 0
+                          ? NewGenericRateLimiter(
+                                FLAGS_rate_limiter_bytes_per_sec, 100 * 1000,
+                                FLAGS_rate_limiter_auto_tuned)
+                          : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -541,12 +709,20 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    for (int bits : ParseIntList(FLAGS_bloom_bits_per_level)) {
+      filter_policy_per_level_.push_back(
+          bits > 0 ? NewBloomFilterPolicy(bits) : nullptr);
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    for (const FilterPolicy* policy : filter_policy_per_level_) {
+      delete policy;
+    }
+    delete rate_limiter_;
   }
 
   void Run() {
@@ -593,11 +769,20 @@ class Benchmark {
       } else if (name == Slice("overwrite")) {
         fresh_db = false;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("overwritehot")) {
+        fresh_db = false;
+        method = &Benchmark::WriteHot;
       } else if (name == Slice("fillsync")) {
         fresh_db = true;
         num_ /= 1000;
         write_options_.sync = true;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillsyncwhilewriting")) {
+        fresh_db = true;
+        num_ /= 1000;
+        write_options_.sync = true;
+        num_threads++;  // Add extra thread for writing
+        method = &Benchmark::SyncWhileWriting;
       } else if (name == Slice("fill100K")) {
         fresh_db = true;
         num_ /= 1000;
@@ -624,13 +809,26 @@ class Benchmark {
         method = &Benchmark::DeleteSeq;
       } else if (name == Slice("deleterandom")) {
         method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("filltombstones")) {
+        fresh_db = true;
+        method = &Benchmark::FillTombstones;
+      } else if (name == Slice("readtombstones")) {
+        method = &Benchmark::ReadTombstones;
+      } else if (name == Slice("mergerandom")) {
+        method = &Benchmark::MergeRandom;
+      } else if (name == Slice("readmodifywrite")) {
+        method = &Benchmark::ReadModifyWrite;
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
+      } else if (name == Slice("compactrate")) {
+        method = &Benchmark::CompactRate;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("xxh3")) {
+        method = &Benchmark::XXH3;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -639,12 +837,24 @@ class Benchmark {
         method = &Benchmark::ZstdCompress;
       } else if (name == Slice("zstduncomp")) {
         method = &Benchmark::ZstdUncompress;
+      } else if (name == Slice("lz4comp")) {
+        method = &Benchmark::Lz4Compress;
+      } else if (name == Slice("lz4uncomp")) {
+        method = &Benchmark::Lz4Uncompress;
+      } else if (name == Slice("lz4hccomp")) {
+        method = &Benchmark::Lz4hcCompress;
+      } else if (name == Slice("lz4hcuncomp")) {
+        method = &Benchmark::Lz4hcUncompress;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("writeamp")) {
+        PrintStats("leveldb.write-amplification");
+      } else if (name == Slice("writestalls")) {
+        PrintStats("leveldb.write-stalls");
       } else {
         if (!name.empty()) {  // No error message for empty name
           std::fprintf(stderr, "unknown benchmark '%s'\n",
@@ -772,6 +982,31 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  void XXH3(ThreadState* thread) {
+    // Checksum about 500MB of data total
+    const int size = 4096;
+    const char* label = "(4K per op)";
+    std::string data(size, 'x');
+    int64_t bytes = 0;
+    uint64_t hash = 0;
+    bool ok = true;
+    while (ok && bytes < 500 * 1048576) {
+      ok = port::XXH3_Hash64(data.data(), size, &hash);
+      thread->stats.FinishedSingleOp();
+      bytes += size;
+    }
+    // Print so result is not dead
+    std::fprintf(stderr, "... hash=0x%llx\r",
+                 static_cast<unsigned long long>(hash));
+
+    if (!ok) {
+      thread->stats.AddMessage("(xxh3 not supported)");
+    } else {
+      thread->stats.AddBytes(bytes);
+      thread->stats.AddMessage(label);
+    }
+  }
+
   void SnappyCompress(ThreadState* thread) {
     Compress(thread, "snappy", &port::Snappy_Compress);
   }
@@ -799,6 +1034,32 @@ class Benchmark {
         &port::Zstd_Uncompress);
   }
 
+  void Lz4Compress(ThreadState* thread) {
+    Compress(thread, "lz4", &port::Lz4_Compress);
+  }
+
+  void Lz4Uncompress(ThreadState* thread) {
+    Uncompress(thread, "lz4", &port::Lz4_Compress, &port::Lz4_Uncompress);
+  }
+
+  void Lz4hcCompress(ThreadState* thread) {
+    Compress(thread, "lz4hc",
+             [](const char* input, size_t length, std::string* output) {
+               return port::Lz4hc_Compress(FLAGS_lz4hc_compression_level,
+                                           input, length, output);
+             });
+  }
+
+  void Lz4hcUncompress(ThreadState* thread) {
+    Uncompress(
+        thread, "lz4hc",
+        [](const char* input, size_t length, std::string* output) {
+          return port::Lz4hc_Compress(FLAGS_lz4hc_compression_level, input,
+                                      length, output);
+        },
+        &port::Lz4_Uncompress);
+  }
+
   void Open() {
     assert(db_ == nullptr);
     Options options;
@@ -813,9 +1074,42 @@ class Benchmark {
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.filter_policy_per_level = filter_policy_per_level_;
+    options.optimize_filters_for_hits = FLAGS_optimize_filters_for_hits;
+    options.rate_limiter = rate_limiter_;
+    options.bytes_per_sync = FLAGS_bytes_per_sync;
+    options.wal_bytes_per_sync = FLAGS_wal_bytes_per_sync;
+    options.use_direct_io_for_flush_and_compaction =
+        FLAGS_use_direct_io_for_flush_and_compaction;
+    options.use_direct_reads = FLAGS_use_direct_reads;
+    options.max_mmap_read_bytes = FLAGS_max_mmap_read_bytes;
+    options.merge_operator = &merge_operator_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.max_sequential_skip_in_iterations = FLAGS_max_sequential_skip;
+    options.compaction_style =
+        FLAGS_universal_compaction ? kUniversalCompaction : kLevelCompaction;
+    options.level_compaction_dynamic_level_bytes = FLAGS_dynamic_level_bytes;
+    options.compaction_priority =
+        static_cast<CompactionPriority>(FLAGS_compaction_priority);
+    options.deletion_compaction_percent = FLAGS_deletion_compaction_percent;
+    if (FLAGS_delayed_write_rate >= 0) {
+      options.delayed_write_rate = FLAGS_delayed_write_rate;
+    }
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
+    for (int n : ParseIntList(FLAGS_compression_per_level)) {
+      options.compression_per_level.push_back(static_cast<CompressionType>(n));
+    }
+    options.zstd_compression_level_per_level =
+        ParseIntList(FLAGS_zstd_compression_level_per_level);
+    options.lz4hc_compression_level = FLAGS_lz4hc_compression_level;
+    options.zstd_max_dict_bytes = FLAGS_zstd_max_dict_bytes;
+    options.zstd_max_train_bytes = FLAGS_zstd_max_train_bytes;
+    options.parallel_compression_threads = FLAGS_parallel_compression_threads;
+    options.pipelined_compaction = FLAGS_pipelined_compaction;
+    options.checksum = static_cast<ChecksumType>(FLAGS_checksum);
+    options.min_blob_size = FLAGS_min_blob_size;
+    options.blob_gc_age_cutoff = FLAGS_blob_gc_age_cutoff;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -831,11 +1125,13 @@ class Benchmark {
     }
   }
 
-  void WriteSeq(ThreadState* thread) { DoWrite(thread, true); }
+  void WriteSeq(ThreadState* thread) { DoWrite(thread, true, false); }
+
+  void WriteRandom(ThreadState* thread) { DoWrite(thread, false, false); }
 
-  void WriteRandom(ThreadState* thread) { DoWrite(thread, false); }
+  void WriteHot(ThreadState* thread) { DoWrite(thread, false, true); }
 
-  void DoWrite(ThreadState* thread, bool seq) {
+  void DoWrite(ThreadState* thread, bool seq, bool hot) {
     if (num_ != FLAGS_num) {
       char msg[100];
       std::snprintf(msg, sizeof(msg), "(%d ops)", num_);
@@ -850,7 +1146,14 @@ class Benchmark {
     for (int i = 0; i < num_; i += entries_per_batch_) {
       batch.Clear();
       for (int j = 0; j < entries_per_batch_; j++) {
-        const int k = seq ? i + j : thread->rand.Uniform(FLAGS_num);
+        int k;
+        if (seq) {
+          k = i + j;
+        } else if (hot && !thread->rand.OneIn(10)) {
+          k = thread->rand.Uniform((FLAGS_num + 9) / 10);
+        } else {
+          k = thread->rand.Uniform(FLAGS_num);
+        }
         key.Set(k);
         batch.Put(key.slice(), gen.Generate(value_size_));
         bytes += value_size_ + key.slice().size();
@@ -997,39 +1300,176 @@ class Benchmark {
 
   void DeleteRandom(ThreadState* thread) { DoDelete(thread, false); }
 
+  // Queue-like workload: every even key is written and deleted
+  // FLAGS_tombstones_per_key times, every odd key holds one live value.
+  void FillTombstones(ThreadState* thread) {
+    RandomGenerator gen;
+    WriteBatch batch;
+    Status s;
+    int64_t bytes = 0;
+    KeyBuffer key;
+    const int per_key = 2 * FLAGS_tombstones_per_key + 1;
+    for (int i = 0; i + per_key <= num_; i += per_key) {
+      const int k = 2 * (i / per_key);
+      batch.Clear();
+      key.Set(k);
+      for (int j = 0; j < FLAGS_tombstones_per_key; j++) {
+        batch.Put(key.slice(), gen.Generate(value_size_));
+        batch.Delete(key.slice());
+        bytes += value_size_ + 2 * key.slice().size();
+      }
+      key.Set(k + 1);
+      batch.Put(key.slice(), gen.Generate(value_size_));
+      bytes += value_size_ + key.slice().size();
+      s = db_->Write(write_options_, &batch);
+      if (!s.ok()) {
+        std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      for (int j = 0; j < per_key; j++) {
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void ReadTombstones(ThreadState* thread) {
+    std::string skipped_before, reseeks_before;
+    db_->GetProperty("leveldb.iterator-skipped-entries", &skipped_before);
+    db_->GetProperty("leveldb.iterator-reseeks", &reseeks_before);
+    ReadSequential(thread);
+    std::string skipped, reseeks;
+    db_->GetProperty("leveldb.iterator-skipped-entries", &skipped);
+    db_->GetProperty("leveldb.iterator-reseeks", &reseeks);
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%llu skipped, %llu reseeks)",
+                  std::stoull(skipped) - std::stoull(skipped_before),
+                  std::stoull(reseeks) - std::stoull(reseeks_before));
+    thread->stats.AddMessage(msg);
+  }
+
+  void MergeRandom(ThreadState* thread) {
+    KeyBuffer key;
+    std::string operand;
+    PutFixed64(&operand, 1);
+    int64_t bytes = 0;
+    for (int i = 0; i < num_; i++) {
+      key.Set(thread->rand.Uniform(FLAGS_num));
+      Status s = db_->Merge(write_options_, key.slice(), operand);
+      if (!s.ok()) {
+        std::fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      bytes += key.slice().size() + operand.size();
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  // The same updates as MergeRandom, done the way an application without
+  // a merge operator has to: read the counter and write it back while
+  // holding a lock so concurrent increments are not lost.
+  void ReadModifyWrite(ThreadState* thread) {
+    ReadOptions options;
+    KeyBuffer key;
+    std::string value;
+    std::string updated;
+    int64_t bytes = 0;
+    for (int i = 0; i < num_; i++) {
+      key.Set(thread->rand.Uniform(FLAGS_num));
+      MutexLock l(&counter_mutex_);
+      Status s = db_->Get(options, key.slice(), &value);
+      if (!s.ok() && !s.IsNotFound()) {
+        std::fprintf(stderr, "get error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      Slice current(value);
+      updated.clear();
+      PutFixed64(&updated, DecodeCounter(s.ok() ? &current : nullptr) + 1);
+      s = db_->Put(write_options_, key.slice(), updated);
+      if (!s.ok()) {
+        std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      bytes += key.slice().size() + updated.size();
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadWhileWriting(ThreadState* thread) {
     if (thread->tid > 0) {
       ReadRandom(thread);
     } else {
-      // Special thread that keeps writing until other threads are done.
-      RandomGenerator gen;
-      KeyBuffer key;
-      while (true) {
-        {
-          MutexLock l(&thread->shared->mu);
-          if (thread->shared->num_done + 1 >= thread->shared->num_initialized) {
-            // Other threads have finished
-            break;
-          }
-        }
+      WriteUntilOthersDone(thread);
+    }
+  }
 
-        const int k = thread->rand.Uniform(FLAGS_num);
-        key.Set(k);
-        Status s =
-            db_->Put(write_options_, key.slice(), gen.Generate(value_size_));
-        if (!s.ok()) {
-          std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
-          std::exit(1);
+  void SyncWhileWriting(ThreadState* thread) {
+    if (thread->tid > 0) {
+      WriteRandom(thread);
+    } else {
+      WriteUntilOthersDone(thread);
+    }
+  }
+
+  // Special thread that keeps writing in async mode until other threads
+  // are done.
+  void WriteUntilOthersDone(ThreadState* thread) {
+    RandomGenerator gen;
+    KeyBuffer key;
+    while (true) {
+      {
+        MutexLock l(&thread->shared->mu);
+        if (thread->shared->num_done + 1 >= thread->shared->num_initialized) {
+          // Other threads have finished
+          break;
         }
       }
 
-      // Do not count any of the preceding work/delay in stats.
-      thread->stats.Start();
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      Status s =
+          db_->Put(WriteOptions(), key.slice(), gen.Generate(value_size_));
+      if (!s.ok()) {
+        std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
     }
+
+    // Do not count any of the preceding work/delay in stats.
+    thread->stats.Start();
   }
 
   void Compact(ThreadState* thread) { db_->CompactRange(nullptr, nullptr); }
 
+  uint64_t GetIntProperty(const char* key) {
+    std::string value;
+    if (!db_->GetProperty(key, &value)) {
+      return 0;
+    }
+    return std::strtoull(value.c_str(), nullptr, 10);
+  }
+
+  void CompactRate(ThreadState* thread) {
+    const uint64_t read = GetIntProperty("leveldb.compaction-bytes-read");
+    const uint64_t written =
+        GetIntProperty("leveldb.compaction-bytes-written");
+    const uint64_t start_micros = g_env->NowMicros();
+    db_->CompactRange(nullptr, nullptr);
+    const double seconds = (g_env->NowMicros() - start_micros) * 1e-6;
+    const uint64_t bytes_in =
+        GetIntProperty("leveldb.compaction-bytes-read") - read;
+    const uint64_t bytes_out =
+        GetIntProperty("leveldb.compaction-bytes-written") - written;
+    thread->stats.AddBytes(bytes_in);
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(in %.1f MB/s, out %.1f MB/s)",
+                  bytes_in / 1048576.0 / seconds,
+                  bytes_out / 1048576.0 / seconds);
+    thread->stats.AddMessage(msg);
+  }
+
   void PrintStats(const char* key) {
     std::string stats;
     if (!db_->GetProperty(key, &stats)) {
@@ -1068,10 +1508,13 @@ int main(int argc, char** argv) {
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_max_sequential_skip =
+      leveldb::Options().max_sequential_skip_in_iterations;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
     double d;
+    long long ll;
     int n;
     char junk;
     if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
@@ -1093,6 +1536,44 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
+    } else if (sscanf(argv[i], "--universal_compaction=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_universal_compaction = n;
+    } else if (sscanf(argv[i], "--dynamic_level_bytes=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_dynamic_level_bytes = n;
+    } else if (sscanf(argv[i], "--compaction_priority=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_compaction_priority = n;
+    } else if (sscanf(argv[i], "--deletion_compaction_percent=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_deletion_compaction_percent = n;
+    } else if (sscanf(argv[i], "--delayed_write_rate=%d%c", &n, &junk) == 1) {
+      FLAGS_delayed_write_rate = n;
+    } else if (sscanf(argv[i], "--rate_limiter_bytes_per_sec=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_rate_limiter_bytes_per_sec = n;
+    } else if (sscanf(argv[i], "--rate_limiter_auto_tuned=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_rate_limiter_auto_tuned = n;
+    } else if (sscanf(argv[i], "--bytes_per_sync=%d%c", &n, &junk) == 1) {
+      FLAGS_bytes_per_sync = n;
+    } else if (sscanf(argv[i], "--wal_bytes_per_sync=%d%c", &n, &junk) == 1) {
+      FLAGS_wal_bytes_per_sync = n;
+    } else if (sscanf(argv[i], "--use_direct_io_for_flush_and_compaction=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_io_for_flush_and_compaction = n;
+    } else if (sscanf(argv[i], "--use_direct_reads=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_reads = n;
+    } else if (sscanf(argv[i], "--max_mmap_read_bytes=%lld%c", &ll, &junk) ==
+               1) {
+      FLAGS_max_mmap_read_bytes = ll;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1115,6 +1596,44 @@ int main(int argc, char** argv) {
       FLAGS_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--tombstones_per_key=%d%c", &n, &junk) == 1) {
+      FLAGS_tombstones_per_key = n;
+    } else if (sscanf(argv[i], "--max_sequential_skip=%d%c", &n, &junk) == 1) {
+      FLAGS_max_sequential_skip = n;
+    } else if (sscanf(argv[i], "--lz4hc_compression_level=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_lz4hc_compression_level = n;
+    } else if (sscanf(argv[i], "--zstd_max_dict_bytes=%d%c", &n, &junk) == 1) {
+      FLAGS_zstd_max_dict_bytes = n;
+    } else if (sscanf(argv[i], "--zstd_max_train_bytes=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_zstd_max_train_bytes = n;
+    } else if (sscanf(argv[i], "--optimize_filters_for_hits=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_optimize_filters_for_hits = n;
+    } else if (sscanf(argv[i], "--pipelined_compaction=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pipelined_compaction = n;
+    } else if (sscanf(argv[i], "--checksum=%d%c", &n, &junk) == 1 &&
+               (n == leveldb::kCRC32c || n == leveldb::kXXH3)) {
+      FLAGS_checksum = n;
+    } else if (sscanf(argv[i], "--min_blob_size=%d%c", &n, &junk) == 1) {
+      FLAGS_min_blob_size = n;
+    } else if (sscanf(argv[i], "--blob_gc_age_cutoff=%lf%c", &d, &junk) ==
+               1) {
+      FLAGS_blob_gc_age_cutoff = d;
+    } else if (sscanf(argv[i], "--parallel_compression_threads=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_parallel_compression_threads = n;
+    } else if (strncmp(argv[i], "--bloom_bits_per_level=", 23) == 0) {
+      FLAGS_bloom_bits_per_level = argv[i] + 23;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0) {
+      FLAGS_compression_per_level = argv[i] + 24;
+    } else if (strncmp(argv[i], "--zstd_compression_level_per_level=", 35) ==
+               0) {
+      FLAGS_zstd_compression_level_per_level = argv[i] + 35;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
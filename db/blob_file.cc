@@ -0,0 +1,299 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/blob_file.h"
+
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/range_sync_file.h"
+
+namespace leveldb {
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file_number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+bool BlobIndex::DecodeFrom(Slice input) {
+  return GetVarint64(&input, &file_number) && GetVarint64(&input, &offset) &&
+         GetVarint64(&input, &size) && input.empty();
+}
+
+BlobFileBuilder::BlobFileBuilder(const std::string& dbname,
+                                 const Options& options, uint64_t number,
+                                 RateLimiter::Priority priority)
+    : dbname_(dbname),
+      options_(options),
+      number_(number),
+      priority_(priority),
+      file_(nullptr),
+      offset_(0),
+      num_values_(0) {}
+
+BlobFileBuilder::~BlobFileBuilder() { delete file_; }
+
+Status BlobFileBuilder::OpenFile() {
+  const std::string fname = BlobFileName(dbname_, number_);
+  Env* env = options_.env;
+  Status s;
+  if (options_.use_direct_io_for_flush_and_compaction) {
+    s = env->NewDirectWritableFile(fname, &file_);
+  } else {
+    s = env->NewWritableFile(fname, &file_);
+  }
+  if (!s.ok()) {
+    file_ = nullptr;
+    return s;
+  }
+  file_ = NewRangeSyncWritableFile(file_, options_.bytes_per_sync);
+  if (options_.rate_limiter != nullptr) {
+    file_ = NewRateLimitedWritableFile(file_, options_.rate_limiter,
+                                       priority_);
+  }
+  return s;
+}
+
+Status BlobFileBuilder::MaybeAdd(Slice* key, Slice* value) {
+  if (options_.min_blob_size == 0 || value->size() < options_.min_blob_size ||
+      ExtractValueType(*key) != kTypeValue) {
+    return Status::OK();
+  }
+  Status s;
+  if (file_ == nullptr) {
+    s = OpenFile();
+  }
+  char trailer[kBlobTrailerSize];
+  EncodeFixed32(trailer,
+                crc32c::Mask(crc32c::Value(value->data(), value->size())));
+  if (s.ok()) {
+    s = file_->Append(*value);
+  }
+  if (s.ok()) {
+    s = file_->Append(Slice(trailer, sizeof(trailer)));
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  BlobIndex index;
+  index.file_number = number_;
+  index.offset = offset_;
+  index.size = value->size();
+  offset_ += value->size() + kBlobTrailerSize;
+  num_values_++;
+
+  key_.assign(key->data(), key->size());
+  key_[key_.size() - 8] = static_cast<char>(kTypeBlobIndex);
+  index_.clear();
+  index.EncodeTo(&index_);
+  *key = key_;
+  *value = index_;
+  return s;
+}
+
+Status BlobFileBuilder::Finish() {
+  if (file_ == nullptr) {
+    return Status::OK();
+  }
+  Status s = file_->Sync();
+  if (s.ok()) {
+    s = file_->Close();
+  }
+  delete file_;
+  file_ = nullptr;
+  return s;
+}
+
+static void DeleteBlobFile(const Slice& key, void* value) {
+  delete reinterpret_cast<RandomAccessFile*>(value);
+}
+
+static void DeleteBlobValue(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+BlobFileCache::BlobFileCache(const std::string& dbname, const Options& options,
+                             int entries)
+    : env_(options.env),
+      dbname_(dbname),
+      options_(options),
+      cache_(NewLRUCache(entries)),
+      block_cache_id_(options.block_cache != nullptr
+                          ? options.block_cache->NewId()
+                          : 0) {}
+
+BlobFileCache::~BlobFileCache() { delete cache_; }
+
+Status BlobFileCache::FindFile(uint64_t file_number, Cache::Handle** handle) {
+  Status s;
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  Slice key(buf, sizeof(buf));
+  *handle = cache_->Lookup(key);
+  if (*handle == nullptr) {
+    const std::string fname = BlobFileName(dbname_, file_number);
+    RandomAccessFile* file = nullptr;
+    if (options_.use_direct_reads) {
+      s = env_->NewDirectRandomAccessFile(fname, &file);
+    } else {
+      s = env_->NewRandomAccessFile(fname, &file);
+    }
+    if (s.ok()) {
+      // Values are read one at a time
+      file->Hint(RandomAccessFile::kRandom);
+      *handle = cache_->Insert(key, file, 1, &DeleteBlobFile);
+    }
+  }
+  return s;
+}
+
+Status BlobFileCache::Get(const ReadOptions& options, const Slice& index_data,
+                          std::string* value) {
+  BlobIndex index;
+  if (!index.DecodeFrom(index_data)) {
+    return Status::Corruption("bad blob index");
+  }
+
+  Cache* block_cache = options_.block_cache;
+  char cache_key_buffer[24];
+  EncodeFixed64(cache_key_buffer, block_cache_id_);
+  EncodeFixed64(cache_key_buffer + 8, index.file_number);
+  EncodeFixed64(cache_key_buffer + 16, index.offset);
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != nullptr) {
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      *value =
+          *reinterpret_cast<std::string*>(block_cache->Value(cache_handle));
+      block_cache->Release(cache_handle);
+      return Status::OK();
+    }
+  }
+
+  Cache::Handle* handle = nullptr;
+  Status s = FindFile(index.file_number, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+  RandomAccessFile* file =
+      reinterpret_cast<RandomAccessFile*>(cache_->Value(handle));
+  const size_t n = static_cast<size_t>(index.size) + kBlobTrailerSize;
+  char* buf = new char[n];
+  Slice contents;
+  s = file->Read(index.offset, n, &contents, buf);
+  cache_->Release(handle);
+  if (s.ok() && contents.size() != n) {
+    s = Status::Corruption("truncated blob record");
+  }
+  if (s.ok() && (options.verify_checksums || options_.paranoid_checks)) {
+    const size_t value_size = n - kBlobTrailerSize;
+    const uint32_t crc =
+        crc32c::Unmask(DecodeFixed32(contents.data() + value_size));
+    const uint32_t actual = crc32c::Value(contents.data(), value_size);
+    if (actual != crc) {
+      s = Status::Corruption("blob checksum mismatch");
+    }
+  }
+  if (s.ok()) {
+    value->assign(contents.data(), n - kBlobTrailerSize);
+    if (block_cache != nullptr && options.fill_cache) {
+      Cache::Handle* cache_handle =
+          block_cache->Insert(cache_key, new std::string(*value),
+                              value->size(), &DeleteBlobValue);
+      block_cache->Release(cache_handle);
+    }
+  }
+  delete[] buf;
+  return s;
+}
+
+void BlobFileCache::Evict(uint64_t file_number) {
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
+namespace {
+
+class BlobResolvingIterator : public Iterator {
+ public:
+  BlobResolvingIterator(Iterator* iter, BlobFileCache* cache,
+                        const ReadOptions& options)
+      : iter_(iter), cache_(cache), options_(options), is_blob_(false) {}
+
+  ~BlobResolvingIterator() override { delete iter_; }
+
+  bool Valid() const override { return status_.ok() && iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Update();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Update();
+  }
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    Update();
+  }
+  void Next() override {
+    iter_->Next();
+    Update();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Update();
+  }
+  Slice key() const override { return is_blob_ ? Slice(key_) : iter_->key(); }
+  Slice value() const override {
+    return is_blob_ ? Slice(value_) : iter_->value();
+  }
+  Status status() const override {
+    Status s = iter_->status();
+    return s.ok() ? status_ : s;
+  }
+
+ private:
+  // Read the value of the current entry if it is in a blob file.  On a
+  // read error, the iterator becomes invalid and keeps the error.
+  void Update() {
+    is_blob_ = false;
+    if (!status_.ok() || !iter_->Valid()) {
+      return;
+    }
+    const Slice k = iter_->key();
+    if (k.size() >= 8 && ExtractValueType(k) == kTypeBlobIndex) {
+      status_ = cache_->Get(options_, iter_->value(), &value_);
+      if (!status_.ok()) {
+        value_.clear();
+        return;
+      }
+      is_blob_ = true;
+      key_.assign(k.data(), k.size());
+      key_[key_.size() - 8] = static_cast<char>(kTypeValue);
+    }
+  }
+
+  Iterator* const iter_;
+  BlobFileCache* const cache_;
+  const ReadOptions options_;
+  bool is_blob_;       // The current entry is a kTypeBlobIndex entry
+  std::string key_;    // Its key, as a kTypeValue entry
+  std::string value_;  // Its value, read from the blob file
+  Status status_;      // First error reading a value
+};
+
+}  // namespace
+
+Iterator* NewBlobResolvingIterator(Iterator* iter, BlobFileCache* cache,
+                                   const ReadOptions& options) {
+  return new BlobResolvingIterator(iter, cache, options);
+}
+
+}  // namespace leveldb
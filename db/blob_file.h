@@ -0,0 +1,126 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Blob files hold the values that are too large to be kept in table files
+// (see Options::min_blob_size).  A blob file is a sequence of records, each
+// a value followed by the masked crc32c of the value.  Tables refer to a
+// record with a kTypeBlobIndex entry whose value is a BlobIndex.  Blob files
+// are never modified; one is deleted once no live table refers to it.
+
+#ifndef STORAGE_LEVELDB_DB_BLOB_FILE_H_
+#define STORAGE_LEVELDB_DB_BLOB_FILE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/cache.h"
+#include "leveldb/options.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+class Iterator;
+class WritableFile;
+
+// Size of the checksum that follows each value in a blob file
+static const size_t kBlobTrailerSize = 4;
+
+// The location of a value in a blob file
+struct BlobIndex {
+  uint64_t file_number;
+  uint64_t offset;
+  uint64_t size;  // Size of the value, excluding its trailer
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(Slice input);
+};
+
+// Writes the values of a table file being built to a blob file.
+class BlobFileBuilder {
+ public:
+  // Write the blob file "number" of the database "dbname", with
+  // "priority" if options.rate_limiter is set.  The file is only created
+  // if a value is added to it.
+  BlobFileBuilder(const std::string& dbname, const Options& options,
+                  uint64_t number, RateLimiter::Priority priority);
+
+  BlobFileBuilder(const BlobFileBuilder&) = delete;
+  BlobFileBuilder& operator=(const BlobFileBuilder&) = delete;
+
+  ~BlobFileBuilder();
+
+  // If the internal key "*key" is a kTypeValue entry whose "*value" has
+  // at least options.min_blob_size bytes, append the value to the file
+  // and point *key and *value at a kTypeBlobIndex entry that refers to it.
+  // The new entry remains valid until the next call.
+  Status MaybeAdd(Slice* key, Slice* value);
+
+  // Sync and close the file, if it was created.
+  Status Finish();
+
+  uint64_t number() const { return number_; }
+
+  // Number of values added so far
+  uint64_t NumValues() const { return num_values_; }
+
+  // Size of the file generated so far
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  Status OpenFile();
+
+  const std::string dbname_;
+  const Options& options_;
+  const uint64_t number_;
+  const RateLimiter::Priority priority_;
+  WritableFile* file_;
+  uint64_t offset_;
+  uint64_t num_values_;
+  std::string key_;    // Key of the last entry returned by MaybeAdd()
+  std::string index_;  // Value of the last entry returned by MaybeAdd()
+};
+
+// Thread-safe cache of the open blob files of a database.  Values read
+// through it are also kept in options.block_cache, if set.
+class BlobFileCache {
+ public:
+  BlobFileCache(const std::string& dbname, const Options& options,
+                int entries);
+
+  BlobFileCache(const BlobFileCache&) = delete;
+  BlobFileCache& operator=(const BlobFileCache&) = delete;
+
+  ~BlobFileCache();
+
+  // Store in *value the value that the encoded BlobIndex "index" refers to.
+  Status Get(const ReadOptions& options, const Slice& index,
+             std::string* value);
+
+  // Evict any entry for the specified file number
+  void Evict(uint64_t file_number);
+
+ private:
+  Status FindFile(uint64_t file_number, Cache::Handle** handle);
+
+  Env* const env_;
+  const std::string dbname_;
+  const Options& options_;
+  Cache* cache_;
+  const uint64_t block_cache_id_;  // Prefix of our keys in the block cache
+};
+
+// Return an iterator over the internal entries of "iter" that presents
+// each kTypeBlobIndex entry as the kTypeValue entry it stands for.  The
+// value is read through "cache" with "options" when the iterator is
+// positioned on the entry.  If that read fails, the iterator becomes
+// invalid and status() returns the error from then on, so that no entry
+// is ever presented without its value.  Takes ownership of "iter".
+Iterator* NewBlobResolvingIterator(Iterator* iter, BlobFileCache* cache,
+                                   const ReadOptions& options);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_BLOB_FILE_H_
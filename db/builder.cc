@@ -4,6 +4,9 @@
 
 #include "db/builder.h"
 
+#include <algorithm>
+
+#include "db/blob_file.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/table_cache.h"
@@ -11,36 +14,107 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/rate_limiter.h"
+#include "util/range_sync_file.h"
 
 namespace leveldb {
 
+Options TableOptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  if (!options.compression_per_level.empty()) {
+    result.compression = options.compression_per_level[std::min<size_t>(
+        level, options.compression_per_level.size() - 1)];
+  }
+  if (!options.zstd_compression_level_per_level.empty()) {
+    result.zstd_compression_level =
+        options.zstd_compression_level_per_level[std::min<size_t>(
+            level, options.zstd_compression_level_per_level.size() - 1)];
+  }
+  if (!options.filter_policy_per_level.empty()) {
+    result.filter_policy = options.filter_policy_per_level[std::min<size_t>(
+        level, options.filter_policy_per_level.size() - 1)];
+  }
+  return result;
+}
+
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, BlobFileBuilder* blob_builder,
+                  CompressionWorkerPool* compression_workers,
+                  FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->num_range_deletions = 0;
+  meta->num_entries = 0;
+  meta->num_deletions = 0;
+  meta->blob_files.clear();
   iter->SeekToFirst();
+  range_del_iter->SeekToFirst();
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || range_del_iter->Valid()) {
     WritableFile* file;
-    s = env->NewWritableFile(fname, &file);
+    if (options.use_direct_io_for_flush_and_compaction) {
+      s = env->NewDirectWritableFile(fname, &file);
+    } else {
+      s = env->NewWritableFile(fname, &file);
+    }
     if (!s.ok()) {
       return s;
     }
+    file = NewRangeSyncWritableFile(file, options.bytes_per_sync);
+    if (options.rate_limiter != nullptr) {
+      // Writes stall when flushes fall behind, so they go first
+      file = NewRateLimitedWritableFile(file, options.rate_limiter,
+                                        RateLimiter::kHigh);
+    }
 
-    TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    TableBuilder* builder = new TableBuilder(TableOptionsForLevel(options, 0),
+                                             file, compression_workers);
     Slice key;
-    for (; iter->Valid(); iter->Next()) {
+    for (; s.ok() && iter->Valid(); iter->Next()) {
       key = iter->key();
-      builder->Add(key, iter->value());
+      Slice value = iter->value();
+      if (blob_builder != nullptr) {
+        s = blob_builder->MaybeAdd(&key, &value);
+      }
+      if (builder->NumEntries() == 0) {
+        meta->smallest.DecodeFrom(key);
+      }
+      builder->Add(key, value);
+      if (ExtractValueType(key) == kTypeDeletion) {
+        meta->num_deletions++;
+      }
+    }
+    if (blob_builder != nullptr && blob_builder->NumValues() > 0) {
+      meta->blob_files.push_back(blob_builder->number());
+      if (s.ok()) {
+        s = blob_builder->Finish();
+      }
     }
+    meta->num_entries = builder->NumEntries();
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
 
+    // Widen the file's key range to the deleted ranges
+    const InternalKeyComparator& icmp =
+        *static_cast<const InternalKeyComparator*>(options.comparator);
+    for (; range_del_iter->Valid(); range_del_iter->Next()) {
+      const Slice start = range_del_iter->key();
+      builder->AddRangeDeletion(start, range_del_iter->value());
+      ExtendKeyRangeForTombstone(icmp, start, range_del_iter->value(),
+                                 &meta->smallest, &meta->largest);
+    }
+    meta->num_range_deletions = builder->NumRangeDeletions();
+
     // Finish and check for builder errors
-    s = builder->Finish();
+    if (s.ok()) {
+      builder->SetNumDeletions(meta->num_deletions);
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
     if (s.ok()) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
@@ -12,18 +12,33 @@ namespace leveldb {
 struct Options;
 struct FileMetaData;
 
+class BlobFileBuilder;
+class CompressionWorkerPool;
 class Env;
 class Iterator;
 class TableCache;
 class VersionEdit;
 
-// Build a Table file from the contents of *iter.  The generated file
-// will be named according to meta->number.  On success, the rest of
-// *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+// Return a copy of "options" with the compression settings for table files
+// written to "level".
+Options TableOptionsForLevel(const Options& options, int level);
+
+// Build a Table file from the contents of *iter and the range tombstones
+// yielded by *range_del_iter.  The generated file will be named according
+// to meta->number.  On success, the rest of *meta will be filled with
+// metadata about the generated table.
+// If no data is present in either iterator, meta->file_size will be set
+// to zero, and no Table file will be produced.
+//
+// If "blob_builder" is non-null, the values that options.min_blob_size
+// selects are written to it instead of the table, and it is finished
+// before the table is.  If "compression_workers" is non-null, the data
+// blocks are compressed by its threads.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, BlobFileBuilder* blob_builder,
+                  CompressionWorkerPool* compression_workers,
+                  FileMetaData* meta);
 
 }  // namespace leveldb
 
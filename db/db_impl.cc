@@ -8,10 +8,13 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <limits>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
@@ -19,26 +22,40 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/compression_worker_pool.h"
 #include "table/merger.h"
+#include "table/prefetching_iterator.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/range_sync_file.h"
 
 namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Lowest rate in bytes per second that writes are throttled to
+static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+// Bytes of entries a pipelined compaction reads ahead of its merge
+static const size_t kCompactionReadaheadBytes = 1 << 20;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
@@ -56,7 +73,11 @@ struct DBImpl::CompactionState {
   struct Output {
     uint64_t number;
     uint64_t file_size;
+    uint64_t num_range_deletions;
+    uint64_t num_entries;
+    uint64_t num_deletions;
     InternalKey smallest, largest;
+    std::set<uint64_t> blob_files;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
@@ -64,8 +85,15 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        largest_snapshot(0),
+        range_dels(nullptr),
+        has_output_lower_bound(false),
+        filtered_entries(0),
         outfile(nullptr),
         builder(nullptr),
+        blob_builder(nullptr),
+        blob_gc_cutoff(0),
+        blob_bytes_read(0),
         total_bytes(0) {}
 
   Compaction* const compaction;
@@ -76,12 +104,43 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // No snapshot sees entries newer than largest_snapshot (0 if there are
+  // no snapshots), so only those may be passed to the compaction filter.
+  SequenceNumber largest_snapshot;
+
   std::vector<Output> outputs;
 
+  // Range tombstones of the compaction inputs, or nullptr if there are
+  // none.  Entries they delete for every snapshot are dropped.
+  RangeTombstoneList* range_dels;
+
+  // Input tombstones that must be written to the outputs.  Each output
+  // receives the part of them between the previous output's upper bound
+  // (the first user key of this output; -inf for the first one) and the
+  // first user key of the next output (+inf for the last one).
+  std::vector<RangeTombstone> output_range_dels;
+  bool has_output_lower_bound;
+  std::string output_lower_bound;
+
+  // Number of entries deleted by options_.compaction_filter
+  int64_t filtered_entries;
+
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
 
+  // Blob file shared by the outputs, or nullptr if values are not moved
+  // to blob files
+  BlobFileBuilder* blob_builder;
+
+  // Values in blob files numbered below this are copied to the outputs
+  uint64_t blob_gc_cutoff;
+
+  // Entry whose value was read back from a blob file
+  std::string blob_key;
+  std::string blob_value;
+  uint64_t blob_bytes_read;
+
   uint64_t total_bytes;
 };
 
@@ -91,17 +150,50 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
   if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
   if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
 }
-Options SanitizeOptions(const std::string& dbname,
-                        const InternalKeyComparator* icmp,
-                        const InternalFilterPolicy* ipolicy,
-                        const Options& src) {
+
+// Fix the options that DB::SetOptions() may change to be reasonable
+static void SanitizeMutableOptions(Options* options) {
+  ClipToRange(&options->write_buffer_size, 64 << 10, 1 << 30);
+  ClipToRange(&options->max_file_size, 1 << 20, 1 << 30);
+  ClipToRange(&options->level0_file_num_compaction_trigger, 1, 1 << 16);
+  ClipToRange(&options->level0_slowdown_writes_trigger,
+              options->level0_file_num_compaction_trigger, 1 << 16);
+  ClipToRange(&options->level0_stop_writes_trigger,
+              options->level0_slowdown_writes_trigger, 1 << 16);
+  if (options->compaction_style == kUniversalCompaction) {
+    // Level-0 files alone must be able to trigger a universal compaction
+    ClipToRange(&options->level0_stop_writes_trigger,
+                options->universal_compaction_trigger, 1 << 16);
+  }
+  ClipToRange(&options->max_mem_compaction_level, 0, config::kNumLevels - 1);
+  ClipToRange(&options->delayed_write_rate, kMinDelayedWriteRate,
+              std::numeric_limits<uint64_t>::max());
+  if (options->hard_pending_compaction_bytes_limit > 0) {
+    options->soft_pending_compaction_bytes_limit =
+        std::min(options->soft_pending_compaction_bytes_limit,
+                 options->hard_pending_compaction_bytes_limit);
+  }
+}
+
+Options SanitizeOptions(
+    const std::string& dbname, const InternalKeyComparator* icmp,
+    const InternalFilterPolicy* ipolicy,
+    const std::vector<InternalFilterPolicy>* ipolicy_per_level,
+    const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  for (size_t i = 0; i < result.filter_policy_per_level.size(); i++) {
+    if (result.filter_policy_per_level[i] != nullptr) {
+      result.filter_policy_per_level[i] = &(*ipolicy_per_level)[i];
+    }
+  }
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
-  ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
-  ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.universal_compaction_trigger, 2, 1 << 16);
+  ClipToRange(&result.deletion_compaction_percent, 0, 100);
+  ClipToRange(&result.blob_gc_age_cutoff, 0.0, 1.0);
+  SanitizeMutableOptions(&result);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -123,16 +215,43 @@ static int TableCacheSize(const Options& sanitized_options) {
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
 }
 
+static int BlobFileCacheSize(const Options& sanitized_options) {
+  // Blob files are much larger than tables, so there are fewer of them.
+  return std::max(TableCacheSize(sanitized_options) / 10, 1);
+}
+
+// Return the compression workers for a DB opened with "options", or
+// nullptr if it compresses inline.
+static CompressionWorkerPool* NewCompressionWorkers(const Options& options) {
+  int num_threads = options.parallel_compression_threads;
+  if (options.pipelined_compaction) {
+    // Compaction outputs are compressed off the compaction thread
+    num_threads = std::max(num_threads, 1);
+  }
+  if (num_threads <= 0) {
+    return nullptr;
+  }
+  return new CompressionWorkerPool(options.env, num_threads);
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_per_level_(
+          raw_options.filter_policy_per_level.begin(),
+          raw_options.filter_policy_per_level.end()),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_filter_policy_per_level_,
+                               raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
       table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
+      blob_cache_(
+          new BlobFileCache(dbname_, options_, BlobFileCacheSize(options_))),
+      compression_workers_(NewCompressionWorkers(options_)),
       db_lock_(nullptr),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
@@ -146,8 +265,14 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       tmp_batch_(new WriteBatch),
       background_compaction_scheduled_(false),
       manual_compaction_(nullptr),
-      versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+      mutable_options_(options_),
+      versions_(new VersionSet(dbname_, &mutable_options_, table_cache_,
+                               blob_cache_, &internal_comparator_)),
+      user_bytes_written_(0),
+      delayed_write_rate_(0),
+      next_write_micros_(0),
+      iter_skipped_entries_(0),
+      iter_reseeks_(0) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
@@ -169,6 +294,8 @@ DBImpl::~DBImpl() {
   delete log_;
   delete logfile_;
   delete table_cache_;
+  delete blob_cache_;
+  delete compression_workers_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -254,6 +381,7 @@ void DBImpl::RemoveObsoleteFiles() {
           keep = (number >= versions_->ManifestFileNumber());
           break;
         case kTableFile:
+        case kBlobFile:
           keep = (live.find(number) != live.end());
           break;
         case kTempFile:
@@ -272,6 +400,8 @@ void DBImpl::RemoveObsoleteFiles() {
         files_to_delete.push_back(std::move(filename));
         if (type == kTableFile) {
           table_cache_->Evict(number);
+        } else if (type == kBlobFile) {
+          blob_cache_->Evict(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n", static_cast<int>(type),
             static_cast<unsigned long long>(number));
@@ -452,7 +582,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *max_sequence = last_seq;
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+    if (mem->ApproximateMemoryUsage() > mutable_options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
       status = WriteLevel0Table(mem, edit, nullptr);
@@ -477,6 +607,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
+      logfile_ = NewRangeSyncWritableFile(
+          logfile_, options_.wal_bytes_per_sync, lfile_size);
       log_ = new log::Writer(logfile_, lfile_size);
       logfile_number_ = log_number;
       if (mem != nullptr) {
@@ -509,21 +641,47 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  BlobFileBuilder* blob_builder = nullptr;
+  if (options_.min_blob_size > 0) {
+    // Writes stall when flushes fall behind, so they go first
+    blob_builder = new BlobFileBuilder(
+        dbname_, options_, versions_->NewFileNumber(), RateLimiter::kHigh);
+    pending_outputs_.insert(blob_builder->number());
+  }
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeDelIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, range_del_iter,
+                   blob_builder,
+                   options_.parallel_compression_threads > 0
+                       ? compression_workers_
+                       : nullptr,
+                   &meta);
     mutex_.Lock();
   }
+  uint64_t blob_bytes = 0;
+  if (blob_builder != nullptr) {
+    blob_bytes = blob_builder->FileSize();
+    if (blob_builder->NumValues() > 0) {
+      Log(options_.info_log, "Level-0 table #%llu: %lld values in blob #%llu",
+          (unsigned long long)meta.number,
+          (unsigned long long)blob_builder->NumValues(),
+          (unsigned long long)blob_builder->number());
+    }
+    pending_outputs_.erase(blob_builder->number());
+    delete blob_builder;
+  }
 
   Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s",
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
+  delete range_del_iter;
   pending_outputs_.erase(meta.number);
 
   // Note that if file_size is zero, the file has been deleted and
@@ -532,16 +690,16 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
+    if (base != nullptr && options_.compaction_style == kLevelCompaction &&
+        !options_.level_compaction_dynamic_level_bytes) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
-  stats.bytes_written = meta.file_size;
+  stats.bytes_written = meta.file_size + blob_bytes;
   stats_[level].Add(stats);
   return s;
 }
@@ -596,6 +754,84 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+Status DBImpl::SetOptions(
+    const std::map<std::string, std::string>& new_options) {
+  MutexLock l(&mutex_);
+  Options options = mutable_options_;
+  for (const auto& option : new_options) {
+    Slice in = option.second;
+    uint64_t value;
+    if (!ConsumeDecimalNumber(&in, &value) || !in.empty()) {
+      return Status::InvalidArgument(option.first, "value is not a number");
+    }
+    const std::string& name = option.first;
+    if (name == "delayed_write_rate") {
+      options.delayed_write_rate = value;
+      continue;
+    } else if (name == "soft_pending_compaction_bytes_limit") {
+      options.soft_pending_compaction_bytes_limit = value;
+      continue;
+    } else if (name == "hard_pending_compaction_bytes_limit") {
+      options.hard_pending_compaction_bytes_limit = value;
+      continue;
+    }
+    value = std::min<uint64_t>(value, 1 << 30);
+    if (name == "write_buffer_size") {
+      options.write_buffer_size = value;
+    } else if (name == "max_file_size") {
+      options.max_file_size = value;
+    } else if (name == "level0_file_num_compaction_trigger") {
+      options.level0_file_num_compaction_trigger = value;
+    } else if (name == "level0_slowdown_writes_trigger") {
+      options.level0_slowdown_writes_trigger = value;
+    } else if (name == "level0_stop_writes_trigger") {
+      options.level0_stop_writes_trigger = value;
+    } else if (name == "max_mem_compaction_level") {
+      options.max_mem_compaction_level = value;
+    } else {
+      return Status::InvalidArgument(name, "not a mutable option");
+    }
+  }
+  SanitizeMutableOptions(&options);
+
+  // Assign the fields one by one: the others are read without mutex_.
+  mutable_options_.write_buffer_size = options.write_buffer_size;
+  mutable_options_.max_file_size = options.max_file_size;
+  mutable_options_.level0_file_num_compaction_trigger =
+      options.level0_file_num_compaction_trigger;
+  mutable_options_.level0_slowdown_writes_trigger =
+      options.level0_slowdown_writes_trigger;
+  mutable_options_.level0_stop_writes_trigger =
+      options.level0_stop_writes_trigger;
+  mutable_options_.max_mem_compaction_level = options.max_mem_compaction_level;
+  mutable_options_.delayed_write_rate = options.delayed_write_rate;
+  mutable_options_.soft_pending_compaction_bytes_limit =
+      options.soft_pending_compaction_bytes_limit;
+  mutable_options_.hard_pending_compaction_bytes_limit =
+      options.hard_pending_compaction_bytes_limit;
+  Log(options_.info_log,
+      "SetOptions: write_buffer_size=%llu max_file_size=%llu "
+      "level0 triggers=%d/%d/%d max_mem_compaction_level=%d "
+      "delayed_write_rate=%llu pending compaction limits=%llu/%llu",
+      static_cast<unsigned long long>(options.write_buffer_size),
+      static_cast<unsigned long long>(options.max_file_size),
+      options.level0_file_num_compaction_trigger,
+      options.level0_slowdown_writes_trigger,
+      options.level0_stop_writes_trigger, options.max_mem_compaction_level,
+      static_cast<unsigned long long>(options.delayed_write_rate),
+      static_cast<unsigned long long>(
+          options.soft_pending_compaction_bytes_limit),
+      static_cast<unsigned long long>(
+          options.hard_pending_compaction_bytes_limit));
+
+  // The compaction score depends on the level-0 trigger, and writers
+  // waiting for level-0 to shrink may now proceed.
+  versions_->UpdateCompactionScore();
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+  return Status::OK();
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
@@ -734,15 +970,14 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+    c->edit()->AddFile(c->output_level(), *f);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
+        static_cast<unsigned long long>(f->number), c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
@@ -790,6 +1025,11 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
     assert(compact->outfile == nullptr);
   }
   delete compact->outfile;
+  delete compact->range_dels;
+  if (compact->blob_builder != nullptr) {
+    pending_outputs_.erase(compact->blob_builder->number());
+    delete compact->blob_builder;
+  }
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     pending_outputs_.erase(out.number);
@@ -807,6 +1047,9 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     pending_outputs_.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
+    out.num_range_deletions = 0;
+    out.num_entries = 0;
+    out.num_deletions = 0;
     out.smallest.Clear();
     out.largest.Clear();
     compact->outputs.push_back(out);
@@ -815,9 +1058,29 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s;
+  if (options_.use_direct_io_for_flush_and_compaction) {
+    s = env_->NewDirectWritableFile(fname, &compact->outfile);
+  } else {
+    s = env_->NewWritableFile(fname, &compact->outfile);
+  }
+  if (s.ok()) {
+    compact->outfile =
+        NewRangeSyncWritableFile(compact->outfile, options_.bytes_per_sync);
+  }
+  if (s.ok() && options_.rate_limiter != nullptr) {
+    compact->outfile = NewRateLimitedWritableFile(
+        compact->outfile, options_.rate_limiter, RateLimiter::kLow);
+  }
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    Options table_options =
+        TableOptionsForLevel(options_, compact->compaction->output_level());
+    if (options_.optimize_filters_for_hits &&
+        compact->compaction->IsBottommostLevel()) {
+      table_options.filter_policy = nullptr;
+    }
+    compact->builder = new TableBuilder(table_options, compact->outfile,
+                                        compression_workers_);
   }
   return s;
 }
@@ -834,7 +1097,11 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
+  compact->current_output()->num_range_deletions =
+      compact->builder->NumRangeDeletions();
+  compact->current_output()->num_entries = current_entries;
   if (s.ok()) {
+    compact->builder->SetNumDeletions(compact->current_output()->num_deletions);
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
@@ -855,48 +1122,343 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = nullptr;
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() &&
+      (current_entries > 0 || compact->current_output()->num_range_deletions)) {
     // Verify that the table is usable
     Iterator* iter =
         table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
     s = iter->status();
     delete iter;
     if (s.ok()) {
-      Log(options_.info_log, "Generated table #%llu@%d: %lld keys, %lld bytes",
+      Log(options_.info_log,
+          "Generated table #%llu@%d: %lld keys, %lld range deletions, "
+          "%lld bytes",
           (unsigned long long)output_number, compact->compaction->level(),
           (unsigned long long)current_entries,
+          (unsigned long long)compact->current_output()->num_range_deletions,
           (unsigned long long)current_bytes);
     }
   }
   return s;
 }
 
+// Describe the input files of "c", e.g. "3@0 + 1@1".
+static std::string CompactionInputSummary(Compaction* c) {
+  std::string result;
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    if (which > 0 && c->num_input_files(which) == 0 &&
+        which + 1 < c->num_input_levels()) {
+      continue;  // Empty level between the runs of a universal compaction
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%s%d@%d", (which > 0 ? " + " : ""),
+                  c->num_input_files(which), c->level() + which);
+    result.append(buf);
+  }
+  return result;
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
-  Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+  Log(options_.info_log, "Compacted %s files => %lld bytes",
+      CompactionInputSummary(compact->compaction).c_str(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    f.num_range_deletions = out.num_range_deletions;
+    f.num_entries = out.num_entries;
+    f.num_deletions = out.num_deletions;
+    f.blob_files.assign(out.blob_files.begin(), out.blob_files.end());
+    compact->compaction->edit()->AddFile(level, f);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
 
+Status DBImpl::LoadCompactionRangeTombstones(CompactionState* compact) {
+  Compaction* const c = compact->compaction;
+  RangeTombstoneList* list = new RangeTombstoneList(user_comparator());
+  Status s;
+  for (int which = 0; which < c->num_input_levels() && s.ok(); which++) {
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      const FileMetaData* f = c->input(which, i);
+      if (f->num_range_deletions == 0) {
+        continue;
+      }
+      Iterator* iter =
+          table_cache_->NewRangeDelIterator(ReadOptions(), f->number,
+                                            f->file_size);
+      s = list->AddAll(iter);
+      delete iter;
+      if (!s.ok()) {
+        break;
+      }
+    }
+  }
+  if (!s.ok() || list->empty()) {
+    delete list;
+    return s;
+  }
+  list->Finish();
+  compact->range_dels = list;
+
+  // A tombstone is obsolete once no snapshot can see an entry it deletes
+  // and no data it may delete remains below the output level.
+  for (const RangeTombstone& t : list->tombstones()) {
+    if (t.sequence > compact->smallest_snapshot ||
+        !c->IsBaseLevelForRange(t.start, t.end)) {
+      compact->output_range_dels.push_back(t);
+    }
+  }
+  return s;
+}
+
+void DBImpl::AddRangeTombstonesToOutput(CompactionState* compact,
+                                        const Slice* upper) {
+  const Comparator* ucmp = user_comparator();
+  CompactionState::Output* out = compact->current_output();
+  for (const RangeTombstone& t : compact->output_range_dels) {
+    Slice start = t.start;
+    Slice end = t.end;
+    if (compact->has_output_lower_bound &&
+        ucmp->Compare(start, compact->output_lower_bound) < 0) {
+      start = compact->output_lower_bound;
+    }
+    if (upper != nullptr && ucmp->Compare(end, *upper) > 0) {
+      end = *upper;
+    }
+    if (ucmp->Compare(start, end) >= 0) {
+      continue;
+    }
+    InternalKey ikey(start, t.sequence, kTypeRangeDeletion);
+    compact->builder->AddRangeDeletion(ikey.Encode(), end);
+    ExtendKeyRangeForTombstone(internal_comparator_, ikey.Encode(), end,
+                               &out->smallest, &out->largest);
+  }
+  if (upper != nullptr) {
+    compact->has_output_lower_bound = true;
+    compact->output_lower_bound.assign(upper->data(), upper->size());
+  }
+}
+
+Status DBImpl::AddToCompactionOutput(CompactionState* compact,
+                                     Iterator* input, Slice key, Slice value,
+                                     bool split_at_user_keys,
+                                     bool* close_pending) {
+  // Open output file if necessary
+  if (compact->builder == nullptr) {
+    Status s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  BlobIndex index;
+  if (ExtractValueType(key) == kTypeBlobIndex) {
+    if (!index.DecodeFrom(value)) {
+      return Status::Corruption("bad blob index");
+    }
+    if (index.file_number < compact->blob_gc_cutoff) {
+      // Copy the value out of one of the oldest blob files, which can be
+      // deleted once no table refers to it
+      Status s = ReadCompactionBlob(compact, value, &compact->blob_value);
+      if (!s.ok()) {
+        return s;
+      }
+      compact->blob_key.assign(key.data(), key.size());
+      compact->blob_key[compact->blob_key.size() - 8] =
+          static_cast<char>(kTypeValue);
+      key = compact->blob_key;
+      value = compact->blob_value;
+    }
+  }
+  if (compact->blob_builder != nullptr) {
+    Status s = compact->blob_builder->MaybeAdd(&key, &value);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (ExtractValueType(key) == kTypeBlobIndex && index.DecodeFrom(value)) {
+    compact->current_output()->blob_files.insert(index.file_number);
+  }
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
+  if (ExtractValueType(key) == kTypeDeletion) {
+    compact->current_output()->num_deletions++;
+  }
+
+  // Close output file if it is big enough
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    if (split_at_user_keys) {
+      // Close before the next user key
+      *close_pending = true;
+    } else {
+      return FinishCompactionOutputFile(compact, input);
+    }
+  }
+  return Status::OK();
+}
+
+Status DBImpl::ReadCompactionBlob(CompactionState* compact,
+                                  const Slice& index, std::string* value) {
+  // Same as the compaction inputs
+  ReadOptions options;
+  options.verify_checksums = options_.paranoid_checks;
+  options.fill_cache = false;
+  Status s = blob_cache_->Get(options, index, value);
+  if (s.ok()) {
+    compact->blob_bytes_read += value->size();
+  }
+  return s;
+}
+
+Status DBImpl::FilterCompactionValue(CompactionState* compact,
+                                     const ParsedInternalKey& ikey, Slice* key,
+                                     Slice* value, std::string* key_buf,
+                                     std::string* value_buf, bool* keep) {
+  assert(ikey.type == kTypeValue || ikey.type == kTypeBlobIndex);
+  *keep = true;
+  Slice existing_value = *value;
+  if (ikey.type == kTypeBlobIndex) {
+    Status s = ReadCompactionBlob(compact, *value, &compact->blob_value);
+    if (!s.ok()) {
+      return s;
+    }
+    existing_value = compact->blob_value;
+  }
+  bool value_changed = false;
+  if (options_.compaction_filter->Filter(compact->compaction->level(),
+                                         ikey.user_key, existing_value,
+                                         value_buf, &value_changed)) {
+    compact->filtered_entries++;
+    if (ikey.sequence <= compact->smallest_snapshot &&
+        compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+      *keep = false;
+      return Status::OK();
+    }
+    // Older values of the key, kept for snapshots or in deeper levels,
+    // must stay hidden
+    *key_buf = InternalKey(ikey.user_key, ikey.sequence, kTypeDeletion)
+                   .Encode()
+                   .ToString();
+    *key = *key_buf;
+    *value = Slice();
+  } else if (value_changed) {
+    if (ikey.type == kTypeBlobIndex) {
+      // The new value replaces the reference to the old one
+      *key_buf = InternalKey(ikey.user_key, ikey.sequence, kTypeValue)
+                     .Encode()
+                     .ToString();
+      *key = *key_buf;
+    }
+    *value = *value_buf;
+  }
+  return Status::OK();
+}
+
+Status DBImpl::MergeCompactionOperands(
+    CompactionState* compact, Iterator* input,
+    std::vector<std::pair<std::string, std::string>>* entries) {
+  ParsedInternalKey first;
+  bool ok = ParseInternalKey(input->key(), &first);
+  assert(ok && first.type == kTypeMerge);
+  (void)ok;
+  const std::string user_key = first.user_key.ToString();
+  const SequenceNumber first_sequence = first.sequence;
+
+  MergeContext operands;
+  operands.Add(first_sequence, input->value());
+  bool found_base = false;  // True if the older entries are known
+  bool has_base = false;    // True if they end with a value
+  std::string base;
+  for (input->Next(); input->Valid(); input->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(input->key(), &ikey) ||
+        user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    const bool deleted =
+        compact->range_dels != nullptr &&
+        ikey.sequence < compact->range_dels->MaxCoveringSequence(
+                            ikey.user_key, compact->smallest_snapshot);
+    if (deleted || ikey.type == kTypeDeletion) {
+      // Left in input: dropped by rule (A) in DoCompactionWork()
+      found_base = true;
+      break;
+    } else if (ikey.type == kTypeValue || ikey.type == kTypeBlobIndex) {
+      found_base = true;
+      has_base = true;
+      if (ikey.type == kTypeBlobIndex) {
+        Status s = ReadCompactionBlob(compact, input->value(), &base);
+        if (!s.ok()) {
+          return s;
+        }
+      } else {
+        base = input->value().ToString();
+      }
+      input->Next();
+      break;
+    }
+    operands.Add(ikey.sequence, input->value());
+  }
+  if (!found_base && compact->compaction->IsBaseLevelForKey(user_key)) {
+    // No older entries exist
+    found_base = true;
+  }
+
+  std::string result;
+  if (found_base) {
+    Slice base_value(base);
+    Status s = operands.Apply(options_.merge_operator, user_key,
+                              has_base ? &base_value : nullptr, &result);
+    if (!s.ok()) {
+      return s;
+    }
+    InternalKey ikey(user_key, first_sequence, kTypeValue);
+    entries->emplace_back(ikey.Encode().ToString(), std::move(result));
+    return Status::OK();
+  }
+
+  // The value is below this compaction: combine the operands if the merge
+  // operator can, else keep them all.
+  bool combined = true;
+  result = operands.operand(operands.size() - 1);
+  for (size_t i = operands.size() - 1; combined && i > 0; i--) {
+    std::string tmp;
+    combined = options_.merge_operator->PartialMerge(
+        user_key, result, operands.operand(i - 1), &tmp);
+    result.swap(tmp);
+  }
+  if (combined) {
+    InternalKey ikey(user_key, first_sequence, kTypeMerge);
+    entries->emplace_back(ikey.Encode().ToString(), std::move(result));
+  } else {
+    for (size_t i = 0; i < operands.size(); i++) {
+      InternalKey ikey(user_key, operands.sequence(i), kTypeMerge);
+      entries->emplace_back(ikey.Encode().ToString(), operands.operand(i));
+    }
+  }
+  return Status::OK();
+}
+
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
   int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+  Log(options_.info_log, "Compacting %s files",
+      CompactionInputSummary(compact->compaction).c_str());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
@@ -905,20 +1467,42 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = versions_->LastSequence();
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    compact->largest_snapshot = snapshots_.newest()->sequence_number();
+  }
+
+  if (versions_->current()->HasBlobFiles()) {
+    compact->blob_gc_cutoff =
+        versions_->BlobGarbageCollectionCutoff(options_.blob_gc_age_cutoff);
+  }
+  if (options_.min_blob_size > 0) {
+    compact->blob_builder = new BlobFileBuilder(
+        dbname_, options_, versions_->NewFileNumber(), RateLimiter::kLow);
+    pending_outputs_.insert(compact->blob_builder->number());
   }
 
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  if (options_.pipelined_compaction) {
+    // Read the inputs ahead of the merge, on a thread of their own
+    input = NewPrefetchingIterator(input, env_, kCompactionReadaheadBytes);
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  Status status = LoadCompactionRangeTombstones(compact);
+  // With range tombstones, outputs are split only between user keys so
+  // that each tombstone can be clipped to the file it is written to.
+  const bool split_at_user_keys = !compact->output_range_dels.empty();
+  bool close_pending = false;
+
   input->SeekToFirst();
-  Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-  while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
+  std::string key_buf, value_buf;  // Entries rewritten by the filter
+  while (status.ok() && input->Valid() &&
+         !shutting_down_.load(std::memory_order_acquire)) {
     // Prioritize immutable compaction work
     if (has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
@@ -933,16 +1517,34 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
+    if (compact->compaction->ShouldStopBefore(key)) {
+      close_pending = true;
+    }
+    if (close_pending && compact->builder != nullptr) {
+      bool close = true;
+      if (split_at_user_keys) {
+        Slice user_key = ExtractUserKey(key);
+        close = user_comparator()->Compare(
+                    user_key, compact->current_output()->largest.user_key()) !=
+                0;
+        if (close) {
+          AddRangeTombstonesToOutput(compact, &user_key);
+        }
+      }
+      if (close) {
+        status = FinishCompactionOutputFile(compact, input);
+        if (!status.ok()) {
+          break;
+        }
       }
     }
+    if (compact->builder == nullptr) {
+      close_pending = false;
+    }
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool first_entry_for_key = false;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -956,11 +1558,18 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
+        first_entry_for_key = true;
       }
 
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;  // (A)
+      } else if (compact->range_dels != nullptr &&
+                 ikey.sequence <
+                     compact->range_dels->MaxCoveringSequence(
+                         ikey.user_key, compact->smallest_snapshot)) {
+        // Deleted by a range tombstone that every snapshot can see
+        drop = true;  // (B)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
                  compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
@@ -986,27 +1595,58 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == nullptr) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
+    if (!drop && has_current_user_key && ikey.type == kTypeMerge &&
+        ikey.sequence <= compact->smallest_snapshot &&
+        options_.merge_operator != nullptr) {
+      // Every snapshot sees this operand and the older entries of the key,
+      // so they can be combined.  This advances input past them.
+      std::vector<std::pair<std::string, std::string>> merged;
+      status = MergeCompactionOperands(compact, input, &merged);
+      for (size_t i = 0; status.ok() && i < merged.size(); i++) {
+        Slice merged_key = merged[i].first;
+        Slice merged_value = merged[i].second;
+        ParsedInternalKey merged_ikey;
+        bool keep = true;
+        if (options_.compaction_filter != nullptr &&
+            ParseInternalKey(merged_key, &merged_ikey) &&
+            merged_ikey.type == kTypeValue &&
+            merged_ikey.sequence > compact->largest_snapshot) {
+          status = FilterCompactionValue(compact, merged_ikey, &merged_key,
+                                         &merged_value, &key_buf, &value_buf,
+                                         &keep);
+        }
+        if (status.ok() && keep) {
+          status = AddToCompactionOutput(compact, input, merged_key,
+                                         merged_value, split_at_user_keys,
+                                         &close_pending);
         }
       }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+      if (!status.ok()) {
+        break;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      continue;
+    }
 
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+    Slice value = input->value();
+    if (!drop && first_entry_for_key &&
+        (ikey.type == kTypeValue || ikey.type == kTypeBlobIndex) &&
+        ikey.sequence > compact->largest_snapshot &&
+        options_.compaction_filter != nullptr) {
+      // The latest value of the key, which no snapshot sees
+      bool keep;
+      status = FilterCompactionValue(compact, ikey, &key, &value, &key_buf,
+                                     &value_buf, &keep);
+      if (!status.ok()) {
+        break;
+      }
+      drop = !keep;
+    }
+
+    if (!drop) {
+      status = AddToCompactionOutput(compact, input, key, value,
+                                     split_at_user_keys, &close_pending);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1016,18 +1656,36 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == nullptr && split_at_user_keys) {
+    // Tombstones past the last output still need a file
+    const Comparator* ucmp = user_comparator();
+    for (const RangeTombstone& t : compact->output_range_dels) {
+      if (!compact->has_output_lower_bound ||
+          ucmp->Compare(t.end, compact->output_lower_bound) > 0) {
+        status = OpenCompactionOutputFile(compact);
+        break;
+      }
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
+    if (split_at_user_keys) {
+      AddRangeTombstonesToOutput(compact, nullptr);
+    }
     status = FinishCompactionOutputFile(compact, input);
   }
   if (status.ok()) {
     status = input->status();
   }
+  if (status.ok() && compact->blob_builder != nullptr) {
+    status = compact->blob_builder->Finish();
+  }
   delete input;
   input = nullptr;
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < compact->compaction->num_input_levels();
+       which++) {
     for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
       stats.bytes_read += compact->compaction->input(which, i)->file_size;
     }
@@ -1035,9 +1693,19 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
   }
+  stats.bytes_read += compact->blob_bytes_read;
+  if (compact->blob_builder != nullptr) {
+    stats.bytes_written += compact->blob_builder->FileSize();
+  }
+
+  if (compact->filtered_entries > 0) {
+    Log(options_.info_log, "%s deleted %lld entries",
+        options_.compaction_filter->Name(),
+        static_cast<long long>(compact->filtered_entries));
+  }
 
   mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  stats_[compact->compaction->output_level()].Add(stats);
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
@@ -1074,9 +1742,10 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 }  // anonymous namespace
 
-Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
-                                      SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+Iterator* DBImpl::NewInternalIterator(
+    const ReadOptions& options, SequenceNumber* latest_snapshot,
+    uint32_t* seed,
+    std::vector<std::shared_ptr<const RangeTombstoneList>>* range_dels) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
@@ -1093,11 +1762,39 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
 
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+  MemTable* const mem = mem_;
+  MemTable* const imm = imm_;
+  Version* const current = versions_->current();
+  IterState* cleanup = new IterState(&mutex_, mem, imm, current);
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+  if (current->HasBlobFiles()) {
+    internal_iter = NewBlobResolvingIterator(internal_iter, blob_cache_,
+                                             options);
+  }
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_dels != nullptr) {
+    // The state is pinned by internal_iter, so collect its tombstones
+    // without holding the lock.  The lists are cached by their memtable
+    // or by the table cache, so no tombstone is read again.
+    for (MemTable* m : {mem, imm}) {
+      std::shared_ptr<const RangeTombstoneList> list =
+          m != nullptr ? m->FragmentedRangeDels() : nullptr;
+      if (list != nullptr) {
+        range_dels->push_back(std::move(list));
+      }
+    }
+    if (current->HasRangeDeletions()) {
+      Status s = current->AddRangeTombstones(range_dels);
+      if (!s.ok()) {
+        range_dels->clear();
+        delete internal_iter;
+        return NewErrorIterator(s);
+      }
+    }
+  }
   return internal_iter;
 }
 
@@ -1139,14 +1836,42 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    SequenceNumber seq = 0;
+    MergeContext merge_context;
+    if (mem->Get(lkey, value, &s, &seq, &merge_context)) {
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    } else if (imm != nullptr &&
+               imm->Get(lkey, value, &s, &seq, &merge_context)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, value, &stats, &seq, &merge_context);
       have_stat_update = true;
     }
+    if (s.ok() || (s.IsNotFound() && !merge_context.empty())) {
+      // Entries older than a range tombstone covering the key are deleted
+      SequenceNumber tombstone;
+      Status ts = current->MaxCoveringTombstone(key, snapshot, &tombstone);
+      tombstone = std::max(tombstone, mem->MaxCoveringTombstone(key, snapshot));
+      if (imm != nullptr) {
+        tombstone =
+            std::max(tombstone, imm->MaxCoveringTombstone(key, snapshot));
+      }
+      if (!ts.ok()) {
+        s = ts;
+      } else if (s.ok() && tombstone > seq) {
+        value->clear();
+        s = Status::NotFound(Slice());
+      }
+      merge_context.DropOlderThan(tombstone);
+    }
+    if (!merge_context.empty() && (s.ok() || s.IsNotFound())) {
+      Slice existing_value;
+      if (s.ok()) {
+        existing_value = *value;
+      }
+      s = merge_context.Apply(options_.merge_operator, key,
+                              s.ok() ? &existing_value : nullptr, value);
+    }
     mutex_.Lock();
   }
 
@@ -1162,13 +1887,16 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  std::vector<std::shared_ptr<const RangeTombstoneList>> range_dels;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, &range_dels);
+  return NewDBIterator(this, user_comparator(), options_.merge_operator, iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, options_.max_sequential_skip_in_iterations,
+                       std::move(range_dels));
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1178,6 +1906,11 @@ void DBImpl::RecordReadSample(Slice key) {
   }
 }
 
+void DBImpl::RecordIteratorSkips(uint64_t skipped, uint64_t reseeks) {
+  iter_skipped_entries_.fetch_add(skipped, std::memory_order_relaxed);
+  iter_reseeks_.fetch_add(reseeks, std::memory_order_relaxed);
+}
+
 const Snapshot* DBImpl::GetSnapshot() {
   MutexLock l(&mutex_);
   return snapshots_.New(versions_->LastSequence());
@@ -1197,6 +1930,14 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& operand) {
+  if (options_.merge_operator == nullptr) {
+    return Status::InvalidArgument("DB::Merge() requires a merge operator");
+  }
+  return DB::Merge(options, key, operand);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   Writer w(&mutex_);
   w.batch = updates;
@@ -1218,6 +1959,14 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
     WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    if (delayed_write_rate_ > 0) {
+      // Charge the group to the delayed rate.  The next group waits
+      // until it has been paid for.
+      next_write_micros_ =
+          std::max(next_write_micros_, env_->NowMicros()) +
+          WriteBatchInternal::ByteSize(write_batch) * 1000000 /
+              delayed_write_rate_;
+    }
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
 
@@ -1246,6 +1995,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
+    if (status.ok()) {
+      user_bytes_written_ += WriteBatchInternal::ByteSize(write_batch);
+    }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
@@ -1320,43 +2072,111 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   return result;
 }
 
+uint64_t DBImpl::DelayedWriteRate(StallCause* cause) {
+  mutex_.AssertHeld();
+  const Options& options = mutable_options_;
+
+  // Scale the rate down linearly from the soft limit to the hard limit
+  // of the level-0 file count and of the pending compaction bytes, and
+  // apply whichever scale is lower.
+  double scale = 2;
+  const int level0_files = versions_->NumLevelFiles(0);
+  if (level0_files >= options.level0_slowdown_writes_trigger) {
+    const int stop = options.level0_stop_writes_trigger;
+    const int slowdown = options.level0_slowdown_writes_trigger;
+    scale = stop > level0_files ? static_cast<double>(stop - level0_files) /
+                                      (stop - slowdown)
+                                : 0;
+    *cause = kStallLevel0Slowdown;
+  }
+  const uint64_t pending_bytes = versions_->EstimatedPendingCompactionBytes();
+  const uint64_t soft_limit = options.soft_pending_compaction_bytes_limit;
+  const uint64_t hard_limit = options.hard_pending_compaction_bytes_limit;
+  if (soft_limit > 0 && pending_bytes >= soft_limit) {
+    // Without a hard limit there is nothing to ramp down towards
+    double pending_scale = 1;
+    if (hard_limit > 0) {
+      pending_scale = hard_limit > pending_bytes
+                          ? static_cast<double>(hard_limit - pending_bytes) /
+                                (hard_limit - soft_limit)
+                          : 0;
+    }
+    if (pending_scale < scale) {
+      scale = pending_scale;
+      *cause = kStallPendingCompactionSlowdown;
+    }
+  }
+  if (scale > 1) {
+    return 0;
+  }
+  return std::max(static_cast<uint64_t>(options.delayed_write_rate * scale),
+                  kMinDelayedWriteRate);
+}
+
+void DBImpl::WaitForBackgroundWork(StallCause cause) {
+  mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
+  background_work_finished_signal_.Wait();
+  stall_stats_[cause].count++;
+  stall_stats_[cause].micros += env_->NowMicros() - start_micros;
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;
+  StallCause delay_cause;
+  delayed_write_rate_ = force ? 0 : DelayedWriteRate(&delay_cause);
+  if (delayed_write_rate_ == 0) {
+    next_write_micros_ = 0;
+  }
+  bool allow_delay = (delayed_write_rate_ > 0);
   Status s;
   while (true) {
+    const uint64_t hard_limit =
+        mutable_options_.hard_pending_compaction_bytes_limit;
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+    } else if (allow_delay) {
+      // We are getting close to a hard limit on the number of L0 files
+      // or on the compaction debt.  Rather than stopping writes for
+      // several seconds when we hit the hard limit, throttle them to a
+      // rate that decreases as the limit gets closer, which keeps the
+      // latency of individual writes even.  Also, the delay hands over
+      // some CPU to the compaction thread in case it is sharing the same
+      // core as the writer.
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
-    } else if (!force &&
-               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
+      const uint64_t now_micros = env_->NowMicros();
+      if (next_write_micros_ > now_micros) {
+        const uint64_t delay_micros = next_write_micros_ - now_micros;
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(delay_micros));
+        mutex_.Lock();
+        stall_stats_[delay_cause].count++;
+        stall_stats_[delay_cause].micros += delay_micros;
+      }
+    } else if (!force && hard_limit > 0 &&
+               versions_->EstimatedPendingCompactionBytes() >= hard_limit) {
+      // Compactions are too far behind.
+      Log(options_.info_log, "Too many pending compaction bytes; waiting...\n");
+      WaitForBackgroundWork(kStallPendingCompactionStop);
+    } else if (!force && (mem_->ApproximateMemoryUsage() <=
+                          mutable_options_.write_buffer_size)) {
       // There is room in current memtable
       break;
     } else if (imm_ != nullptr) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
-      background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      WaitForBackgroundWork(kStallMemtableFull);
+    } else if (versions_->NumLevelFiles(0) >=
+               mutable_options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
-      background_work_finished_signal_.Wait();
+      WaitForBackgroundWork(kStallLevel0Stop);
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1384,6 +2204,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       }
       delete logfile_;
 
+      lfile = NewRangeSyncWritableFile(lfile, options_.wal_bytes_per_sync);
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
@@ -1455,6 +2276,88 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "iterator-skipped-entries") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      iter_skipped_entries_.load(std::memory_order_relaxed)));
+    value->append(buf);
+    return true;
+  } else if (in == "write-amplification") {
+    uint64_t table_bytes = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      table_bytes += stats_[level].bytes_written;
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%.2f",
+                  user_bytes_written_ == 0
+                      ? 0.0
+                      : static_cast<double>(table_bytes) / user_bytes_written_);
+    value->append(buf);
+    return true;
+  } else if (in == "write-stalls") {
+    static const char* const kStallCauseNames[kNumStallCauses] = {
+        "level0-slowdown", "level0-stop", "pending-compaction-slowdown",
+        "pending-compaction-stop", "memtable-full"};
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Cause                         Count Time(sec)\n"
+                  "-------------------------------------------\n");
+    value->append(buf);
+    for (int cause = 0; cause < kNumStallCauses; cause++) {
+      std::snprintf(buf, sizeof(buf), "%-27s %7lld %9.3f\n",
+                    kStallCauseNames[cause],
+                    static_cast<long long>(stall_stats_[cause].count),
+                    stall_stats_[cause].micros / 1e6);
+      value->append(buf);
+    }
+    return true;
+  } else if (in == "delayed-write-rate") {
+    StallCause cause;
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(DelayedWriteRate(&cause)));
+    value->append(buf);
+    return true;
+  } else if (in == "compaction-bytes-read" ||
+             in == "compaction-bytes-written") {
+    uint64_t bytes = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      bytes += (in == "compaction-bytes-read") ? stats_[level].bytes_read
+                                               : stats_[level].bytes_written;
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(bytes));
+    value->append(buf);
+    return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      versions_->EstimatedPendingCompactionBytes()));
+    value->append(buf);
+    return true;
+  } else if (in == "estimate-num-keys") {
+    // Reading table properties may take I/O
+    Version* current = versions_->current();
+    current->Ref();
+    mutex_.Unlock();
+    const uint64_t keys = current->NumLiveEntries();
+    mutex_.Lock();
+    current->Unref();
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(keys));
+    value->append(buf);
+    return true;
+  } else if (in == "iterator-reseeks") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      iter_reseeks_.load(std::memory_order_relaxed)));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1492,17 +2395,56 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::SetOptions(const std::map<std::string, std::string>& new_options) {
+  return Status::NotSupported("SetOptions");
+}
+
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& operand) {
+  WriteBatch batch;
+  batch.Merge(key, operand);
+  return Write(opt, &batch);
+}
+
 DB::~DB() = default;
 
+// Reject the options that the database could not honor.
+static Status ValidateOptions(const Options& options) {
+  for (const FilterPolicy* policy : options.filter_policy_per_level) {
+    // Table files are read with filter_policy, which ignores the filters
+    // of any other policy.
+    if (policy != nullptr &&
+        (options.filter_policy == nullptr ||
+         std::strcmp(policy->Name(), options.filter_policy->Name()) != 0)) {
+      return Status::InvalidArgument(
+          "filter_policy_per_level",
+          "policies must have the same Name() as filter_policy");
+    }
+  }
+  return Status::OK();
+}
+
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   *dbptr = nullptr;
 
+  Status s = ValidateOptions(options);
+  if (!s.ok()) {
+    return s;
+  }
+
   DBImpl* impl = new DBImpl(options, dbname);
   impl->mutex_.Lock();
   VersionEdit edit;
   // Recover handles create_if_missing, error_if_exists
   bool save_manifest = false;
-  Status s = impl->Recover(&edit, &save_manifest);
+  s = impl->Recover(&edit, &save_manifest);
   if (s.ok() && impl->mem_ == nullptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
@@ -1511,6 +2453,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
                                      &lfile);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
+      lfile = NewRangeSyncWritableFile(lfile,
+                                       impl->options_.wal_bytes_per_sync);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
@@ -7,8 +7,11 @@
 
 #include <atomic>
 #include <deque>
+#include <memory>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
@@ -20,7 +23,10 @@
 
 namespace leveldb {
 
+class BlobFileCache;
+class CompressionWorkerPool;
 class MemTable;
+class RangeTombstoneList;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -39,6 +45,8 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& operand) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
@@ -48,6 +56,8 @@ class DBImpl : public DB {
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status SetOptions(
+      const std::map<std::string, std::string>& new_options) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -71,6 +81,10 @@ class DBImpl : public DB {
   // bytes.
   void RecordReadSample(Slice key);
 
+  // Add to the counts reported by the "leveldb.iterator-skipped-entries"
+  // and "leveldb.iterator-reseeks" properties.
+  void RecordIteratorSkips(uint64_t skipped, uint64_t reseeks);
+
  private:
   friend class DB;
   struct CompactionState;
@@ -101,9 +115,31 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
-  Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+  // Reasons for a write to be delayed or to wait.
+  enum StallCause {
+    kStallLevel0Slowdown,
+    kStallLevel0Stop,
+    kStallPendingCompactionSlowdown,
+    kStallPendingCompactionStop,
+    kStallMemtableFull,
+    kNumStallCauses
+  };
+
+  // Write stall stats.  stall_stats_[cause] counts the delays and waits
+  // of writes for the specified cause.
+  struct StallStats {
+    StallStats() : count(0), micros(0) {}
+
+    int64_t count;
+    int64_t micros;
+  };
+
+  // If range_dels is non-null, the fragmented range tombstones of the
+  // memtables and tables the iterator reads are appended to *range_dels.
+  Iterator* NewInternalIterator(
+      const ReadOptions&, SequenceNumber* latest_snapshot, uint32_t* seed,
+      std::vector<std::shared_ptr<const RangeTombstoneList>>* range_dels =
+          nullptr);
 
   Status NewDB();
 
@@ -135,6 +171,15 @@ class DBImpl : public DB {
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Return the rate in bytes per second that writes should be throttled
+  // to, or 0 if they should not be.  Sets *cause to the reason.
+  uint64_t DelayedWriteRate(StallCause* cause)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Wait for background work to finish and account the time to "cause".
+  void WaitForBackgroundWork(StallCause cause)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -148,6 +193,21 @@ class DBImpl : public DB {
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  Status LoadCompactionRangeTombstones(CompactionState* compact);
+  Status AddToCompactionOutput(CompactionState* compact, Iterator* input,
+                               Slice key, Slice value, bool split_at_user_keys,
+                               bool* close_pending);
+  Status FilterCompactionValue(CompactionState* compact,
+                               const ParsedInternalKey& ikey, Slice* key,
+                               Slice* value, std::string* key_buf,
+                               std::string* value_buf, bool* keep);
+  Status ReadCompactionBlob(CompactionState* compact, const Slice& index,
+                            std::string* value);
+  Status MergeCompactionOperands(
+      CompactionState* compact, Iterator* input,
+      std::vector<std::pair<std::string, std::string>>* entries);
+  void AddRangeTombstonesToOutput(CompactionState* compact,
+                                  const Slice* upper);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -159,13 +219,20 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const std::vector<InternalFilterPolicy> internal_filter_policy_per_level_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
   const std::string dbname_;
 
-  // table_cache_ provides its own synchronization
+  // table_cache_ and blob_cache_ provide their own synchronization
   TableCache* const table_cache_;
+  BlobFileCache* const blob_cache_;
+
+  // Threads compressing the data blocks of the tables written by flushes
+  // and compactions, shared by all of them.  nullptr if the blocks are
+  // compressed inline.  Provides its own synchronization.
+  CompressionWorkerPool* const compression_workers_;
 
   // Lock over the persistent DB state.  Non-null iff successfully acquired.
   FileLock* db_lock_;
@@ -197,20 +264,44 @@ class DBImpl : public DB {
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
+  // Copy of options_ in which the fields that SetOptions() changes are
+  // current.  Those fields are only accessed with mutex_ held.
+  Options mutable_options_;
+
   VersionSet* const versions_ GUARDED_BY(mutex_);
 
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Bytes of write batches applied since the DB was opened
+  uint64_t user_bytes_written_ GUARDED_BY(mutex_);
+
+  StallStats stall_stats_[kNumStallCauses] GUARDED_BY(mutex_);
+
+  // Rate in bytes per second that the current write group is throttled
+  // to, or 0 if it is not.  Set by MakeRoomForWrite().
+  uint64_t delayed_write_rate_ GUARDED_BY(mutex_);
+
+  // While writes are throttled, the time at which the bytes of the
+  // previous write groups have been paid for at the delayed rate.  The
+  // next write group sleeps until then.
+  uint64_t next_write_micros_ GUARDED_BY(mutex_);
+
+  // Hidden entries stepped over and reseeks done by DB iterators.
+  std::atomic<uint64_t> iter_skipped_entries_;
+  std::atomic<uint64_t> iter_reseeks_;
 };
 
-// Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
-Options SanitizeOptions(const std::string& db,
-                        const InternalKeyComparator* icmp,
-                        const InternalFilterPolicy* ipolicy,
-                        const Options& src);
+// Sanitize db options.  "ipolicy_per_level" wraps the elements of
+// src.filter_policy_per_level.  The caller should delete result.info_log
+// if it is not equal to src.info_log.
+Options SanitizeOptions(
+    const std::string& db, const InternalKeyComparator* icmp,
+    const InternalFilterPolicy* ipolicy,
+    const std::vector<InternalFilterPolicy>* ipolicy_per_level,
+    const Options& src);
 
 }  // namespace leveldb
 
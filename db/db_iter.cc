@@ -7,6 +7,8 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -45,14 +47,21 @@ class DBIter : public Iterator {
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const Comparator* cmp, const MergeOperator* merge_operator,
+         Iterator* iter, SequenceNumber s, uint32_t seed,
+         int max_sequential_skip,
+         std::vector<std::shared_ptr<const RangeTombstoneList>> range_dels)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
         iter_(iter),
+        range_dels_(std::move(range_dels)),
         sequence_(s),
+        max_sequential_skip_(max_sequential_skip),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        pending_prev_key_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
@@ -63,11 +72,13 @@ class DBIter : public Iterator {
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ? iter_->value()
+                                                : saved_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -86,8 +97,23 @@ class DBIter : public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeForward(const ParsedInternalKey& ikey);
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns the type of "ikey", or kTypeDeletion for a value or merge
+  // operand deleted by a range tombstone visible at sequence_.
+  inline ValueType EffectiveType(const ParsedInternalKey& ikey) const {
+    if (ikey.type == kTypeValue || ikey.type == kTypeMerge) {
+      for (const auto& list : range_dels_) {
+        if (list->MaxCoveringSequence(ikey.user_key, sequence_) >
+            ikey.sequence) {
+          return kTypeDeletion;
+        }
+      }
+    }
+    return ikey.type;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -108,13 +134,27 @@ class DBIter : public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
   Iterator* const iter_;
+  // The tombstones of the memtables and tables iter_ reads, none empty
+  const std::vector<std::shared_ptr<const RangeTombstoneList>> range_dels_;
   SequenceNumber const sequence_;
+  int const max_sequential_skip_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  // True iff the current entry was produced by merging operands.  Then
+  // saved_key_ and saved_value_ hold it in both directions, and when
+  // direction_==kForward iter_ is already past its operands.
+  bool merged_;
+  MergeContext merge_context_;
+  // When direction_==kReverse, true iff pending_prev_ikey_ holds the already
+  // parsed internal key iter_ is positioned at, so that the next
+  // FindPrevUserEntry() neither parses it nor samples its bytes again.
+  bool pending_prev_key_;
+  ParsedInternalKey pending_prev_ikey_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -143,6 +183,7 @@ void DBIter::Next() {
 
   if (direction_ == kReverse) {  // Switch directions?
     direction_ = kForward;
+    pending_prev_key_ = false;
     // iter_ is pointing just before the entries for this->key(),
     // so advance into the range of entries for this->key() and then
     // use the normal skipping code below.
@@ -157,6 +198,15 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // saved_key_ already contains the key to skip past, and iter_ is past
+    // its operands.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -178,32 +228,122 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  // Number of consecutive hidden entries of the user key in *skip.
+  int num_skipped = 0;
+  uint64_t total_skipped = 0;
+  uint64_t reseeks = 0;
   do {
     ParsedInternalKey ikey;
+    bool hidden = false;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+      switch (EffectiveType(ikey)) {
         case kTypeDeletion:
-          // Arrange to skip all upcoming entries for this key since
-          // they are hidden by this deletion.
-          SaveKey(ikey.user_key, skip);
-          skipping = true;
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) == 0) {
+            // Older deletion of a key that is already being skipped
+            hidden = true;
+          } else {
+            // Arrange to skip all upcoming entries for this key since
+            // they are hidden by this deletion.
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
+            num_skipped = 0;
+          }
           break;
         case kTypeValue:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+            hidden = true;
           } else {
             valid_ = true;
             saved_key_.clear();
+            if (total_skipped > 0) {
+              db_->RecordIteratorSkips(total_skipped, reseeks);
+            }
+            return;
+          }
+          break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+            hidden = true;
+          } else {
+            MergeForward(ikey);
+            if (total_skipped > 0) {
+              db_->RecordIteratorSkips(total_skipped, reseeks);
+            }
             return;
           }
           break;
+        case kTypeRangeDeletion:
+          // Range tombstones are not part of the internal iterator
+          break;
+        case kTypeBlobIndex:
+          // The internal iterator presents these as kTypeValue entries
+          assert(false);
+          break;
+      }
+    }
+    if (hidden) {
+      total_skipped++;
+      if (max_sequential_skip_ > 0 && ++num_skipped > max_sequential_skip_) {
+        // Too many versions of *skip: jump to its oldest possible entry
+        // rather than stepping over the rest one at a time.
+        std::string target;
+        AppendInternalKey(&target, ParsedInternalKey(*skip, 0, kTypeDeletion));
+        iter_->Seek(target);
+        num_skipped = 0;
+        reseeks++;
+        continue;
       }
     }
     iter_->Next();
   } while (iter_->Valid());
   saved_key_.clear();
   valid_ = false;
+  if (total_skipped > 0) {
+    db_->RecordIteratorSkips(total_skipped, reseeks);
+  }
+}
+
+void DBIter::MergeForward(const ParsedInternalKey& ikey) {
+  // Collect the operands of ikey.user_key down to the value or deletion
+  // they apply to, leaving iter_ at that entry or past the key.
+  SaveKey(ikey.user_key, &saved_key_);
+  merge_context_.Clear();
+  merge_context_.Add(ikey.sequence, iter_->value());
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey older;
+    if (!ParseKey(&older) ||
+        user_comparator_->Compare(older.user_key, saved_key_) != 0) {
+      break;
+    }
+    const ValueType type = EffectiveType(older);
+    if (type == kTypeMerge) {
+      merge_context_.Add(older.sequence, iter_->value());
+    } else {
+      has_base = (type == kTypeValue);
+      break;
+    }
+  }
+  Slice base;
+  if (has_base) {
+    base = iter_->value();
+  }
+  Status s = merge_context_.Apply(merge_operator_, saved_key_,
+                                  has_base ? &base : nullptr, &saved_value_);
+  merge_context_.Clear();
+  if (s.ok()) {
+    merged_ = true;
+    valid_ = true;
+  } else {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+  }
 }
 
 void DBIter::Prev() {
@@ -212,8 +352,16 @@ void DBIter::Prev() {
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (merged_) {
+      // saved_key_ holds the current key and iter_ is past its operands
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -237,33 +385,72 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // True iff saved_value_ holds the value the operands in merge_context_
+  // apply to.
+  bool has_base = false;
+  merge_context_.Clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      bool parsed;
+      if (pending_prev_key_) {
+        // Parsed by the previous call, which stopped at this entry.
+        ikey = pending_prev_ikey_;
+        pending_prev_key_ = false;
+        parsed = true;
+      } else {
+        parsed = ParseKey(&ikey);
+      }
+      if (parsed && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
+          pending_prev_key_ = true;
+          pending_prev_ikey_ = ikey;
           break;
         }
-        value_type = ikey.type;
-        if (value_type == kTypeDeletion) {
+        const ValueType type = EffectiveType(ikey);
+        if (type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          merge_context_.Clear();
+        } else if (type == kTypeMerge) {
+          // Entries are visited from the oldest, so this operand applies
+          // on top of what was seen so far for the key.
+          if (value_type == kTypeDeletion) {
+            SaveKey(ikey.user_key, &saved_key_);
+            has_base = false;
+          } else if (value_type == kTypeValue) {
+            has_base = true;
+          }
+          merge_context_.AddNewest(ikey.sequence, iter_->value());
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
             swap(empty, saved_value_);
           }
-          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          SaveKey(ikey.user_key, &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
+          merge_context_.Clear();
         }
+        value_type = type;
       }
       iter_->Prev();
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge) {
+    Slice base(saved_value_);
+    Status s = merge_context_.Apply(merge_operator_, saved_key_,
+                                    has_base ? &base : nullptr, &saved_value_);
+    merge_context_.Clear();
+    if (!s.ok()) {
+      status_ = s;
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -277,6 +464,8 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
+  pending_prev_key_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
@@ -291,6 +480,8 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
+  pending_prev_key_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -302,6 +493,8 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
+  pending_prev_key_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -310,9 +503,13 @@ void DBIter::SeekToLast() {
 }  // anonymous namespace
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+                        const MergeOperator* merge_operator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, int max_sequential_skip,
+                        std::vector<std::shared_ptr<const RangeTombstoneList>>
+                            range_dels) {
+  return new DBIter(db, user_key_comparator, merge_operator, internal_iter,
+                    sequence, seed, max_sequential_skip, std::move(range_dels));
 }
 
 }  // namespace leveldb
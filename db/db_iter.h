@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_DB_DB_ITER_H_
 
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/db.h"
@@ -13,13 +15,23 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class RangeTombstoneList;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  After stepping over more than
+// "max_sequential_skip" hidden entries of one user key the iterator seeks
+// past that key instead (0 disables this).  Entries deleted by a tombstone
+// in one of the lists of "range_dels" are hidden as well.
+// Merge operands are combined with the values they update using
+// "merge_operator".
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+                        const MergeOperator* merge_operator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, int max_sequential_skip,
+                        std::vector<std::shared_ptr<const RangeTombstoneList>>
+                            range_dels);
 
 }  // namespace leveldb
 
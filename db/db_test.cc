@@ -6,19 +6,25 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <memory>
 #include <string>
 
 #include "gtest/gtest.h"
+#include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -141,6 +147,17 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Number of RangeSync() calls on table and log files.
+  AtomicCounter table_range_sync_counter_;
+  AtomicCounter log_range_sync_counter_;
+
+  // Number of files opened for direct I/O.
+  AtomicCounter direct_writable_file_counter_;
+  AtomicCounter direct_random_access_file_counter_;
+
+  // The last budget returned by NewMmapBudget().
+  std::atomic<MmapBudget*> mmap_budget_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -150,7 +167,8 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        mmap_budget_(nullptr) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -190,6 +208,14 @@ class SpecialEnv : public EnvWrapper {
         }
         return base_->Sync();
       }
+      Status RangeSync(uint64_t offset, uint64_t nbytes) {
+        if (IsLogFile(fname_)) {
+          env_->log_range_sync_counter_.Increment();
+        } else {
+          env_->table_range_sync_counter_.Increment();
+        }
+        return base_->RangeSync(offset, nbytes);
+      }
     };
     class ManifestFile : public WritableFile {
      private:
@@ -255,6 +281,23 @@ class SpecialEnv : public EnvWrapper {
     }
     return s;
   }
+
+  MmapBudget* NewMmapBudget(uint64_t capacity) {
+    MmapBudget* budget = target()->NewMmapBudget(capacity);
+    mmap_budget_.store(budget);
+    return budget;
+  }
+
+  Status NewDirectWritableFile(const std::string& f, WritableFile** r) {
+    direct_writable_file_counter_.Increment();
+    return target()->NewDirectWritableFile(f, r);
+  }
+
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) {
+    direct_random_access_file_counter_.Increment();
+    return target()->NewDirectRandomAccessFile(f, r);
+  }
 };
 
 class DBTest : public testing::Test {
@@ -306,6 +349,12 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedCompaction:
+        options.pipelined_compaction = true;
+        break;
+      case kBlobFiles:
+        options.min_blob_size = 8;
+        break;
       default:
         break;
     }
@@ -420,6 +469,13 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeRangeDeletion:
+            case kTypeBlobIndex:
+              // Not returned by the internal iterator
+              break;
           }
         }
         iter->Next();
@@ -471,6 +527,20 @@ class DBTest : public testing::Test {
     return static_cast<int>(files.size());
   }
 
+  int CountBlobFiles() {
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    int count = 0;
+    uint64_t number;
+    FileType type;
+    for (const std::string& file : files) {
+      if (ParseFileName(file, &number, &type) && type == kBlobFile) {
+        count++;
+      }
+    }
+    return count;
+  }
+
   uint64_t Size(const Slice& start, const Slice& limit) {
     Range r(start, limit);
     uint64_t size;
@@ -562,7 +632,15 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedCompaction,
+    kBlobFiles,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -1014,6 +1092,383 @@ TEST_F(DBTest, IterMultiWithDeleteAndCompaction) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, IterReseeksOverHiddenVersions) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put("b", "vb" + NumberToString(i)));
+      ASSERT_LEVELDB_OK(Delete("b"));
+    }
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+
+    // First pass reads the memtable, second pass a table that keeps the
+    // hidden versions alive because of a snapshot.
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+        dbfull()->TEST_CompactMemTable();
+      }
+      std::string before;
+      ASSERT_TRUE(db_->GetProperty("leveldb.iterator-reseeks", &before));
+      std::string skipped_before;
+      ASSERT_TRUE(db_->GetProperty("leveldb.iterator-skipped-entries",
+                                   &skipped_before));
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      iter->SeekToFirst();
+      ASSERT_EQ(IterStatus(iter), "a->va");
+      iter->Next();
+      ASSERT_EQ(IterStatus(iter), "c->vc");
+      iter->Prev();
+      ASSERT_EQ(IterStatus(iter), "a->va");
+      iter->Seek("b");
+      ASSERT_EQ(IterStatus(iter), "c->vc");
+      delete iter;
+
+      std::string reseeks, skipped;
+      ASSERT_TRUE(db_->GetProperty("leveldb.iterator-reseeks", &reseeks));
+      ASSERT_TRUE(
+          db_->GetProperty("leveldb.iterator-skipped-entries", &skipped));
+      ASSERT_GE(std::stoull(reseeks), std::stoull(before) + 2);
+      // Far fewer entries than the 2 * 199 hidden ones are stepped over.
+      uint64_t stepped = std::stoull(skipped) - std::stoull(skipped_before);
+      ASSERT_GT(stepped, 0);
+      ASSERT_LT(stepped, 100);
+    }
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, IterReseekDisabled) {
+  Options options = CurrentOptions();
+  options.max_sequential_skip_in_iterations = 0;
+  Reopen(&options);
+  for (int i = 0; i < 50; i++) {
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Delete("b"));
+  }
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_EQ("(c->vc)", Contents());
+  std::string reseeks, skipped;
+  ASSERT_TRUE(db_->GetProperty("leveldb.iterator-reseeks", &reseeks));
+  ASSERT_TRUE(db_->GetProperty("leveldb.iterator-skipped-entries", &skipped));
+  ASSERT_EQ("0", reseeks);
+  ASSERT_NE("0", skipped);
+}
+
+TEST_F(DBTest, DeleteRange) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+
+    for (int pass = 0; pass < 3; pass++) {
+      // Check the memtable, then a level-0 file, then the compacted files.
+      if (pass == 1) {
+        dbfull()->TEST_CompactMemTable();
+      } else if (pass == 2) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("vd", Get("d"));
+      ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+      ASSERT_EQ("vb", Get("b", snapshot));
+      ASSERT_EQ("vc", Get("c", snapshot));
+    }
+    db_->ReleaseSnapshot(snapshot);
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeInMemTableAfterLookups) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+  ASSERT_LEVELDB_OK(Put("e", "ve"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "c"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("vc", Get("c"));
+
+  // Tombstones added after a lookup are seen by the next one.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "c", "e"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+  ASSERT_EQ("ve", Get("e"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "d"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("ve", Get("e"));
+  ASSERT_EQ("va", Get("a", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("b", snapshot));
+  ASSERT_EQ("vc", Get("c", snapshot));
+  ASSERT_EQ("vd", Get("d", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, DeleteRangeDropsCoveredEntries) {
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "key%03d", i);
+    ASSERT_LEVELDB_OK(Put(key, std::string(1000, 'x')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "key010", "key090"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(nullptr, nullptr);
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+
+  ASSERT_EQ("[ ]", AllEntriesFor("key050"));
+  ASSERT_EQ("NOT_FOUND", Get("key050"));
+  ASSERT_EQ("[ " + std::string(1000, 'x') + " ]", AllEntriesFor("key090"));
+  int count = 0;
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(20, count);
+  ASSERT_LT(Size("", "z"), 40000);
+}
+
+namespace {
+
+// Appends the operands to the value, separated by commas.
+class AppendOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "test.AppendOperator"; }
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    new_value->clear();
+    if (existing_value != nullptr) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (const Slice& operand : operands) {
+      if (!new_value->empty()) new_value->push_back(',');
+      new_value->append(operand.data(), operand.size());
+    }
+    return true;
+  }
+  bool PartialMerge(const Slice& key, const Slice& older_operand,
+                    const Slice& newer_operand,
+                    std::string* new_operand) const override {
+    *new_operand = older_operand.ToString() + "," + newer_operand.ToString();
+    return true;
+  }
+};
+
+}  // namespace
+
+TEST_F(DBTest, Merge) {
+  AppendOperator append;
+  do {
+    Options options = CurrentOptions();
+    options.merge_operator = &append;
+    Reopen(&options);
+    ASSERT_LEVELDB_OK(Put("a", "x"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "y"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "1"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "z"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "2"));
+    ASSERT_LEVELDB_OK(Put("c", "v"));
+    ASSERT_LEVELDB_OK(Delete("b"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "3"));
+
+    for (int pass = 0; pass < 3; pass++) {
+      // Check the memtable, then a level-0 file, then the compacted files.
+      if (pass == 1) {
+        dbfull()->TEST_CompactMemTable();
+      } else if (pass == 2) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+      ASSERT_EQ("x,y,z", Get("a"));
+      ASSERT_EQ("3", Get("b"));
+      ASSERT_EQ("(a->x,y,z)(b->3)(c->v)", Contents());
+      ASSERT_EQ("x,y", Get("a", snapshot));
+      ASSERT_EQ("1", Get("b", snapshot));
+    }
+    db_->ReleaseSnapshot(snapshot);
+    Reopen(&options);
+    ASSERT_EQ("x,y,z", Get("a"));
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, MergeOperandsAcrossLevels) {
+  AppendOperator append;
+  Options options = CurrentOptions();
+  options.merge_operator = &append;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("k", "base"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(1));
+  ASSERT_EQ(1, NumTableFilesAtLevel(2));
+
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "2"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "3"));
+  ASSERT_EQ("base,1,2,3", Get("k"));
+
+  // The operands above the value are combined into one
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("[ MERGE(1,2,3), base ]", AllEntriesFor("k"));
+  ASSERT_EQ("base,1,2,3", Get("k"));
+
+  // ... and with the value once they reach it
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("[ base,1,2,3 ]", AllEntriesFor("k"));
+  ASSERT_EQ("(k->base,1,2,3)", Contents());
+}
+
+TEST_F(DBTest, MergeWithRangeDeletion) {
+  AppendOperator append;
+  Options options = CurrentOptions();
+  options.merge_operator = &append;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("k", "old"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "1"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "z"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "2"));
+  ASSERT_EQ("2", Get("k"));
+  ASSERT_EQ("(k->2)", Contents());
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("2", Get("k"));
+  ASSERT_EQ("(k->2)", Contents());
+}
+
+TEST_F(DBTest, MergeRequiresOperator) {
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "k", "v").IsInvalidArgument());
+
+  // Operands written without an operator cannot be read
+  WriteBatch batch;
+  batch.Merge("k", "v");
+  ASSERT_LEVELDB_OK(db_->Write(WriteOptions(), &batch));
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "k", &value).IsNotSupportedError());
+}
+
+namespace {
+
+// Deletes the values "expired" and rewrites the values "old" to "new".
+class TestCompactionFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "test.CompactionFilter"; }
+  bool Filter(int level, const Slice& key, const Slice& value,
+              std::string* new_value, bool* value_changed) const override {
+    if (value == "expired") {
+      return true;
+    }
+    if (value == "old") {
+      *new_value = "new";
+      *value_changed = true;
+    }
+    return false;
+  }
+};
+
+}  // namespace
+
+TEST_F(DBTest, CompactionFilter) {
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("b", "old"));
+  ASSERT_LEVELDB_OK(Put("c", "expired"));
+  ASSERT_LEVELDB_OK(Put("e", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ("v1", Get("a"));
+  ASSERT_EQ("new", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("[ ]", AllEntriesFor("c"));
+  dbfull()->TEST_CompactRange(3, nullptr, nullptr);
+  ASSERT_EQ("0,0,0,0,1", FilesPerLevel());
+
+  // Values seen by a snapshot are not filtered, and values written after
+  // it leave a deletion marker so the snapshot keeps its view.
+  ASSERT_LEVELDB_OK(Put("d", "expired"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put("b", "expired"));
+  // An expired value above an older one in a deeper level also leaves a
+  // deletion marker.
+  ASSERT_LEVELDB_OK(Put("e", "expired"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1,0,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ("expired", Get("d"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("new", Get("b", snapshot));
+  ASSERT_EQ("[ DEL, v1 ]", AllEntriesFor("e"));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(3, nullptr, nullptr);
+  ASSERT_EQ("v1", Get("a"));
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  ASSERT_EQ("[ ]", AllEntriesFor("e"));
+}
+
+// An Env whose clock reads "now_micros".
+class FixedClockEnv : public EnvWrapper {
+ public:
+  FixedClockEnv(Env* base, uint64_t now_micros)
+      : EnvWrapper(base), now_micros_(now_micros) {}
+
+  uint64_t NowMicros() override { return now_micros_; }
+
+ private:
+  const uint64_t now_micros_;
+};
+
+TEST_F(DBTest, TTLCompactionFilter) {
+  // Long before the real time, so that the values expire only if the
+  // filter reads this clock.
+  const uint64_t now = 1000000000;
+  FixedClockEnv clock(env_, now * 1000000);
+  const CompactionFilter* filter = NewTTLCompactionFilter(3600, &clock);
+  Options options = CurrentOptions();
+  options.compaction_filter = filter;
+  Reopen(&options);
+
+  std::string expired = "x";
+  PutFixed64(&expired, now - 7200);
+  std::string live = "y";
+  PutFixed64(&live, now - 60);
+  ASSERT_LEVELDB_OK(Put("expired", expired));
+  ASSERT_LEVELDB_OK(Put("live", live));
+  ASSERT_LEVELDB_OK(Put("short", "z"));
+  ASSERT_EQ(expired, Get("expired"));
+
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ("NOT_FOUND", Get("expired"));
+  ASSERT_EQ(live, Get("live"));
+  ASSERT_EQ("z", Get("short"));
+
+  Close();
+  delete filter;
+}
+
 TEST_F(DBTest, Recover) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1104,6 +1559,26 @@ TEST_F(DBTest, MinorCompactionsHappen) {
   }
 }
 
+TEST_F(DBTest, EstimateNumKeys) {
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.estimate-num-keys", &val));
+  ASSERT_EQ("0", val);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  // The deleted values are still in the table
+  ASSERT_TRUE(db_->GetProperty("leveldb.estimate-num-keys", &val));
+  ASSERT_EQ("100", val);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_TRUE(db_->GetProperty("leveldb.estimate-num-keys", &val));
+  ASSERT_EQ("90", val);
+}
+
 TEST_F(DBTest, RecoverWithLargeLog) {
   {
     Options options = CurrentOptions();
@@ -1162,7 +1637,8 @@ TEST_F(DBTest, RepeatedWritesToSameKey) {
 
   // We must have at most one file per level except for level-0,
   // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  const int kMaxFiles =
+      config::kNumLevels + Options().level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1225,6 +1701,9 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
 
 TEST_F(DBTest, ApproximateSizes) {
   do {
+    if (CurrentOptions().min_blob_size > 0) {
+      continue;  // The sizes of large values are not in the tables
+    }
     Options options = CurrentOptions();
     options.write_buffer_size = 100000000;  // Large write buffer
     options.compression = kNoCompression;
@@ -1284,6 +1763,9 @@ TEST_F(DBTest, ApproximateSizes) {
 
 TEST_F(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
   do {
+    if (CurrentOptions().min_blob_size > 0) {
+      continue;  // The sizes of large values are not in the tables
+    }
     Options options = CurrentOptions();
     options.compression = kNoCompression;
     Reopen();
@@ -1379,8 +1861,15 @@ TEST_F(DBTest, Snapshot) {
 
 TEST_F(DBTest, HiddenValuesAreRemoved) {
   do {
+    if (CurrentOptions().min_blob_size > 0) {
+      continue;  // The sizes of large values are not in the tables
+    }
     Random rnd(301);
     FillLevels("a", "z");
+    // FillLevels() leaves enough level-0 files to trigger a background
+    // compaction, which could otherwise pick up "foo" while the snapshot
+    // below is still held.
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1411,7 +1900,7 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
 TEST_F(DBTest, DeletionMarkers1) {
   Put("foo", "v1");
   ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = Options().max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -1440,7 +1929,7 @@ TEST_F(DBTest, DeletionMarkers1) {
 TEST_F(DBTest, DeletionMarkers2) {
   Put("foo", "v1");
   ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = Options().max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -1465,7 +1954,8 @@ TEST_F(DBTest, DeletionMarkers2) {
 
 TEST_F(DBTest, OverlapInLevel0) {
   do {
-    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
+    ASSERT_EQ(Options().max_mem_compaction_level, 2)
+        << "Fix test to match config";
 
     // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
     // 0.
@@ -1505,6 +1995,665 @@ TEST_F(DBTest, OverlapInLevel0) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.compaction_style = kUniversalCompaction;
+  options.universal_compaction_trigger = 4;
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  // Flushes stay in level 0 until there are enough sorted runs
+  for (int run = 0; run < 3; run++) {
+    for (int i = 0; i < 250; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(run * 250 + i), std::string(100, 'a' + run)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ("3", FilesPerLevel());
+
+  // The fourth run makes the newer runs three times as large as the oldest
+  // one, so everything is merged into the last level.
+  for (int i = 0; i < 250; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(750 + i), std::string(100, 'd')));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+
+  // Small runs are merged together, without rewriting the large run.  The
+  // third one brings the number of runs to four.
+  for (int run = 0; run < 3; run++) {
+    for (int i = 0; i < 25; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(run * 250 + i), std::string(100, 'v')));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,0,0,0,0,1,1", FilesPerLevel());
+
+  for (int i = 0; i < 1000; i++) {
+    const char expected = (i < 750 && i % 250 < 25) ? 'v' : 'a' + i / 250;
+    ASSERT_EQ(std::string(100, expected), Get(Key(i)));
+  }
+  Reopen(&options);
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(0)));
+  ASSERT_EQ(std::string(100, 'd'), Get(Key(999)));
+}
+
+TEST_F(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.level_compaction_dynamic_level_bytes = true;
+  options.write_buffer_size = 1 << 20;
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  // A small database compacts level-0 straight into the last level
+  for (int run = 0; run < options.level0_file_num_compaction_trigger;
+       run++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'a' + run)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+
+  // With 30MB of data, the level above the last one gets a 10MB limit and
+  // the levels above that stay empty.
+  Random rnd(301);
+  const int kNumKeys = 30000;
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < kNumKeys; i++) {
+    const int k = (i * 7919) % kNumKeys;
+    values[k] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(k), values[k]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int last = config::kNumLevels - 1;
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(last) <=
+                                  NumTableFilesAtLevel(last - 1);
+       i++) {
+    DelayMilliseconds(10);
+  }
+  for (int level = 1; level < last - 1; level++) {
+    ASSERT_EQ(0, NumTableFilesAtLevel(level)) << level;
+  }
+  ASSERT_GT(NumTableFilesAtLevel(last), NumTableFilesAtLevel(last - 1));
+
+  for (int k = 0; k < kNumKeys; k += 97) {
+    ASSERT_EQ(values[k], Get(Key(k)));
+  }
+  Reopen(&options);
+  for (int k = 1; k < kNumKeys; k += 97) {
+    ASSERT_EQ(values[k], Get(Key(k)));
+  }
+}
+
+// Which file each priority picks is checked by PickCompactionTest; this
+// checks that compactions started with each of them keep the data intact.
+TEST_F(DBTest, CompactionPriority) {
+  for (CompactionPriority priority :
+       {kRoundRobin, kMinOverlappingRatio, kOldestFileFirst}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.compaction_priority = priority;
+    options.write_buffer_size = 1 << 20;
+    options.compression = kNoCompression;
+    DestroyAndReopen(&options);
+
+    // Overwrite 15MB of data until level-1 grows past its limit and
+    // compacts into level-2
+    Random rnd(301);
+    const int kNumKeys = 15000;
+    std::vector<std::string> values(kNumKeys);
+    for (int i = 0; i < 3 * kNumKeys; i++) {
+      const int k = rnd.Uniform(kNumKeys);
+      values[k] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(k), values[k]));
+    }
+    for (int i = 0; i < 1000 && NumTableFilesAtLevel(2) == 0; i++) {
+      DelayMilliseconds(10);
+    }
+    ASSERT_GT(NumTableFilesAtLevel(2), 0) << priority;
+
+    for (int k = 0; k < kNumKeys; k++) {
+      ASSERT_EQ(values[k].empty() ? "NOT_FOUND" : values[k], Get(Key(k)));
+    }
+  }
+}
+
+TEST_F(DBTest, DeletionCompaction) {
+  Options options = CurrentOptions();
+  Reopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 90; i++) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  ASSERT_LEVELDB_OK(Put(Key(5), "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // The level-1 file is mostly deletion markers, as its table properties
+  // record, so it is compacted into level-2, where the markers and the
+  // entries they delete are dropped.
+  options.deletion_compaction_percent = 50;
+  Reopen(&options);
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(1) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(6)));
+  ASSERT_EQ("v2", Get(Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(6)));
+  ASSERT_EQ("v", Get(Key(95)));
+}
+
+TEST_F(DBTest, DeletionCompactionDropsMarkers) {
+  Options options = CurrentOptions();
+  options.deletion_compaction_percent = 40;
+  Reopen(&options);
+
+  // A file with nothing below it, and a deletion marker for most of its
+  // entries.  Moving it down a level would keep them all.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  for (int i = 0; i < 90; i++) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(2) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,0,0,1", FilesPerLevel());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(6)));
+  std::string num_keys;
+  ASSERT_TRUE(db_->GetProperty("leveldb.estimate-num-keys", &num_keys));
+  ASSERT_EQ("10", num_keys);
+  ASSERT_EQ("NOT_FOUND", Get(Key(6)));
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(95)));
+}
+
+TEST_F(DBTest, SetOptions) {
+  Options options = CurrentOptions();
+  options.level0_file_num_compaction_trigger = 100;
+  options.max_mem_compaction_level = 0;
+  Reopen(&options);
+
+  ASSERT_TRUE(db_->SetOptions({{"block_size", "1024"}}).IsInvalidArgument());
+  ASSERT_TRUE(db_->SetOptions({{"write_buffer_size", "65536"},
+                               {"max_file_size", "big"}})
+                  .IsInvalidArgument());
+
+  // Memtables are flushed after 64KB
+  ASSERT_LEVELDB_OK(db_->SetOptions({{"write_buffer_size", "65536"}}));
+  for (int i = 0; i < 600; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  ASSERT_GE(NumTableFilesAtLevel(0), 5);
+
+  // Lowering the trigger compacts level-0 without waiting for a write
+  ASSERT_LEVELDB_OK(
+      db_->SetOptions({{"level0_file_num_compaction_trigger", "4"}}));
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) >= 4; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_LT(NumTableFilesAtLevel(0), 4);
+  for (int i = 0; i < 600; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+}
+
+// Occupies the background thread until *arg is set.
+static void BlockBackgroundWork(void* arg) {
+  std::atomic<bool>* release = reinterpret_cast<std::atomic<bool>*>(arg);
+  while (!release->load(std::memory_order_acquire)) {
+    DelayMilliseconds(1);
+  }
+}
+
+TEST_F(DBTest, DelayedWriteRate) {
+  Options options = CurrentOptions();
+  options.level0_file_num_compaction_trigger = 100;
+  options.max_mem_compaction_level = 0;
+  options.delayed_write_rate = 1 << 20;
+  Reopen(&options);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 4);
+  std::string value;
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &value));
+  ASSERT_EQ("0", value);
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &value));
+  ASSERT_EQ("0", value);
+
+  // Keep level-0 at 4 files, halfway from the slowdown to the stop trigger
+  std::atomic<bool> release(false);
+  env_->Schedule(&BlockBackgroundWork, &release);
+  ASSERT_LEVELDB_OK(
+      db_->SetOptions({{"level0_file_num_compaction_trigger", "2"},
+                       {"level0_slowdown_writes_trigger", "2"},
+                       {"level0_stop_writes_trigger", "6"}}));
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &value));
+  ASSERT_EQ("524288", value);
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &value));
+  ASSERT_NE("0", value);
+
+  // 100KB take about 200ms at 512KB/s
+  const uint64_t start_micros = env_->NowMicros();
+  for (int i = 0; i < 10; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(10000, 'x')));
+  }
+  ASSERT_GE(env_->NowMicros() - start_micros, 100000);
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stalls", &value));
+  const size_t pos = value.find("level0-slowdown");
+  ASSERT_NE(std::string::npos, pos);
+  long long stalls = 0;
+  ASSERT_EQ(1, std::sscanf(value.c_str() + pos, "level0-slowdown %lld",
+                           &stalls));
+  ASSERT_GT(stalls, 0);
+
+  release.store(true, std::memory_order_release);
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) >= 2; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &value));
+  ASSERT_EQ("0", value);
+}
+
+TEST_F(DBTest, DelayedWriteRateWithoutHardLimit) {
+  Options options = CurrentOptions();
+  options.level0_file_num_compaction_trigger = 100;
+  options.max_mem_compaction_level = 0;
+  options.delayed_write_rate = 1 << 20;
+  Reopen(&options);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // Past the soft limit, with the hard limit disabled, writes are
+  // throttled to delayed_write_rate rather than to the minimum rate.
+  std::atomic<bool> release(false);
+  env_->Schedule(&BlockBackgroundWork, &release);
+  ASSERT_LEVELDB_OK(
+      db_->SetOptions({{"level0_file_num_compaction_trigger", "2"},
+                       {"soft_pending_compaction_bytes_limit", "1"},
+                       {"hard_pending_compaction_bytes_limit", "0"}}));
+  std::string value;
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &value));
+  ASSERT_NE("0", value);
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &value));
+  ASSERT_EQ("1048576", value);
+
+  release.store(true, std::memory_order_release);
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) >= 2; i++) {
+    DelayMilliseconds(10);
+  }
+}
+
+TEST_F(DBTest, RateLimiter) {
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(100 << 20));
+  Options options = CurrentOptions();
+  options.rate_limiter = limiter.get();
+  options.max_mem_compaction_level = 0;
+  Reopen(&options);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  const int64_t flushed = limiter->GetTotalBytesThrough(RateLimiter::kHigh);
+  ASSERT_GT(flushed, 2 * 100 * 1000);
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(RateLimiter::kLow));
+
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(flushed, limiter->GetTotalBytesThrough(RateLimiter::kHigh));
+  ASSERT_GT(limiter->GetTotalBytesThrough(RateLimiter::kLow), 100 * 1000);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+  Close();
+}
+
+TEST_F(DBTest, BytesPerSync) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 1 << 20;
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(0, env_->table_range_sync_counter_.Read());
+  ASSERT_EQ(0, env_->log_range_sync_counter_.Read());
+
+  // 200KB are written back in pieces of at least 16KB
+  options.bytes_per_sync = 16 << 10;
+  options.wal_bytes_per_sync = 16 << 10;
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  ASSERT_GE(env_->log_range_sync_counter_.Read(), 10);
+  ASSERT_LE(env_->log_range_sync_counter_.Read(), 13);
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GE(env_->table_range_sync_counter_.Read(), 10);
+  ASSERT_LE(env_->table_range_sync_counter_.Read(), 13);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, DirectIO) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.use_direct_io_for_flush_and_compaction = true;
+  Reopen(&options);
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 500; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 500; i += 2) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int flushed_files = env_->direct_writable_file_counter_.Read();
+  ASSERT_EQ(2, flushed_files);
+
+  // Compaction inputs are opened for direct reads, and user reads are not
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_GT(env_->direct_writable_file_counter_.Read(), flushed_files);
+  ASSERT_GE(env_->direct_random_access_file_counter_.Read(), flushed_files);
+  const int direct_reads = env_->direct_random_access_file_counter_.Read();
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  ASSERT_EQ(direct_reads, env_->direct_random_access_file_counter_.Read());
+
+  options.use_direct_reads = true;
+  Reopen(&options);
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  ASSERT_GT(env_->direct_random_access_file_counter_.Read(), direct_reads);
+}
+
+TEST_F(DBTest, MmapReadBudget) {
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+  }
+
+  // Room for about a tenth of the tables, and none
+  for (int64_t budget : {100 << 10, 0}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.write_buffer_size = 100 << 10;
+    options.max_mmap_read_bytes = budget;
+    options.env = env_;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    dbfull()->CompactRange(nullptr, nullptr);
+    for (int i = 0; i < 1000; i += 7) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+    const MmapBudget* mmap_budget = env_->mmap_budget_.load();
+    ASSERT_TRUE(mmap_budget != nullptr);
+    ASSERT_EQ(budget, mmap_budget->Capacity());
+    ASSERT_LE(mmap_budget->MappedBytes(), budget);
+    if (budget > 0) {
+      // The tables read most often are mapped
+      ASSERT_GT(mmap_budget->MappedBytes(), 0);
+    } else {
+      ASSERT_EQ(0, mmap_budget->MappedBytes());
+    }
+    int count = 0;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(values[count], iter->value().ToString());
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(1000, count);
+  }
+}
+
+TEST_F(DBTest, CompressionPerLevel) {
+  Options options = CurrentOptions();
+  options.compression_per_level = {kNoCompression, kSnappyCompression,
+                                   kZstdCompression};
+  options.zstd_compression_level_per_level = {1, 1, 5};
+  ASSERT_EQ(kNoCompression, TableOptionsForLevel(options, 0).compression);
+  ASSERT_EQ(kSnappyCompression, TableOptionsForLevel(options, 1).compression);
+  ASSERT_EQ(kZstdCompression, TableOptionsForLevel(options, 2).compression);
+  ASSERT_EQ(kZstdCompression, TableOptionsForLevel(options, 6).compression);
+  ASSERT_EQ(1, TableOptionsForLevel(options, 1).zstd_compression_level);
+  ASSERT_EQ(5, TableOptionsForLevel(options, 6).zstd_compression_level);
+
+  // Flushed files are not compressed, and compacted ones are
+  options.compression_per_level = {kNoCompression, kSnappyCompression};
+  options.max_mem_compaction_level = 0;
+  Reopen(&options);
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 100; i++) {
+    std::string value;
+    test::CompressibleString(&rnd, 0.25, 1000, &value);
+    values.push_back(value);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+  const uint64_t flushed_size = Size("", Key(100));
+  ASSERT_GE(flushed_size, 100 * 1000);
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  std::string compressed;
+  if (port::Snappy_Compress(values[0].data(), values[0].size(), &compressed)) {
+    ASSERT_LT(Size("", Key(100)), flushed_size / 2);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, ZstdDictionary) {
+  // Small documents that share most of their structure
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 2000; i++) {
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"id\": %d, \"name\": \"user%d\", \"active\": %s, "
+                  "\"score\": %d, \"tags\": [\"a%d\", \"b%d\"]}",
+                  i, rnd.Uniform(100000), rnd.OneIn(2) ? "true" : "false",
+                  rnd.Uniform(1000), rnd.Uniform(50), rnd.Uniform(50));
+    values.push_back(buf);
+  }
+
+  std::unique_ptr<const FilterPolicy> filter_policy(NewBloomFilterPolicy(10));
+  uint64_t sizes[2];
+  for (int use_dict = 0; use_dict < 2; use_dict++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.compression = kZstdCompression;
+    options.zstd_max_dict_bytes = use_dict ? 4 << 10 : 0;
+    options.zstd_max_train_bytes = 32 << 10;
+    // Small blocks share little context of their own, which is where a
+    // dictionary pays off
+    options.block_size = 1024;
+    options.filter_policy = filter_policy.get();
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 2000; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    sizes[use_dict] = Size("", Key(2000));
+
+    // Point reads, with the filters, and a scan of every block
+    for (int i = 0; i < 2000; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+    ASSERT_EQ("NOT_FOUND", Get(Key(2000)));
+    int count = 0;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(values[count], iter->value().ToString());
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(2000, count);
+
+    // Files that fit the training budget train on all of their blocks
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    Reopen(&options);
+    for (int i = 0; i < 2000; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+  }
+
+  std::string compressed;
+  if (port::Zstd_Compress(1, values[0].data(), values[0].size(),
+                          &compressed)) {
+    ASSERT_LT(sizes[1], sizes[0]);
+  }
+}
+
+TEST_F(DBTest, BlobFiles) {
+  AppendOperator append;
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.min_blob_size = 3;
+  options.merge_operator = &append;
+  options.compaction_filter = &filter;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  const std::string big(1000, 'b');
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(Put("b", big));
+  ASSERT_LEVELDB_OK(Put("c", "old"));
+  ASSERT_LEVELDB_OK(Put("d", "expired"));
+  ASSERT_LEVELDB_OK(Put("e", "base"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, CountBlobFiles());
+  ASSERT_EQ("v", Get("a"));
+  ASSERT_EQ(big, Get("b"));
+  ASSERT_EQ("(a->v)(b->" + big + ")(c->old)(d->expired)(e->base)",
+            Contents());
+
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put("b", "small"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "e", "x"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("small", Get("b"));
+  ASSERT_EQ(big, Get("b", snapshot));
+  ASSERT_EQ("base,x", Get("e"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // The merge operator and the compaction filter see the values
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->v)(b->small)(c->new)(e->base,x)", Contents());
+  // The first file is no longer referred to
+  ASSERT_EQ(2, CountBlobFiles());
+
+  Reopen(&options);
+  ASSERT_EQ("(a->v)(b->small)(c->new)(e->base,x)", Contents());
+  ASSERT_EQ("new", Get("c"));
+}
+
+TEST_F(DBTest, BlobReadError) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(Put("b", std::string(1000, 'b')));
+  ASSERT_LEVELDB_OK(Put("c", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  Close();
+  std::vector<std::string> files;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &files));
+  uint64_t number;
+  FileType type;
+  for (const std::string& file : files) {
+    if (ParseFileName(file, &number, &type) && type == kBlobFile) {
+      ASSERT_LEVELDB_OK(WriteStringToFile(env_, "", dbname_ + "/" + file));
+    }
+  }
+  Reopen(&options);
+
+  // The iterator stops at the entry whose value cannot be read
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("a", iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(!iter->status().ok());
+  delete iter;
+}
+
+TEST_F(DBTest, BlobGarbageCollection) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  options.blob_gc_age_cutoff = 0.0;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  for (int i = 0; i < 10; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put(Key(0), std::string(1000, 'z')));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  // The other values of the first file keep it alive
+  ASSERT_EQ(2, CountBlobFiles());
+
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  options.blob_gc_age_cutoff = 1.0;
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  // Every value was moved to the file written by the last compaction
+  ASSERT_EQ(1, CountBlobFiles());
+  ASSERT_EQ(std::string(1000, 'z'), Get(Key(0)));
+  for (int i = 1; i < 10; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i), Get(Key(i)));
+  }
+}
+
 TEST_F(DBTest, L0_CompactionBug_Issue44_a) {
   Reopen();
   ASSERT_LEVELDB_OK(Put("b", "v"));
@@ -1637,8 +2786,8 @@ TEST_F(DBTest, CustomComparator) {
 }
 
 TEST_F(DBTest, ManualCompaction) {
-  ASSERT_EQ(config::kMaxMemCompactLevel, 2)
-      << "Need to update this test to match kMaxMemCompactLevel";
+  ASSERT_EQ(Options().max_mem_compaction_level, 2)
+      << "Need to update this test to match max_mem_compaction_level";
 
   MakeTables(3, "p", "q");
   ASSERT_EQ("1,1,1", FilesPerLevel());
@@ -1871,7 +3020,7 @@ TEST_F(DBTest, ManifestWriteError) {
     // Memtable compaction (will succeed)
     dbfull()->TEST_CompactMemTable();
     ASSERT_EQ("bar", Get("foo"));
-    const int last = config::kMaxMemCompactLevel;
+    const int last = Options().max_mem_compaction_level;
     ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo=>bar is now in last level
 
     // Merging compaction (will fail)
@@ -1977,6 +3126,97 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+namespace {
+// A filter policy whose filters always match
+class NamedFilterPolicy : public FilterPolicy {
+ public:
+  explicit NamedFilterPolicy(const char* name) : name_(name) {}
+  const char* Name() const override { return name_; }
+  void CreateFilter(const Slice* keys, int n,
+                    std::string* dst) const override {}
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    return true;
+  }
+
+ private:
+  const char* const name_;
+};
+}  // namespace
+
+TEST_F(DBTest, FilterPolicyPerLevel) {
+  std::unique_ptr<const FilterPolicy> policy(NewBloomFilterPolicy(10));
+  std::unique_ptr<const FilterPolicy> level0_policy(NewBloomFilterPolicy(20));
+  Options options = CurrentOptions();
+  options.filter_policy = policy.get();
+  options.filter_policy_per_level = {level0_policy.get(), nullptr};
+  ASSERT_EQ(level0_policy.get(),
+            TableOptionsForLevel(options, 0).filter_policy);
+  ASSERT_EQ(nullptr, TableOptionsForLevel(options, 1).filter_policy);
+  ASSERT_EQ(nullptr, TableOptionsForLevel(options, 6).filter_policy);
+
+  // Reads could not use filters written with another policy
+  std::unique_ptr<const FilterPolicy> other_policy(
+      new NamedFilterPolicy("test.OtherFilter"));
+  options.filter_policy_per_level = {other_policy.get(), nullptr};
+  ASSERT_TRUE(TryReopen(&options).IsInvalidArgument());
+  options.filter_policy = nullptr;
+  options.filter_policy_per_level = {level0_policy.get(), nullptr};
+  ASSERT_TRUE(TryReopen(&options).IsInvalidArgument());
+  options.filter_policy = policy.get();
+
+  env_->count_random_reads_ = true;
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.max_mem_compaction_level = 0;
+  Reopen(&options);
+
+  const int N = 2000;
+  auto missing_reads = [&]() {
+    // Prevent auto compactions triggered by seeks
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+    env_->random_read_counter_.Reset();
+    // Keys within the range of the files
+    for (int i = 0; i < N - 1; i++) {
+      EXPECT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+    return env_->random_read_counter_.Read();
+  };
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1", FilesPerLevel());
+  // The filters written by the level-0 policy are loaded and used by
+  // "filter_policy", so lookups of missing keys rarely read a block
+  ASSERT_LE(missing_reads(), 3 * N / 100);
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("0,1", FilesPerLevel());
+  ASSERT_GE(missing_reads(), N - 1);
+
+  // Without per-level policies, only the bottommost level has no filters
+  options.filter_policy_per_level.clear();
+  options.optimize_filters_for_hits = true;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("0,1", FilesPerLevel());
+  ASSERT_GE(missing_reads(), N - 1);
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1,1", FilesPerLevel());
+  ASSERT_LE(missing_reads(), N - 1 + 3 * N / 100);
+
+  Close();
+  delete options.block_cache;
+}
+
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
   // Close() error when switching to a new log file.
@@ -2122,8 +3362,16 @@ class ModelDB : public DB {
   }
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override {
-    assert(false);  // Not implemented
-    return Status::NotFound(key);
+    const KVMap* map =
+        (options.snapshot == nullptr)
+            ? &map_
+            : &reinterpret_cast<const ModelSnapshot*>(options.snapshot)->map_;
+    KVMap::const_iterator it = map->find(key.ToString());
+    if (it == map->end()) {
+      return Status::NotFound(key);
+    }
+    *value = it->second;
+    return Status::OK();
   }
   Iterator* NewIterator(const ReadOptions& options) override {
     if (options.snapshot == nullptr) {
@@ -2153,9 +3401,24 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin, const Slice& end) override {
+        map_->erase(map_->lower_bound(begin.ToString()),
+                    map_->lower_bound(end.ToString()));
+      }
+      void Merge(const Slice& key, const Slice& operand) override {
+        KVMap::iterator it = map_->find(key.ToString());
+        Slice existing;
+        if (it != map_->end()) existing = it->second;
+        std::string merged;
+        merge_operator_->FullMerge(key, it != map_->end() ? &existing : nullptr,
+                                   std::vector<Slice>(1, operand), &merged);
+        (*map_)[key.ToString()] = merged;
+      }
+      const MergeOperator* merge_operator_;
     };
     Handler handler;
     handler.map_ = &map_;
+    handler.merge_operator_ = options_.merge_operator;
     return batch->Iterate(&handler);
   }
 
@@ -2190,7 +3453,13 @@ class ModelDB : public DB {
       iter_ = map_->lower_bound(k.ToString());
     }
     void Next() override { ++iter_; }
-    void Prev() override { --iter_; }
+    void Prev() override {
+      if (iter_ == map_->begin()) {
+        iter_ = map_->end();
+      } else {
+        --iter_;
+      }
+    }
     Slice key() const override { return iter_->first; }
     Slice value() const override { return iter_->second; }
     Status status() const override { return Status::OK(); }
@@ -2251,6 +3520,22 @@ static bool CompareIterators(int step, DB* model, DB* db,
     }
   }
 
+  // Compare equality of all elements using Prev().
+  for (miter->SeekToLast(), dbiter->SeekToLast();
+       ok && miter->Valid() && dbiter->Valid(); miter->Prev(), dbiter->Prev()) {
+    if (miter->key().compare(dbiter->key()) != 0 ||
+        miter->value().compare(dbiter->value()) != 0) {
+      std::fprintf(stderr, "step %d: Reverse mismatch: '%s' vs. '%s'\n", step,
+                   EscapeString(miter->key()).c_str(),
+                   EscapeString(dbiter->key()).c_str());
+      ok = false;
+    }
+  }
+  if (ok && miter->Valid() != dbiter->Valid()) {
+    std::fprintf(stderr, "step %d: Mismatch at start of iterators\n", step);
+    ok = false;
+  }
+
   if (ok) {
     // Validate iterator equality when performing seeks.
     for (auto kiter = seek_keys.begin(); ok && kiter != seek_keys.end();
@@ -2357,4 +3642,171 @@ TEST_F(DBTest, Randomized) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, RandomizedDeleteRange) {
+  Random rnd(test::RandomSeed());
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;  // Small, to flush often
+  Reopen(&options);
+  ModelDB model(options);
+  const int N = 5000;
+  const Snapshot* model_snap = nullptr;
+  const Snapshot* db_snap = nullptr;
+  for (int step = 0; step < N; step++) {
+    const int p = rnd.Uniform(100);
+    if (p < 70) {
+      const std::string k = test::RandomKey(&rnd, 2);
+      const std::string v = RandomString(&rnd, rnd.Uniform(100));
+      ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
+    } else if (p < 85) {
+      const std::string k = test::RandomKey(&rnd, 2);
+      ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
+      ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
+    } else {
+      std::string begin = test::RandomKey(&rnd, 1 + rnd.Uniform(2));
+      std::string end = test::RandomKey(&rnd, 1 + rnd.Uniform(2));
+      if (end < begin) std::swap(begin, end);
+      ASSERT_LEVELDB_OK(model.DeleteRange(WriteOptions(), begin, end));
+      ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), begin, end));
+    }
+
+    if ((step % 100) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+      ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+      for (int i = 0; i < 20; i++) {
+        const std::string k = test::RandomKey(&rnd, 2);
+        std::string expected, actual;
+        Status ms = model.Get(ReadOptions(), k, &expected);
+        Status ds = db_->Get(ReadOptions(), k, &actual);
+        ASSERT_EQ(ms.IsNotFound(), ds.IsNotFound()) << k;
+        ASSERT_EQ(expected, actual) << k;
+      }
+      if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+      if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+      if ((step % 1000) == 0) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+      model_snap = model.GetSnapshot();
+      db_snap = db_->GetSnapshot();
+    }
+  }
+  if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+  if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+  Reopen(&options);
+  ASSERT_TRUE(CompareIterators(N, &model, db_, nullptr, nullptr));
+}
+
+TEST_F(DBTest, RandomizedUniversalCompaction) {
+  Random rnd(test::RandomSeed());
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;  // Small, to flush often
+  options.compaction_style = kUniversalCompaction;
+  Reopen(&options);
+  ModelDB model(options);
+  const int N = 10000;
+  const Snapshot* model_snap = nullptr;
+  const Snapshot* db_snap = nullptr;
+  for (int step = 0; step < N; step++) {
+    const int p = rnd.Uniform(100);
+    if (p < 80) {
+      const std::string k = test::RandomKey(&rnd, 3);
+      const std::string v = RandomString(&rnd, rnd.Uniform(100));
+      ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
+    } else if (p < 95) {
+      const std::string k = test::RandomKey(&rnd, 3);
+      ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
+      ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
+    } else {
+      std::string begin = test::RandomKey(&rnd, 1 + rnd.Uniform(3));
+      std::string end = test::RandomKey(&rnd, 1 + rnd.Uniform(3));
+      if (end < begin) std::swap(begin, end);
+      ASSERT_LEVELDB_OK(model.DeleteRange(WriteOptions(), begin, end));
+      ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), begin, end));
+    }
+
+    if ((step % 100) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+      ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+      for (int i = 0; i < 20; i++) {
+        const std::string k = test::RandomKey(&rnd, 3);
+        std::string expected, actual;
+        Status ms = model.Get(ReadOptions(), k, &expected);
+        Status ds = db_->Get(ReadOptions(), k, &actual);
+        ASSERT_EQ(ms.IsNotFound(), ds.IsNotFound()) << k;
+        ASSERT_EQ(expected, actual) << k;
+      }
+      if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+      if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+      model_snap = model.GetSnapshot();
+      db_snap = db_->GetSnapshot();
+    }
+  }
+  if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+  if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+  Reopen(&options);
+  ASSERT_TRUE(CompareIterators(N, &model, db_, nullptr, nullptr));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_TRUE(CompareIterators(N, &model, db_, nullptr, nullptr));
+}
+
+TEST_F(DBTest, RandomizedMerge) {
+  Random rnd(test::RandomSeed());
+  AppendOperator append;
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;  // Small, to flush often
+  options.merge_operator = &append;
+  Reopen(&options);
+  ModelDB model(options);
+  const int N = 5000;
+  const Snapshot* model_snap = nullptr;
+  const Snapshot* db_snap = nullptr;
+  for (int step = 0; step < N; step++) {
+    const int p = rnd.Uniform(100);
+    const std::string k = test::RandomKey(&rnd, 2);
+    if (p < 20) {
+      const std::string v = RandomString(&rnd, rnd.Uniform(10));
+      ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
+    } else if (p < 30) {
+      ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
+      ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
+    } else if (p < 32) {
+      std::string end = test::RandomKey(&rnd, 2);
+      std::string begin = k;
+      if (end < begin) std::swap(begin, end);
+      ASSERT_LEVELDB_OK(model.DeleteRange(WriteOptions(), begin, end));
+      ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), begin, end));
+    } else {
+      const std::string operand = NumberToString(step);
+      ASSERT_LEVELDB_OK(model.Merge(WriteOptions(), k, operand));
+      ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), k, operand));
+    }
+
+    if ((step % 100) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+      ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+      for (int i = 0; i < 20; i++) {
+        const std::string key = test::RandomKey(&rnd, 2);
+        std::string expected, actual;
+        Status ms = model.Get(ReadOptions(), key, &expected);
+        Status ds = db_->Get(ReadOptions(), key, &actual);
+        ASSERT_EQ(ms.IsNotFound(), ds.IsNotFound()) << key;
+        ASSERT_EQ(expected, actual) << key;
+      }
+      if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+      if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+      if ((step % 1000) == 0) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+      model_snap = model.GetSnapshot();
+      db_snap = db_->GetSnapshot();
+    }
+  }
+  if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+  if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+  Reopen(&options);
+  ASSERT_TRUE(CompareIterators(N, &model, db_, nullptr, nullptr));
+}
+
 }  // namespace leveldb
@@ -40,26 +40,20 @@ std::string InternalKey::DebugString() const {
   return ss.str();
 }
 
-const char* InternalKeyComparator::Name() const {
-  return "leveldb.InternalKeyComparator";
+void ExtendKeyRangeForTombstone(const InternalKeyComparator& icmp,
+                                const Slice& start, const Slice& end,
+                                InternalKey* smallest, InternalKey* largest) {
+  if (smallest->empty() || icmp.Compare(start, smallest->Encode()) < 0) {
+    smallest->DecodeFrom(start);
+  }
+  InternalKey limit(end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (largest->empty() || icmp.Compare(limit, *largest) > 0) {
+    *largest = limit;
+  }
 }
 
-int InternalKeyComparator::Compare(const Slice& akey, const Slice& bkey) const {
-  // Order by:
-  //    increasing user key (according to user-supplied comparator)
-  //    decreasing sequence number
-  //    decreasing type (though sequence# should be enough to disambiguate)
-  int r = user_comparator_->Compare(ExtractUserKey(akey), ExtractUserKey(bkey));
-  if (r == 0) {
-    const uint64_t anum = DecodeFixed64(akey.data() + akey.size() - 8);
-    const uint64_t bnum = DecodeFixed64(bkey.data() + bkey.size() - 8);
-    if (anum > bnum) {
-      r = -1;
-    } else if (anum < bnum) {
-      r = +1;
-    }
-  }
-  return r;
+const char* InternalKeyComparator::Name() const {
+  return "leveldb.InternalKeyComparator";
 }
 
 void InternalKeyComparator::FindShortestSeparator(std::string* start,
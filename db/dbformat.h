@@ -19,28 +19,12 @@
 
 namespace leveldb {
 
-// Grouping of constants.  We may want to make some of these
-// parameters set via options.
+// Grouping of constants.  The number of levels sizes per-level state
+// throughout the implementation and bounds the levels accepted from the
+// manifest, so unlike the level-0 triggers it is not an option.
 namespace config {
 static const int kNumLevels = 7;
 
-// Level-0 compaction is started when we hit this many files.
-static const int kL0_CompactionTrigger = 4;
-
-// Soft limit on number of level-0 files.  We slow down writes at this point.
-static const int kL0_SlowdownWritesTrigger = 8;
-
-// Maximum number of level-0 files.  We stop writes at this point.
-static const int kL0_StopWritesTrigger = 12;
-
-// Maximum level to which a new compacted memtable is pushed if it
-// does not create overlap.  We try to push to level 2 to avoid the
-// relatively expensive level 0=>1 compactions and to avoid some
-// expensive manifest file operations.  We do not push all the way to
-// the largest level since that can generate a lot of wasted disk
-// space if the same key space is being repeatedly overwritten.
-static const int kMaxMemCompactLevel = 2;
-
 // Approximate gap in bytes between samples of data read during iteration.
 static const int kReadBytesPeriod = 1048576;
 
@@ -51,14 +35,27 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+//
+// kTypeRangeDeletion entries never appear among the point entries of a
+// memtable or table: their key is the start of the deleted range, their
+// value the (exclusive) end, and they are stored separately.
+//
+// kTypeBlobIndex entries only appear in table files: their value is the
+// BlobIndex of a value kept in a blob file (see db/blob_file.h).
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2,
+  kTypeMerge = 0x3,
+  kTypeBlobIndex = 0x4
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeBlobIndex;
 
 typedef uint64_t SequenceNumber;
 
@@ -97,14 +94,29 @@ inline Slice ExtractUserKey(const Slice& internal_key) {
   return Slice(internal_key.data(), internal_key.size() - 8);
 }
 
+// Returns the value type of an internal key.
+inline ValueType ExtractValueType(const Slice& internal_key) {
+  assert(internal_key.size() >= 8);
+  const size_t n = internal_key.size();
+  return static_cast<ValueType>(DecodeFixed64(internal_key.data() + n - 8) &
+                                0xff);
+}
+
 // A comparator for internal keys that uses a specified comparator for
 // the user key portion and breaks ties by decreasing sequence number.
-class InternalKeyComparator : public Comparator {
+//
+// The class is final and Compare() is inline, so that callers that hold
+// an InternalKeyComparator rather than a Comparator, such as the skiplist
+// of the memtable, make no virtual call.  Neither does Compare() itself
+// when the user comparator is BytewiseComparator().
+class InternalKeyComparator final : public Comparator {
  private:
   const Comparator* user_comparator_;
+  const bool bytewise_;  // user_comparator_ == BytewiseComparator()
 
  public:
-  explicit InternalKeyComparator(const Comparator* c) : user_comparator_(c) {}
+  explicit InternalKeyComparator(const Comparator* c)
+      : user_comparator_(c), bytewise_(c == BytewiseComparator()) {}
   const char* Name() const override;
   int Compare(const Slice& a, const Slice& b) const override;
   void FindShortestSeparator(std::string* start,
@@ -160,14 +172,47 @@ class InternalKey {
 
   void Clear() { rep_.clear(); }
 
+  // True iff *this has not been set (see the default constructor).
+  bool empty() const { return rep_.empty(); }
+
   std::string DebugString() const;
 };
 
+inline int InternalKeyComparator::Compare(const Slice& akey,
+                                          const Slice& bkey) const {
+  // Order by:
+  //    increasing user key (according to user-supplied comparator)
+  //    decreasing sequence number
+  //    decreasing type (though sequence# should be enough to disambiguate)
+  const Slice auser = ExtractUserKey(akey);
+  const Slice buser = ExtractUserKey(bkey);
+  int r = bytewise_ ? auser.compare(buser)
+                    : user_comparator_->Compare(auser, buser);
+  if (r == 0) {
+    const uint64_t anum = DecodeFixed64(akey.data() + akey.size() - 8);
+    const uint64_t bnum = DecodeFixed64(bkey.data() + bkey.size() - 8);
+    if (anum > bnum) {
+      r = -1;
+    } else if (anum < bnum) {
+      r = +1;
+    }
+  }
+  return r;
+}
+
 inline int InternalKeyComparator::Compare(const InternalKey& a,
                                           const InternalKey& b) const {
   return Compare(a.Encode(), b.Encode());
 }
 
+// Widen [*smallest, *largest], either of which may be empty, so that it
+// includes the range tombstone whose start is the internal key "start" and
+// whose exclusive end is the user key "end".  The upper bound becomes a
+// sentinel that sorts before every real entry for "end".
+void ExtendKeyRangeForTombstone(const InternalKeyComparator& icmp,
+                                const Slice& start, const Slice& end,
+                                InternalKey* smallest, InternalKey* largest);
+
 inline bool ParseInternalKey(const Slice& internal_key,
                              ParsedInternalKey* result) {
   const size_t n = internal_key.size();
@@ -177,7 +222,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeBlobIndex));
 }
 
 // A helper class useful for DBImpl::Get()
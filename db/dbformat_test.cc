@@ -111,6 +111,45 @@ TEST(FormatTest, InternalKeyShortestSuccessor) {
             ShortSuccessor(IKey("\xff\xff", 100, kTypeValue)));
 }
 
+namespace {
+// Orders user keys like BytewiseComparator(), through a virtual call
+class WrappedBytewiseComparator : public Comparator {
+ public:
+  const char* Name() const override { return "test.WrappedBytewise"; }
+  int Compare(const Slice& a, const Slice& b) const override {
+    return BytewiseComparator()->Compare(a, b);
+  }
+  void FindShortestSeparator(std::string* start,
+                             const Slice& limit) const override {}
+  void FindShortSuccessor(std::string* key) const override {}
+};
+
+int Sign(int r) { return (r < 0) ? -1 : (r > 0) ? +1 : 0; }
+}  // namespace
+
+TEST(FormatTest, InternalKeyComparator) {
+  WrappedBytewiseComparator wrapped;
+  const InternalKeyComparator inline_cmp(BytewiseComparator());
+  const InternalKeyComparator virtual_cmp(&wrapped);
+  const std::string keys[] = {
+      IKey("", 100, kTypeValue),
+      IKey("a", 200, kTypeValue),
+      IKey("a", 100, kTypeValue),
+      IKey("a", 100, kTypeDeletion),
+      IKey("ab", kMaxSequenceNumber, kTypeValue),
+      IKey("b", 1, kTypeValue),
+      IKey("\xff", 5, kTypeValue),
+  };
+  const int n = sizeof(keys) / sizeof(keys[0]);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      const int expected = (i < j) ? -1 : (i > j) ? +1 : 0;
+      ASSERT_EQ(expected, Sign(inline_cmp.Compare(keys[i], keys[j])));
+      ASSERT_EQ(expected, Sign(virtual_cmp.Compare(keys[i], keys[j])));
+    }
+  }
+}
+
 TEST(FormatTest, ParsedInternalKeyDebugString) {
   ParsedInternalKey key("The \"key\" in 'single quotes'", 42, kTypeValue);
 
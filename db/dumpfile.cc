@@ -16,6 +16,7 @@
 #include "leveldb/options.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
+#include "leveldb/table_properties.h"
 #include "leveldb/write_batch.h"
 #include "util/logging.h"
 
@@ -189,6 +190,8 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
         r += "del";
       } else if (key.type == kTypeValue) {
         r += "val";
+      } else if (key.type == kTypeBlobIndex) {
+        r += "blob";
       } else {
         AppendNumberTo(&r, key.type);
       }
@@ -202,6 +205,10 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
   if (!s.ok()) {
     dst->Append("iterator error: " + s.ToString() + "\n");
   }
+  if (table->GetProperties() != nullptr) {
+    dst->Append("--- properties ---\n");
+    dst->Append(table->GetProperties()->ToString());
+  }
 
   delete iter;
   delete table;
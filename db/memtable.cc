@@ -4,10 +4,13 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -19,7 +22,10 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_) {}
 
 MemTable::~MemTable() { assert(refs_ == 0); }
 
@@ -73,6 +79,10 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
+Iterator* MemTable::NewRangeDelIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
   // Format of an entry is concatenation of:
@@ -96,14 +106,23 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+    // Taking range_del_mu_ also waits for a lookup that may be building
+    // the list without the new tombstone, so that it is not kept.
+    MutexLock l(&range_del_mu_);
+    fragmented_range_dels_.reset();
+  } else {
+    table_.Insert(buf);
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   SequenceNumber* seq, MergeContext* merge_context) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  for (; iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -117,22 +136,59 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
+            Slice(key_ptr, key_length - 8), key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    *seq = tag >> 8;
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue: {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        value->assign(v.data(), v.size());
+        return true;
       }
+      case kTypeDeletion:
+        *s = Status::NotFound(Slice());
+        return true;
+      case kTypeMerge:
+        // Keep looking for the value the operand applies to
+        merge_context->Add(*seq, GetLengthPrefixedSlice(key_ptr + key_length));
+        break;
+      case kTypeRangeDeletion:
+        break;  // Never stored in table_
+      case kTypeBlobIndex:
+        assert(false);  // Only written to table files
+        break;
     }
   }
   return false;
 }
 
+std::shared_ptr<const RangeTombstoneList> MemTable::FragmentedRangeDels() {
+  Table::Iterator iter(&range_del_table_);
+  iter.SeekToFirst();
+  if (!iter.Valid()) {
+    return nullptr;  // The common case: no range tombstones at all
+  }
+  MutexLock l(&range_del_mu_);
+  if (fragmented_range_dels_ == nullptr) {
+    RangeTombstoneList* list =
+        new RangeTombstoneList(comparator_.comparator.user_comparator());
+    MemTableIterator iter(&range_del_table_);
+    Status s = list->AddAll(&iter);
+    assert(s.ok());  // The memtable only holds well-formed tombstones
+    (void)s;
+    list->Finish();
+    fragmented_range_dels_.reset(list);
+  }
+  return fragmented_range_dels_;
+}
+
+SequenceNumber MemTable::MaxCoveringTombstone(const Slice& user_key,
+                                              SequenceNumber snapshot) {
+  std::shared_ptr<const RangeTombstoneList> list = FragmentedRangeDels();
+  return list == nullptr ? 0 : list->MaxCoveringSequence(user_key, snapshot);
+}
+
 }  // namespace leveldb
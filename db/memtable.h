@@ -5,17 +5,22 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <memory>
 #include <string>
 
 #include "db/dbformat.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class MergeContext;
+class RangeTombstoneList;
 
 class MemTable {
  public:
@@ -50,9 +55,16 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones in the memtable.  Keys
+  // are internal keys of range starts, values are range ends.  The same
+  // lifetime requirement as for NewIterator() applies.
+  Iterator* NewRangeDelIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // type==kTypeRangeDeletion, key and value are the start and the
+  // exclusive end of the deleted range.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
@@ -60,7 +72,23 @@ class MemTable {
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // Range tombstones are not considered; on success *seq is set to the
+  // sequence number of the entry found.  Merge operands newer than that
+  // entry are added to *merge_context.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           SequenceNumber* seq, MergeContext* merge_context);
+
+  // Return the largest sequence number no greater than "snapshot" among
+  // the range tombstones in the memtable that cover "user_key", or 0.
+  // The tombstones are fragmented once and binary searched until the next
+  // one is added.
+  SequenceNumber MaxCoveringTombstone(const Slice& user_key,
+                                      SequenceNumber snapshot);
+
+  // Return the range tombstones in the memtable, fragmented for lookups,
+  // or nullptr if there are none.  The list does not change when more
+  // tombstones are added.
+  std::shared_ptr<const RangeTombstoneList> FragmentedRangeDels();
 
  private:
   friend class MemTableIterator;
@@ -80,6 +108,14 @@ class MemTable {
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;  // Range tombstones, kept apart from table_
+
+  // The tombstones of range_del_table_ fragmented for lookups, built by
+  // the first lookup after a tombstone is added.  Readers keep using the
+  // list they got while it is replaced.
+  port::Mutex range_del_mu_;
+  std::shared_ptr<const RangeTombstoneList> fragmented_range_dels_
+      GUARDED_BY(range_del_mu_);
 };
 
 }  // namespace leveldb
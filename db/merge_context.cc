@@ -0,0 +1,42 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_context.h"
+
+#include <vector>
+
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+void MergeContext::DropOlderThan(SequenceNumber seq) {
+  size_t keep = 0;
+  while (keep < sequences_.size() && sequences_[keep] >= seq) {
+    keep++;
+  }
+  operands_.resize(keep);
+  sequences_.resize(keep);
+}
+
+Status MergeContext::Apply(const MergeOperator* merge_operator,
+                           const Slice& user_key, const Slice* existing_value,
+                           std::string* result) const {
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("merge operand found without merge operator");
+  }
+  std::vector<Slice> operands;
+  operands.reserve(operands_.size());
+  for (size_t i = operands_.size(); i > 0; i--) {
+    operands.push_back(operands_[i - 1]);
+  }
+  std::string merged;
+  if (!merge_operator->FullMerge(user_key, existing_value, operands,
+                                 &merged)) {
+    return Status::Corruption("merge operator failed for key", user_key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,66 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+#define STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+
+#include <deque>
+#include <string>
+
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// The merge operands of one user key gathered while reading its entries,
+// which are visited from the newest to the oldest.
+class MergeContext {
+ public:
+  MergeContext() = default;
+
+  MergeContext(const MergeContext&) = delete;
+  MergeContext& operator=(const MergeContext&) = delete;
+
+  // Add an operand older than all the operands added so far.
+  void Add(SequenceNumber seq, const Slice& operand) {
+    operands_.push_back(operand.ToString());
+    sequences_.push_back(seq);
+  }
+
+  // Add an operand newer than all the operands added so far.
+  void AddNewest(SequenceNumber seq, const Slice& operand) {
+    operands_.push_front(operand.ToString());
+    sequences_.push_front(seq);
+  }
+
+  void Clear() {
+    operands_.clear();
+    sequences_.clear();
+  }
+
+  bool empty() const { return operands_.empty(); }
+  size_t size() const { return operands_.size(); }
+
+  // The i-th newest operand and its sequence number.
+  const std::string& operand(size_t i) const { return operands_[i]; }
+  SequenceNumber sequence(size_t i) const { return sequences_[i]; }
+
+  // Discard the operands whose sequence number is smaller than "seq".
+  void DropOlderThan(SequenceNumber seq);
+
+  // Combine "existing_value" (nullptr if there is none) with the operands
+  // using "merge_operator", and store the result in *result.
+  Status Apply(const MergeOperator* merge_operator, const Slice& user_key,
+               const Slice* existing_value, std::string* result) const;
+
+ private:
+  std::deque<std::string> operands_;  // Newest first
+  std::deque<SequenceNumber> sequences_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
@@ -0,0 +1,131 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : user_comparator_(user_comparator), finished_(false) {}
+
+void RangeTombstoneList::Add(const Slice& start, const Slice& end,
+                             SequenceNumber seq) {
+  assert(!finished_);
+  if (user_comparator_->Compare(start, end) >= 0) {
+    return;
+  }
+  RangeTombstone t;
+  t.start = start.ToString();
+  t.end = end.ToString();
+  t.sequence = seq;
+  tombstones_.push_back(std::move(t));
+}
+
+Status RangeTombstoneList::AddAll(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  const Comparator* ucmp = user_comparator_;
+  auto less = [ucmp](const std::string& a, const std::string& b) {
+    return ucmp->Compare(a, b) < 0;
+  };
+
+  // Every start and end is a fragment boundary.
+  std::vector<std::string> bounds;
+  bounds.reserve(2 * tombstones_.size());
+  for (const RangeTombstone& t : tombstones_) {
+    bounds.push_back(t.start);
+    bounds.push_back(t.end);
+  }
+  std::sort(bounds.begin(), bounds.end(), less);
+  bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                           [ucmp](const std::string& a, const std::string& b) {
+                             return ucmp->Compare(a, b) == 0;
+                           }),
+               bounds.end());
+
+  std::vector<size_t> by_start(tombstones_.size());
+  for (size_t i = 0; i < by_start.size(); i++) {
+    by_start[i] = i;
+  }
+  std::sort(by_start.begin(), by_start.end(), [&](size_t a, size_t b) {
+    return less(tombstones_[a].start, tombstones_[b].start);
+  });
+
+  // Sweep the boundaries, keeping the tombstones covering the current one.
+  std::vector<size_t> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    const std::string& b = bounds[i];
+    while (next < by_start.size() &&
+           ucmp->Compare(tombstones_[by_start[next]].start, b) <= 0) {
+      active.push_back(by_start[next++]);
+    }
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&](size_t t) {
+                                  return ucmp->Compare(tombstones_[t].end,
+                                                       b) <= 0;
+                                }),
+                 active.end());
+    if (active.empty()) {
+      continue;
+    }
+    Fragment f;
+    f.start = b;
+    f.end = bounds[i + 1];
+    for (size_t t : active) {
+      f.sequences.push_back(tombstones_[t].sequence);
+    }
+    std::sort(f.sequences.begin(), f.sequences.end(),
+              std::greater<SequenceNumber>());
+    fragments_.push_back(std::move(f));
+  }
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  assert(finished_);
+  // Find the last fragment starting at or before "user_key".
+  const Comparator* ucmp = user_comparator_;
+  auto it = std::upper_bound(fragments_.begin(), fragments_.end(), user_key,
+                             [ucmp](const Slice& k, const Fragment& f) {
+                               return ucmp->Compare(k, f.start) < 0;
+                             });
+  if (it == fragments_.begin()) {
+    return 0;
+  }
+  --it;
+  if (ucmp->Compare(user_key, it->end) >= 0) {
+    return 0;
+  }
+  for (SequenceNumber seq : it->sequences) {
+    if (seq <= snapshot) {
+      return seq;
+    }
+  }
+  return 0;
+}
+
+}  // namespace leveldb
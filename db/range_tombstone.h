@@ -0,0 +1,79 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+// A range tombstone written at sequence number "sequence" deletes every
+// entry whose user key is in [start, end) and whose sequence number is
+// smaller.
+struct RangeTombstone {
+  std::string start;
+  std::string end;
+  SequenceNumber sequence;
+};
+
+// A collection of range tombstones.  Tombstones may overlap and may be
+// added in any order; Finish() splits them into sorted, non-overlapping
+// fragments so that a lookup is a binary search.
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  RangeTombstoneList(const RangeTombstoneList&) = delete;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  // Add a tombstone deleting [start, end) at sequence number "seq".
+  // Empty ranges are ignored.
+  // REQUIRES: Finish() has not been called.
+  void Add(const Slice& start, const Slice& end, SequenceNumber seq);
+
+  // Add every tombstone yielded by "iter", whose keys are internal keys
+  // of range starts and whose values are range ends.  Does not take
+  // ownership of "iter".
+  // REQUIRES: Finish() has not been called.
+  Status AddAll(Iterator* iter);
+
+  // Build the fragments used by the lookup methods below.
+  void Finish();
+
+  // True iff no (non-empty) tombstone has been added.
+  bool empty() const { return tombstones_.empty(); }
+
+  // The tombstones in the order they were added.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // Return the largest sequence number no greater than "snapshot" among
+  // the tombstones covering "user_key", or 0 if there is none.  An entry
+  // for "user_key" with sequence number s is deleted iff s is smaller
+  // than the result.
+  // REQUIRES: Finish() has been called.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+ private:
+  struct Fragment {
+    std::string start;
+    std::string end;
+    std::vector<SequenceNumber> sequences;  // Decreasing
+  };
+
+  const Comparator* const user_comparator_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<Fragment> fragments_;
+  bool finished_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
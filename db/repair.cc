@@ -7,11 +7,12 @@
 // (2) We scan every table to compute
 //     (a) smallest/largest for the table
 //     (b) largest sequence number in the table
+//     (c) blob files the table refers to
 // (3) We generate descriptor contents:
 //      - log number is set to zero
 //      - next-file-number is set to 1 + largest file number we found
 //      - last-sequence-number is set to largest sequence# found across
-//        all tables (see 2c)
+//        all tables (see 2b)
 //      - compaction pointers are cleared
 //      - every table file is added at level 0
 //
@@ -24,6 +25,7 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -49,7 +51,10 @@ class Repairer {
         env_(options.env),
         icmp_(options.comparator),
         ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        ipolicy_per_level_(options.filter_policy_per_level.begin(),
+                           options.filter_policy_per_level.end()),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_,
+                                 &ipolicy_per_level_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -203,8 +208,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeDelIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, nullptr, nullptr, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -259,6 +267,7 @@ class Repairer {
     bool empty = true;
     ParsedInternalKey parsed;
     t.max_sequence = 0;
+    std::set<uint64_t> blob_files;
     for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       if (!ParseInternalKey(key, &parsed)) {
@@ -268,6 +277,13 @@ class Repairer {
       }
 
       counter++;
+      if (parsed.type == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
+      BlobIndex index;
+      if (parsed.type == kTypeBlobIndex && index.DecodeFrom(iter->value())) {
+        blob_files.insert(index.file_number);
+      }
       if (empty) {
         empty = false;
         t.meta.smallest.DecodeFrom(key);
@@ -281,8 +297,34 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
-    Log(options_.info_log, "Table #%llu: %d entries %s",
-        (unsigned long long)t.meta.number, counter, status.ToString().c_str());
+    t.meta.num_entries = counter;
+    t.meta.blob_files.assign(blob_files.begin(), blob_files.end());
+
+    // Range tombstones widen the key range like in BuildTable()
+    iter = table_cache_->NewRangeDelIterator(ReadOptions(), t.meta.number,
+                                             t.meta.file_size);
+    for (iter->SeekToFirst(); status.ok() && iter->Valid(); iter->Next()) {
+      Slice key = iter->key();
+      if (!ParseInternalKey(key, &parsed) ||
+          parsed.type != kTypeRangeDeletion) {
+        status = Status::Corruption("bad range tombstone");
+        break;
+      }
+      t.meta.num_range_deletions++;
+      ExtendKeyRangeForTombstone(icmp_, key, iter->value(), &t.meta.smallest,
+                                 &t.meta.largest);
+      if (parsed.sequence > t.max_sequence) {
+        t.max_sequence = parsed.sequence;
+      }
+    }
+    if (status.ok() && !iter->status().ok()) {
+      status = iter->status();
+    }
+    delete iter;
+    Log(options_.info_log, "Table #%llu: %d entries %d range deletions %s",
+        (unsigned long long)t.meta.number, counter,
+        static_cast<int>(t.meta.num_range_deletions),
+        status.ToString().c_str());
 
     if (status.ok()) {
       tables_.push_back(t);
@@ -302,7 +344,8 @@ class Repairer {
     if (!s.ok()) {
       return;
     }
-    TableBuilder* builder = new TableBuilder(options_, file);
+    TableBuilder* builder =
+        new TableBuilder(TableOptionsForLevel(options_, 0), file);
 
     // Copy data.
     Iterator* iter = NewTableIterator(t.meta);
@@ -312,11 +355,21 @@ class Repairer {
       counter++;
     }
     delete iter;
+    if (t.meta.num_range_deletions > 0) {
+      iter = table_cache_->NewRangeDelIterator(ReadOptions(), t.meta.number,
+                                               t.meta.file_size);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        builder->AddRangeDeletion(iter->key(), iter->value());
+        counter++;
+      }
+      delete iter;
+    }
 
     ArchiveFile(src);
     if (counter == 0) {
       builder->Abandon();  // Nothing to save
     } else {
+      builder->SetNumDeletions(t.meta.num_deletions);
       s = builder->Finish();
       if (s.ok()) {
         t.meta.file_size = builder->FileSize();
@@ -368,8 +421,7 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+      edit_.AddFile(0, t.meta);
     }
 
     // std::fprintf(stderr,
@@ -429,6 +481,7 @@ class Repairer {
   Env* const env_;
   InternalKeyComparator const icmp_;
   InternalFilterPolicy const ipolicy_;
+  std::vector<InternalFilterPolicy> const ipolicy_per_level_;
   const Options options_;
   bool owns_info_log_;
   bool owns_cache_;
@@ -5,15 +5,25 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
+#include "port/thread_annotations.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+
+  // The range tombstones of the table, fragmented by the first
+  // GetRangeTombstones() call for it.
+  port::Mutex range_dels_mu;
+  bool range_dels_read GUARDED_BY(range_dels_mu) = false;
+  std::shared_ptr<const RangeTombstoneList> range_dels
+      GUARDED_BY(range_dels_mu);
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
@@ -34,9 +44,59 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
     : env_(options.env),
       dbname_(dbname),
       options_(options),
+      mmap_budget_(options.max_mmap_read_bytes >= 0 && !options.use_direct_reads
+                       ? env_->NewMmapBudget(options.max_mmap_read_bytes)
+                       : nullptr),
       cache_(NewLRUCache(entries)) {}
 
-TableCache::~TableCache() { delete cache_; }
+TableCache::~TableCache() {
+  delete cache_;
+  delete mmap_budget_;
+}
+
+static void DeleteTableAndFile(void* arg1, void* arg2) {
+  delete reinterpret_cast<Table*>(arg1);
+  delete reinterpret_cast<RandomAccessFile*>(arg2);
+}
+
+Status TableCache::OpenFile(const std::string& fname, bool direct,
+                            RandomAccessFile** file) {
+  if (direct) {
+    return env_->NewDirectRandomAccessFile(fname, file);
+  } else if (mmap_budget_ != nullptr) {
+    Status s = env_->NewMmapRandomAccessFile(fname, mmap_budget_, file);
+    if (s.ok()) {
+      // Gets read a block at a time
+      (*file)->Hint(RandomAccessFile::kRandom);
+    }
+    return s;
+  } else {
+    return env_->NewRandomAccessFile(fname, file);
+  }
+}
+
+Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                             bool direct, RandomAccessFile** file,
+                             Table** table) {
+  *file = nullptr;
+  *table = nullptr;
+  Status s = OpenFile(TableFileName(dbname_, file_number), direct, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    if (OpenFile(old_fname, direct, file).ok()) {
+      s = Status::OK();
+    }
+  }
+  if (s.ok()) {
+    s = Table::Open(options_, *file, file_size, table);
+  }
+  if (!s.ok()) {
+    assert(*table == nullptr);
+    delete *file;
+    *file = nullptr;
+  }
+  return s;
+}
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
@@ -46,23 +106,11 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
   if (*handle == nullptr) {
-    std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
+    s = OpenTable(file_number, file_size, options_.use_direct_reads, &file,
+                  &table);
     if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
-      }
-    }
-    if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
-    }
-
-    if (!s.ok()) {
-      assert(table == nullptr);
-      delete file;
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
     } else {
@@ -97,6 +145,41 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewCompactionIterator(const ReadOptions& options,
+                                            uint64_t file_number,
+                                            uint64_t file_size) {
+  if (!options_.use_direct_io_for_flush_and_compaction ||
+      options_.use_direct_reads) {
+    if (mmap_budget_ == nullptr) {
+      return NewIterator(options, file_number, file_size);
+    }
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (!s.ok()) {
+      return NewErrorIterator(s);
+    }
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    // The whole file is about to be read in order
+    tf->file->Hint(RandomAccessFile::kWillNeed);
+    Iterator* result = tf->table->NewIterator(options);
+    result->RegisterCleanup(&UnrefEntry, cache_, handle);
+    return result;
+  }
+
+  // Compaction inputs are read through once, so they are not worth a
+  // cache entry, and the cached handles keep reading through the page
+  // cache.
+  RandomAccessFile* file = nullptr;
+  Table* table = nullptr;
+  Status s = OpenTable(file_number, file_size, true, &file, &table);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Iterator* result = table->NewIterator(options);
+  result->RegisterCleanup(&DeleteTableAndFile, table, file);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
@@ -111,6 +194,75 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
   return s;
 }
 
+Status TableCache::GetProperties(uint64_t file_number, uint64_t file_size,
+                                 TableProperties* props) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (t->GetProperties() != nullptr) {
+      *props = *t->GetProperties();
+    } else {
+      s = Status::NotFound("no table properties");
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Iterator* TableCache::NewRangeDelIterator(const ReadOptions& options,
+                                          uint64_t file_number,
+                                          uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeDelIterator();
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+
+Status TableCache::GetRangeTombstones(
+    uint64_t file_number, uint64_t file_size,
+    std::shared_ptr<const RangeTombstoneList>* result) {
+  result->reset();
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  {
+    MutexLock l(&tf->range_dels_mu);
+    if (!tf->range_dels_read) {
+      const Comparator* ucmp =
+          static_cast<const InternalKeyComparator*>(options_.comparator)
+              ->user_comparator();
+      RangeTombstoneList* list = new RangeTombstoneList(ucmp);
+      Iterator* iter = tf->table->NewRangeDelIterator();
+      s = list->AddAll(iter);
+      delete iter;
+      if (s.ok()) {
+        // Errors are not cached, as in FindTable()
+        tf->range_dels_read = true;
+        if (!list->empty()) {
+          list->Finish();
+          tf->range_dels.reset(list);
+          list = nullptr;
+        }
+      }
+      delete list;
+    }
+    *result = tf->range_dels;
+  }
+  cache_->Release(handle);
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
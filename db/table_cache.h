@@ -8,19 +8,24 @@
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
 #include <cstdint>
+#include <memory>
 #include <string>
 
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
+#include "leveldb/table_properties.h"
 #include "port/port.h"
 
 namespace leveldb {
 
 class Env;
+class MmapBudget;
+class RangeTombstoneList;
 
 class TableCache {
  public:
+  // "options.comparator" must be the InternalKeyComparator of the DB.
   TableCache(const std::string& dbname, const Options& options, int entries);
 
   TableCache(const TableCache&) = delete;
@@ -38,21 +43,51 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
                         uint64_t file_size, Table** tableptr = nullptr);
 
+  // Return an iterator for reading the specified file as a compaction
+  // input.  With Options::use_direct_io_for_flush_and_compaction, unless
+  // the cached tables already use direct I/O, the file is opened with
+  // direct I/O for this iterator alone and is not added to the cache.
+  Iterator* NewCompactionIterator(const ReadOptions& options,
+                                  uint64_t file_number, uint64_t file_size);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Return an iterator over the range tombstones of the specified file
+  // (see Table::NewRangeDelIterator).
+  Iterator* NewRangeDelIterator(const ReadOptions& options,
+                                uint64_t file_number, uint64_t file_size);
+
+  // Set *result to the range tombstones of the specified file, fragmented
+  // for lookups, or to nullptr if the file has none.  The list is built
+  // by the first call for the file and shared with later calls for as
+  // long as the file stays in the cache.
+  Status GetRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            std::shared_ptr<const RangeTombstoneList>* result);
+
+  // Store in *props the statistics recorded in the specified file (see
+  // Table::GetProperties).  Returns NotFound if the file has none.
+  Status GetProperties(uint64_t file_number, uint64_t file_size,
+                       TableProperties* props);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
+  Status OpenTable(uint64_t file_number, uint64_t file_size, bool direct,
+                   RandomAccessFile** file, Table** table);
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
 
+  Status OpenFile(const std::string& fname, bool direct,
+                  RandomAccessFile** file);
+
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
+  MmapBudget* const mmap_budget_;  // nullptr unless tables are mapped
   Cache* cache_;
 };
 
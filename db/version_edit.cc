@@ -20,9 +20,100 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  // Like kNewFile, followed by a list of optional file fields
+  kNewFile2 = 10
 };
 
+// Optional fields of a kNewFile2 entry.  Each field is written as its
+// varint32 tag followed by a length-prefixed value, so that readers can
+// skip fields they do not know about; kFileFieldEnd ends the list.
+enum NewFileField {
+  kFileFieldEnd = 0,
+  kFileFieldRangeDeletions = 1,  // varint64
+  kFileFieldEntries = 2,         // varint64
+  kFileFieldDeletions = 3,       // varint64
+  kFileFieldBlobFiles = 4        // varint64 per file
+};
+
+// Only files with range tombstones or blob files are written as kNewFile2,
+// since older versions cannot read their contents correctly anyway.  The
+// entry and deletion counts ride along with those fields; for other files
+// they are read back from the table properties when the manifest is
+// recovered (see VersionSet::LoadFileCounts).
+static bool HasOptionalFileFields(const FileMetaData& f) {
+  return f.num_range_deletions > 0 || !f.blob_files.empty();
+}
+
+static void PutVarint64FileField(std::string* dst, NewFileField field,
+                                 uint64_t v) {
+  std::string value;
+  PutVarint32(dst, field);
+  PutVarint64(&value, v);
+  PutLengthPrefixedSlice(dst, value);
+}
+
+static void PutOptionalFileFields(std::string* dst, const FileMetaData& f) {
+  if (f.num_range_deletions > 0) {
+    PutVarint64FileField(dst, kFileFieldRangeDeletions, f.num_range_deletions);
+  }
+  if (f.num_entries > 0) {
+    PutVarint64FileField(dst, kFileFieldEntries, f.num_entries);
+    PutVarint64FileField(dst, kFileFieldDeletions, f.num_deletions);
+  }
+  if (!f.blob_files.empty()) {
+    std::string value;
+    for (uint64_t number : f.blob_files) {
+      PutVarint64(&value, number);
+    }
+    PutVarint32(dst, kFileFieldBlobFiles);
+    PutLengthPrefixedSlice(dst, value);
+  }
+  PutVarint32(dst, kFileFieldEnd);
+}
+
+static bool GetOptionalFileFields(Slice* input, FileMetaData* f) {
+  uint32_t field;
+  Slice value;
+  while (GetVarint32(input, &field)) {
+    if (field == kFileFieldEnd) {
+      return true;
+    }
+    if (!GetLengthPrefixedSlice(input, &value)) {
+      return false;
+    }
+    switch (field) {
+      case kFileFieldRangeDeletions:
+        if (!GetVarint64(&value, &f->num_range_deletions)) {
+          return false;
+        }
+        break;
+      case kFileFieldEntries:
+        if (!GetVarint64(&value, &f->num_entries)) {
+          return false;
+        }
+        break;
+      case kFileFieldDeletions:
+        if (!GetVarint64(&value, &f->num_deletions)) {
+          return false;
+        }
+        break;
+      case kFileFieldBlobFiles:
+        while (!value.empty()) {
+          uint64_t number;
+          if (!GetVarint64(&value, &number)) {
+            return false;
+          }
+          f->blob_files.push_back(number);
+        }
+        break;
+      default:
+        break;  // Written by a newer version; skip
+    }
+  }
+  return false;
+}
+
 void VersionEdit::Clear() {
   comparator_.clear();
   log_number_ = 0;
@@ -75,12 +166,18 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Plain files keep the original encoding so that older versions can
+    // still read the manifest.
+    const bool extended = HasOptionalFileFields(f);
+    PutVarint32(dst, extended ? kNewFile2 : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (extended) {
+      PutOptionalFileFields(dst, f);
+    }
   }
 }
 
@@ -176,6 +273,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+        f = FileMetaData();
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
@@ -186,6 +284,19 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kNewFile2:
+        f = FileMetaData();
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetOptionalFileFields(&input, &f)) {
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file2 entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +361,20 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.num_range_deletions > 0) {
+      r.append(" range-deletions=");
+      AppendNumberTo(&r, f.num_range_deletions);
+    }
+    if (f.num_entries > 0) {
+      r.append(" deletions=");
+      AppendNumberTo(&r, f.num_deletions);
+      r.append("/");
+      AppendNumberTo(&r, f.num_entries);
+    }
+    for (uint64_t number : f.blob_files) {
+      r.append(" blob=");
+      AppendNumberTo(&r, number);
+    }
   }
   r.append("\n}\n");
   return r;
@@ -38,4 +38,75 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, EncodeDecodeRangeDeletions) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 1000;
+  f.smallest = InternalKey("a", 5, kTypeRangeDeletion);
+  f.largest = InternalKey("m", kMaxSequenceNumber, kTypeRangeDeletion);
+  f.num_range_deletions = 3;
+  edit.AddFile(2, f);
+  edit.AddFile(2, 8, 2000, InternalKey("n", 6, kTypeValue),
+               InternalKey("z", 7, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos,
+            parsed.DebugString().find("range-deletions=3"));
+}
+
+TEST(VersionEditTest, EncodeDecodeDeletionCounts) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 1000;
+  f.smallest = InternalKey("a", 5, kTypeDeletion);
+  f.largest = InternalKey("m", 9, kTypeValue);
+  f.num_entries = 40;
+  f.num_deletions = 30;
+  edit.AddFile(2, f);
+  TestEncodeDecode(edit);
+
+  // The counts alone keep the original encoding, which drops them
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_EQ(std::string::npos, parsed.DebugString().find("deletions=30/40"));
+
+  // They are kept along with the fields that need the extended encoding
+  edit.Clear();
+  f.num_range_deletions = 2;
+  edit.AddFile(2, f);
+  TestEncodeDecode(edit);
+  encoded.clear();
+  edit.EncodeTo(&encoded);
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos, parsed.DebugString().find("deletions=30/40"));
+}
+
+TEST(VersionEditTest, EncodeDecodeBlobFiles) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 1000;
+  f.smallest = InternalKey("a", 5, kTypeBlobIndex);
+  f.largest = InternalKey("m", 9, kTypeValue);
+  f.blob_files.push_back(3);
+  f.blob_files.push_back(1ull << 40);
+  edit.AddFile(2, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos,
+            parsed.DebugString().find("blob=3 blob=1099511627776"));
+}
+
 }  // namespace leveldb
@@ -6,11 +6,15 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <iterator>
 
+#include "db/blob_file.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -64,6 +68,49 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
   return sum;
 }
 
+// Store the size limit of each level >= 1 of "files" in max_bytes[level]
+// and return the level that level-0 compactions should write to.
+static int ComputeMaxBytesForLevels(const Options* options,
+                                    const std::vector<FileMetaData*>* files,
+                                    double* max_bytes) {
+  if (!options->level_compaction_dynamic_level_bytes) {
+    for (int level = 1; level < config::kNumLevels; level++) {
+      max_bytes[level] = MaxBytesForLevel(options, level);
+    }
+    return 1;
+  }
+
+  int64_t largest_bytes = 0;
+  int first_non_empty = config::kNumLevels - 1;
+  for (int level = config::kNumLevels - 1; level >= 1; level--) {
+    const int64_t level_bytes = TotalFileSize(files[level]);
+    largest_bytes = std::max(largest_bytes, level_bytes);
+    if (level_bytes > 0) {
+      first_non_empty = level;
+    }
+  }
+
+  // Give the last level the size of the largest level and every level
+  // above it a tenth of the level below, stopping at the first limit
+  // that fits in the level-1 limit.  That is the base level.  Data in
+  // the levels above it is moved down.
+  const double base_bytes = MaxBytesForLevel(options, 1);
+  int base_level = config::kNumLevels - 1;
+  max_bytes[base_level] = static_cast<double>(largest_bytes);
+  while (base_level > 1 && max_bytes[base_level] > base_bytes) {
+    max_bytes[base_level - 1] = max_bytes[base_level] / 10;
+    base_level--;
+  }
+  max_bytes[base_level] = std::max(max_bytes[base_level], base_bytes);
+  for (int level = 1; level < base_level; level++) {
+    max_bytes[level] = 0;
+  }
+
+  // Level-0 data must not skip over a level that still holds data, since
+  // that data is older.
+  return std::min(base_level, first_non_empty);
+}
+
 Version::~Version() {
   assert(refs_ == 0);
 
@@ -219,6 +266,20 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
   }
 }
 
+static Iterator* GetCompactionFileIterator(void* arg,
+                                           const ReadOptions& options,
+                                           const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionIterator(options,
+                                        DecodeFixed64(file_value.data()),
+                                        DecodeFixed64(file_value.data() + 8));
+  }
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
@@ -250,6 +311,7 @@ enum SaverState {
   kNotFound,
   kFound,
   kDeleted,
+  kMerge,
   kCorrupt,
 };
 struct Saver {
@@ -257,6 +319,9 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  bool value_is_blob_index;  // *value is the BlobIndex of the value
+  SequenceNumber* seq;
+  MergeContext* merge_context;
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -266,7 +331,24 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      *s->seq = parsed_key.sequence;
+      switch (parsed_key.type) {
+        case kTypeValue:
+          s->state = kFound;
+          s->value_is_blob_index = false;
+          break;
+        case kTypeBlobIndex:
+          s->state = kFound;
+          s->value_is_blob_index = true;
+          break;
+        case kTypeMerge:
+          s->state = kMerge;
+          s->merge_context->Add(parsed_key.sequence, v);
+          return;
+        default:
+          s->state = kDeleted;
+          break;
+      }
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
       }
@@ -322,7 +404,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
 }
 
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    std::string* value, GetStats* stats, SequenceNumber* seq,
+                    MergeContext* merge_context) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -354,6 +437,10 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
                                                 &state->saver, SaveValue);
+      if (state->s.ok() && state->saver.state == kMerge) {
+        // Older entries for the key may follow the operand in this file
+        state->s = state->ReadPastMergeOperand(f);
+      }
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -361,8 +448,16 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       switch (state->saver.state) {
         case kNotFound:
           return true;  // Keep searching in other files
+        case kMerge:
+          state->saver.state = kNotFound;
+          return true;  // The value is in an older file
         case kFound:
           state->found = true;
+          if (state->saver.value_is_blob_index) {
+            const std::string index = *state->saver.value;
+            state->s = state->vset->blob_cache_->Get(*state->options, index,
+                                                     state->saver.value);
+          }
           return false;
         case kDeleted:
           return false;
@@ -377,6 +472,26 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       // "control reaches end of non-void function".
       return false;
     }
+
+    Status ReadPastMergeOperand(FileMetaData* f) {
+      Iterator* iter =
+          vset->table_cache_->NewIterator(*options, f->number, f->file_size);
+      iter->Seek(ikey);
+      if (iter->Valid()) {
+        iter->Next();  // Skip the operand already saved
+      }
+      for (; iter->Valid() && saver.state == kMerge; iter->Next()) {
+        ParsedInternalKey parsed_key;
+        if (ParseInternalKey(iter->key(), &parsed_key) &&
+            saver.ucmp->Compare(parsed_key.user_key, saver.user_key) != 0) {
+          break;
+        }
+        SaveValue(&saver, iter->key(), iter->value());
+      }
+      Status s = iter->status();
+      delete iter;
+      return s;
+    }
   };
 
   State state;
@@ -393,12 +508,103 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.value_is_blob_index = false;
+  state.saver.seq = seq;
+  state.saver.merge_context = merge_context;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+Status Version::MaxCoveringTombstone(const Slice& user_key,
+                                     SequenceNumber snapshot,
+                                     SequenceNumber* result) {
+  *result = 0;
+  if (num_range_del_files_ == 0) {
+    return Status::OK();
+  }
+
+  // Unlike point entries, a tombstone in a deeper level may be newer than
+  // an entry found above it, so every file that may cover user_key is
+  // checked.
+  struct State {
+    TableCache* table_cache;
+    const Slice* user_key;
+    SequenceNumber snapshot;
+    SequenceNumber* result;
+    Status s;
+
+    static bool Match(void* arg, int level, FileMetaData* f) {
+      State* state = reinterpret_cast<State*>(arg);
+      if (f->num_range_deletions == 0) {
+        return true;
+      }
+      std::shared_ptr<const RangeTombstoneList> list;
+      state->s = state->table_cache->GetRangeTombstones(f->number,
+                                                        f->file_size, &list);
+      if (!state->s.ok()) {
+        return false;
+      }
+      if (list != nullptr) {
+        *state->result = std::max(
+            *state->result,
+            list->MaxCoveringSequence(*state->user_key, state->snapshot));
+      }
+      return true;
+    }
+  };
+
+  State state;
+  state.table_cache = vset_->table_cache_;
+  state.user_key = &user_key;
+  state.snapshot = snapshot;
+  state.result = result;
+  InternalKey ikey(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  ForEachOverlapping(user_key, ikey.Encode(), &state, &State::Match);
+  return state.s;
+}
+
+Status Version::AddRangeTombstones(
+    std::vector<std::shared_ptr<const RangeTombstoneList>>* lists) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (FileMetaData* f : files_[level]) {
+      if (f->num_range_deletions == 0) {
+        continue;
+      }
+      std::shared_ptr<const RangeTombstoneList> list;
+      Status s = vset_->table_cache_->GetRangeTombstones(f->number,
+                                                         f->file_size, &list);
+      if (!s.ok()) {
+        return s;
+      }
+      if (list != nullptr) {
+        lists->push_back(std::move(list));
+      }
+    }
+  }
+  return Status::OK();
+}
+
+uint64_t Version::NumLiveEntries() {
+  uint64_t result = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (FileMetaData* f : files_[level]) {
+      uint64_t entries = f->num_entries;
+      uint64_t deletions = f->num_deletions;
+      TableProperties props;
+      if (entries == 0 && vset_->table_cache_
+                              ->GetProperties(f->number, f->file_size, &props)
+                              .ok()) {
+        entries = props.num_entries;
+        deletions = props.num_deletions;
+      }
+      result += entries - std::min(entries, deletions);
+    }
+  }
+  return result;
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -476,7 +682,7 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
-    while (level < config::kMaxMemCompactLevel) {
+    while (level < vset_->options_->max_mem_compaction_level) {
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
@@ -726,17 +932,24 @@ class VersionSet::Builder {
       }
       f->refs++;
       files->push_back(f);
+      if (f->num_range_deletions > 0) {
+        v->num_range_del_files_++;
+      }
+      if (!f->blob_files.empty()) {
+        v->num_blob_ref_files_++;
+      }
     }
   }
 };
 
 VersionSet::VersionSet(const std::string& dbname, const Options* options,
-                       TableCache* table_cache,
+                       TableCache* table_cache, BlobFileCache* blob_cache,
                        const InternalKeyComparator* cmp)
     : env_(options->env),
       dbname_(dbname),
       options_(options),
       table_cache_(table_cache),
+      blob_cache_(blob_cache),
       icmp_(*cmp),
       next_file_number_(2),
       manifest_file_number_(0),  // Filled by Recover()
@@ -967,6 +1180,7 @@ Status VersionSet::Recover(bool* save_manifest) {
   if (s.ok()) {
     Version* v = new Version(this);
     builder.SaveTo(v);
+    LoadFileCounts(v);
     // Install recovered version
     Finalize(v);
     AppendVersion(v);
@@ -1028,7 +1242,59 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
   }
 }
 
+namespace {
+// A sorted run for universal compaction: a level-0 file, or all the files
+// of a deeper level.
+struct SortedRun {
+  int level;
+  FileMetaData* file;  // The level-0 file; nullptr for deeper levels
+  uint64_t size;
+};
+}  // namespace
+
+// Store the sorted runs of "files", indexed by level, in *runs, newest
+// first.  Reads visit them in this order.
+static void GetSortedRuns(const std::vector<FileMetaData*>* files,
+                          std::vector<SortedRun>* runs) {
+  runs->clear();
+  std::vector<FileMetaData*> level0 = files[0];
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  for (FileMetaData* f : level0) {
+    runs->push_back(SortedRun{0, f, f->file_size});
+  }
+  for (int level = 1; level < config::kNumLevels; level++) {
+    if (!files[level].empty()) {
+      runs->push_back(SortedRun{
+          level, nullptr, static_cast<uint64_t>(TotalFileSize(files[level]))});
+    }
+  }
+}
+
 void VersionSet::Finalize(Version* v) {
+  if (options_->compaction_style == kUniversalCompaction) {
+    // Bound the number of sorted runs, which are all searched on reads
+    std::vector<SortedRun> runs;
+    GetSortedRuns(v->files_, &runs);
+    v->compaction_level_ = 0;
+    v->compaction_score_ =
+        runs.size() /
+        static_cast<double>(options_->universal_compaction_trigger);
+
+    // Once compactions are due, every run but the oldest one will have to
+    // be merged into it.
+    v->pending_compaction_bytes_ = 0;
+    if (runs.size() >=
+        static_cast<size_t>(options_->universal_compaction_trigger)) {
+      for (size_t i = 0; i + 1 < runs.size(); i++) {
+        v->pending_compaction_bytes_ += runs[i].size;
+      }
+    }
+    return;
+  }
+
+  double max_bytes[config::kNumLevels];
+  v->base_level_ = ComputeMaxBytesForLevels(options_, v->files_, max_bytes);
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
@@ -1048,12 +1314,13 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-              static_cast<double>(config::kL0_CompactionTrigger);
+              static_cast<double>(
+                  options_->level0_file_num_compaction_trigger);
     } else {
-      // Compute the ratio of current size to size limit.
+      // Compute the ratio of current size to size limit.  A limit of zero
+      // marks a level that should be empty.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+      score = static_cast<double>(level_bytes) / std::max(max_bytes[level], 1.0);
     }
 
     if (score > best_score) {
@@ -1064,6 +1331,77 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate the bytes compactions must rewrite to bring every level back
+  // within its limit.  Level-0 is merged into the base level once it
+  // reaches its trigger, and the excess of every deeper level is merged
+  // into the level below, together with the overlapping part of that
+  // level, which is assumed to be in proportion to their sizes.
+  v->pending_compaction_bytes_ = 0;
+  uint64_t incoming_bytes = 0;
+  if (v->files_[0].size() >= static_cast<size_t>(
+                                 options_->level0_file_num_compaction_trigger)) {
+    incoming_bytes = TotalFileSize(v->files_[0]);
+    v->pending_compaction_bytes_ +=
+        incoming_bytes + TotalFileSize(v->files_[v->base_level_]);
+  }
+  for (int level = v->base_level_; level < config::kNumLevels - 1; level++) {
+    const uint64_t level_bytes =
+        TotalFileSize(v->files_[level]) + incoming_bytes;
+    incoming_bytes = 0;
+    if (level_bytes > max_bytes[level]) {
+      const uint64_t excess_bytes =
+          level_bytes - static_cast<uint64_t>(max_bytes[level]);
+      const double next_level_ratio =
+          static_cast<double>(TotalFileSize(v->files_[level + 1])) /
+          level_bytes;
+      v->pending_compaction_bytes_ += static_cast<uint64_t>(
+          excess_bytes * (next_level_ratio + 1));
+      incoming_bytes = excess_bytes;
+    }
+  }
+
+  // Find the file with the largest share of deletions, if that share
+  // reaches options_->deletion_compaction_percent.  Files in the last
+  // level have nowhere to go.
+  v->deletion_file_to_compact_ = nullptr;
+  v->deletion_file_to_compact_level_ = -1;
+  if (options_->deletion_compaction_percent > 0) {
+    uint64_t best_deleted = 0;
+    uint64_t best_total = 0;
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        const uint64_t deleted = f->num_deletions + f->num_range_deletions;
+        const uint64_t total = f->num_entries + f->num_range_deletions;
+        if (total == 0 ||
+            deleted * 100 <
+                total * options_->deletion_compaction_percent ||
+            (best_total > 0 && deleted * best_total <= best_deleted * total)) {
+          continue;
+        }
+        v->deletion_file_to_compact_ = f;
+        v->deletion_file_to_compact_level_ = level;
+        best_deleted = deleted;
+        best_total = total;
+      }
+    }
+  }
+}
+
+void VersionSet::LoadFileCounts(Version* v) {
+  if (options_->deletion_compaction_percent == 0) {
+    return;  // Only used to pick deletion compactions
+  }
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (FileMetaData* f : v->files_[level]) {
+      TableProperties props;
+      if (f->num_entries == 0 &&
+          table_cache_->GetProperties(f->number, f->file_size, &props).ok()) {
+        f->num_entries = props.num_entries;
+        f->num_deletions = props.num_deletions;
+      }
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1087,7 +1425,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
@@ -1153,11 +1491,32 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
       const std::vector<FileMetaData*>& files = v->files_[level];
       for (size_t i = 0; i < files.size(); i++) {
         live->insert(files[i]->number);
+        live->insert(files[i]->blob_files.begin(),
+                     files[i]->blob_files.end());
       }
     }
   }
 }
 
+uint64_t VersionSet::BlobGarbageCollectionCutoff(double age_cutoff) const {
+  std::set<uint64_t> blob_files;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const FileMetaData* f : current_->files_[level]) {
+      blob_files.insert(f->blob_files.begin(), f->blob_files.end());
+    }
+  }
+  const size_t n = static_cast<size_t>(blob_files.size() * age_cutoff);
+  if (n == 0) {
+    return 0;
+  }
+  if (n >= blob_files.size()) {
+    return *blob_files.rbegin() + 1;
+  }
+  auto iter = blob_files.begin();
+  std::advance(iter, n);
+  return *iter;
+}
+
 int64_t VersionSet::NumLevelBytes(int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
@@ -1224,22 +1583,23 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  const int space = (c->level() == 0 ? c->inputs_[0].size() : 1) +
+                    c->num_input_levels() - 1;
   Iterator** list = new Iterator*[space];
   int num = 0;
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < c->num_input_levels(); which++) {
     if (!c->inputs_[which].empty()) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionIterator(
+              options, files[i]->number, files[i]->file_size);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            &GetCompactionFileIterator, table_cache_, options);
       }
     }
   }
@@ -1249,37 +1609,96 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+// Return the file of "files" whose key range covers the fewest bytes of
+// "next_files" relative to its own size.  Both vectors hold the sorted,
+// disjoint files of a level.
+static FileMetaData* MinOverlappingRatioFile(
+    const Comparator* ucmp, const std::vector<FileMetaData*>& files,
+    const std::vector<FileMetaData*>& next_files) {
+  FileMetaData* best = nullptr;
+  uint64_t best_ratio = 0;
+  size_t first = 0;  // First file of next_files not entirely before f
+  for (FileMetaData* f : files) {
+    while (first < next_files.size() &&
+           ucmp->Compare(next_files[first]->largest.user_key(),
+                         f->smallest.user_key()) < 0) {
+      first++;
+    }
+    uint64_t overlapping_bytes = 0;
+    for (size_t i = first; i < next_files.size() &&
+                           ucmp->Compare(next_files[i]->smallest.user_key(),
+                                         f->largest.user_key()) <= 0;
+         i++) {
+      overlapping_bytes += next_files[i]->file_size;
+    }
+    const uint64_t ratio =
+        overlapping_bytes * 1024 / std::max<uint64_t>(f->file_size, 1);
+    if (best == nullptr || ratio < best_ratio) {
+      best = f;
+      best_ratio = ratio;
+    }
+  }
+  return best;
+}
+
+// Return the file of "files" that was created first.
+static FileMetaData* OldestFile(const std::vector<FileMetaData*>& files) {
+  FileMetaData* oldest = nullptr;
+  for (FileMetaData* f : files) {
+    if (oldest == nullptr || f->number < oldest->number) {
+      oldest = f;
+    }
+  }
+  return oldest;
+}
+
 Compaction* VersionSet::PickCompaction() {
   Compaction* c;
   int level;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
+  // the compactions triggered by seeks, and both over those triggered by
+  // deletions.
   const bool size_compaction = (current_->compaction_score_ >= 1);
   const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
+  if (options_->compaction_style == kUniversalCompaction) {
+    return size_compaction ? PickUniversalCompaction() : nullptr;
+  } else if (size_compaction) {
     level = current_->compaction_level_;
     assert(level >= 0);
     assert(level + 1 < config::kNumLevels);
     c = new Compaction(options_, level);
 
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+    if (level > 0 && options_->compaction_priority == kMinOverlappingRatio) {
+      c->inputs_[0].push_back(MinOverlappingRatioFile(
+          icmp_.user_comparator(), current_->files_[level],
+          current_->files_[level + 1]));
+    } else if (level > 0 && options_->compaction_priority == kOldestFileFirst) {
+      c->inputs_[0].push_back(OldestFile(current_->files_[level]));
+    } else {
+      // Pick the first file that comes after compact_pointer_[level]
+      for (size_t i = 0; i < current_->files_[level].size(); i++) {
+        FileMetaData* f = current_->files_[level][i];
+        if (compact_pointer_[level].empty() ||
+            icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
+          c->inputs_[0].push_back(f);
+          break;
+        }
+      }
+      if (c->inputs_[0].empty()) {
+        // Wrap-around to the beginning of the key space
+        c->inputs_[0].push_back(current_->files_[level][0]);
       }
-    }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
     }
   } else if (seek_compaction) {
     level = current_->file_to_compact_level_;
     c = new Compaction(options_, level);
     c->inputs_[0].push_back(current_->file_to_compact_);
+  } else if (current_->deletion_file_to_compact_ != nullptr) {
+    level = current_->deletion_file_to_compact_level_;
+    c = new Compaction(options_, level);
+    c->inputs_[0].push_back(current_->deletion_file_to_compact_);
+    c->deletion_compaction_ = true;
   } else {
     return nullptr;
   }
@@ -1329,6 +1748,14 @@ FileMetaData* FindSmallestBoundaryFile(
     const InternalKey& largest_key) {
   const Comparator* user_cmp = icmp.user_comparator();
   FileMetaData* smallest_boundary_file = nullptr;
+  ParsedInternalKey parsed_largest;
+  if (ParseInternalKey(largest_key.Encode(), &parsed_largest) &&
+      parsed_largest.type == kTypeRangeDeletion &&
+      parsed_largest.sequence == kMaxSequenceNumber) {
+    // The file ends with the exclusive end of a range tombstone, so it
+    // holds nothing for user_key(u1) (see ExtendKeyRangeForTombstone).
+    return nullptr;
+  }
   for (size_t i = 0; i < level_files.size(); ++i) {
     FileMetaData* f = level_files[i];
     if (icmp.Compare(f->smallest, largest_key) > 0 &&
@@ -1386,25 +1813,32 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
 
+  // Level-0 compactions write to the base level, skipping the empty
+  // levels above it.
+  if (level == 0) {
+    c->inputs_.resize(current_->base_level_ + 1);
+  }
+  const int output_level = c->output_level();
+  std::vector<FileMetaData*>* parents = &c->inputs_[output_level - level];
+
   AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
   GetRange(c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level + 1, &smallest, &largest,
-                                 &c->inputs_[1]);
-  AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
+  current_->GetOverlappingInputs(output_level, &smallest, &largest, parents);
+  AddBoundaryInputs(icmp_, current_->files_[output_level], parents);
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
-  GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+  GetRange2(c->inputs_[0], *parents, &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
-  // changing the number of "level+1" files we pick up.
-  if (!c->inputs_[1].empty()) {
+  // changing the number of "output_level" files we pick up.
+  if (!parents->empty()) {
     std::vector<FileMetaData*> expanded0;
     current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
     AddBoundaryInputs(icmp_, current_->files_[level], &expanded0);
     const int64_t inputs0_size = TotalFileSize(c->inputs_[0]);
-    const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
+    const int64_t inputs1_size = TotalFileSize(*parents);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
@@ -1412,28 +1846,28 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
+      current_->GetOverlappingInputs(output_level, &new_start, &new_limit,
                                      &expanded1);
-      AddBoundaryInputs(icmp_, current_->files_[level + 1], &expanded1);
-      if (expanded1.size() == c->inputs_[1].size()) {
+      AddBoundaryInputs(icmp_, current_->files_[output_level], &expanded1);
+      if (expanded1.size() == parents->size()) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
-            level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
+            level, int(c->inputs_[0].size()), int(parents->size()),
             long(inputs0_size), long(inputs1_size), int(expanded0.size()),
             int(expanded1.size()), long(expanded0_size), long(inputs1_size));
         smallest = new_start;
         largest = new_limit;
         c->inputs_[0] = expanded0;
-        c->inputs_[1] = expanded1;
-        GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+        *parents = expanded1;
+        GetRange2(c->inputs_[0], *parents, &all_start, &all_limit);
       }
     }
   }
 
   // Compute the set of grandparent files that overlap this compaction
-  // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+  // (parent == output_level; grandparent == output_level+1)
+  if (output_level + 1 < config::kNumLevels) {
+    current_->GetOverlappingInputs(output_level + 1, &all_start, &all_limit,
                                    &c->grandparents_);
   }
 
@@ -1445,6 +1879,104 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   c->edit_.SetCompactPointer(level, largest);
 }
 
+Compaction* VersionSet::PickUniversalCompaction() {
+  std::vector<SortedRun> runs;
+  GetSortedRuns(current_->files_, &runs);
+  if (runs.size() < 2) {
+    return nullptr;
+  }
+
+  // Merge runs [start, end).  If the runs newer than the oldest one have
+  // grown too large compared to it, merge everything to reclaim the space
+  // held by their obsolete entries.
+  size_t start = 0;
+  size_t end = 0;
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < runs.size(); i++) {
+    newer_bytes += runs[i].size;
+  }
+  if (newer_bytes * 100 >
+      runs.back().size *
+          static_cast<uint64_t>(
+              options_->universal_max_size_amplification_percent)) {
+    end = runs.size();
+  }
+
+  // Otherwise merge the newest group of runs of similar sizes
+  for (size_t i = 0; end == 0 && i + 1 < runs.size(); i++) {
+    uint64_t group_bytes = runs[i].size;
+    size_t j = i + 1;
+    while (j < runs.size() &&
+           runs[j].size * 100 <=
+               group_bytes * (100 + options_->universal_size_ratio)) {
+      group_bytes += runs[j].size;
+      j++;
+    }
+    if (j - i >= 2) {
+      start = i;
+      end = j;
+    }
+  }
+
+  // Otherwise merge the newest runs, bringing their number back below the
+  // compaction trigger
+  if (end == 0) {
+    // A score >= 1 means there are at least that many runs
+    const size_t trigger = options_->universal_compaction_trigger;
+    assert(runs.size() >= trigger);
+    start = 0;
+    end = std::max<size_t>(2, runs.size() + 2 - trigger);
+  }
+
+  // The output goes to a level below the remaining level-0 files, so they
+  // must all be newer than the merged runs.
+  while (end < runs.size() && runs[end - 1].level == 0 &&
+         runs[end].level == 0) {
+    end++;
+  }
+
+  // Place the output above the runs older than it
+  int output_level;
+  if (runs[end - 1].level > 0) {
+    output_level = runs[end - 1].level;
+  } else if (end == runs.size()) {
+    output_level = config::kNumLevels - 1;
+  } else if (runs[end].level > 1) {
+    output_level = runs[end].level - 1;
+  } else {
+    // No free level in between: merge the level-1 run as well, along with
+    // the following runs that are not larger than the merged data, so that
+    // the next merges have free levels to go to.
+    uint64_t group_bytes = 0;
+    for (size_t i = start; i <= end; i++) {
+      group_bytes += runs[i].size;
+    }
+    end++;
+    while (end < runs.size() &&
+           runs[end].size * 100 <=
+               group_bytes * (100 + options_->universal_size_ratio)) {
+      group_bytes += runs[end].size;
+      end++;
+    }
+    output_level = runs[end - 1].level;
+  }
+
+  const int level = runs[start].level;
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_.resize(output_level - level + 1);
+  c->max_output_file_size_ = MaxFileSizeForLevel(options_, output_level);
+  for (size_t i = start; i < end; i++) {
+    if (runs[i].level == 0) {
+      c->inputs_[0].push_back(runs[i].file);
+    } else {
+      c->inputs_[runs[i].level - level] = current_->files_[runs[i].level];
+    }
+  }
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  return c;
+}
+
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
                                      const InternalKey* end) {
   std::vector<FileMetaData*> inputs;
@@ -1480,8 +2012,11 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      deletion_compaction_(false),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
+      max_grandparent_overlap_bytes_(MaxGrandParentOverlapBytes(options)),
       input_version_(nullptr),
+      inputs_(2),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
@@ -1497,17 +2032,23 @@ Compaction::~Compaction() {
 }
 
 bool Compaction::IsTrivialMove() const {
-  const VersionSet* vset = input_version_->vset_;
+  if (deletion_compaction_) {
+    return false;
+  }
+  for (int which = 1; which < num_input_levels(); which++) {
+    if (num_input_files(which) != 0) {
+      return false;
+    }
+  }
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
-          TotalFileSize(grandparents_) <=
-              MaxGrandParentOverlapBytes(vset->options_));
+  return (num_input_files(0) == 1 &&
+          TotalFileSize(grandparents_) <= max_grandparent_overlap_bytes_);
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < num_input_levels(); which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
       edit->RemoveFile(level_ + which, inputs_[which][i]->number);
     }
@@ -1517,7 +2058,7 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level() + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     while (level_ptrs_[lvl] < files.size()) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -1535,6 +2076,33 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = output_level() + 1; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Compaction::IsBottommostLevel() {
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  Slice smallest, largest;
+  bool found = false;
+  for (int which = 0; which < num_input_levels(); which++) {
+    for (FileMetaData* f : inputs_[which]) {
+      if (!found || user_cmp->Compare(f->smallest.user_key(), smallest) < 0) {
+        smallest = f->smallest.user_key();
+      }
+      if (!found || user_cmp->Compare(f->largest.user_key(), largest) > 0) {
+        largest = f->largest.user_key();
+      }
+      found = true;
+    }
+  }
+  return !found || IsBaseLevelForRange(smallest, largest);
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
@@ -1550,7 +2118,7 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   }
   seen_key_ = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (overlapped_bytes_ > max_grandparent_overlap_bytes_) {
     // Too much overlap for current output; start new output
     overlapped_bytes_ = 0;
     return true;
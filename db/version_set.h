@@ -16,6 +16,7 @@
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -30,9 +31,12 @@ namespace log {
 class Writer;
 }
 
+class BlobFileCache;
 class Compaction;
 class Iterator;
 class MemTable;
+class MergeContext;
+class RangeTombstoneList;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -70,10 +74,39 @@ class Version {
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
   // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // return OK.  Else return a non-OK status.  Fills *stats.  Range
+  // tombstones are not considered; if an entry for key is found, its
+  // sequence number is stored in *seq.  Merge operands newer than that
+  // entry are added to *merge_context.
   // REQUIRES: lock is not held
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, SequenceNumber* seq,
+             MergeContext* merge_context);
+
+  // Return the largest sequence number no greater than "snapshot" among
+  // the range tombstones of this Version that cover "user_key", or 0.
+  // Only the files whose key range holds "user_key" are consulted.
+  // REQUIRES: lock is not held
+  Status MaxCoveringTombstone(const Slice& user_key, SequenceNumber snapshot,
+                              SequenceNumber* result);
+
+  // Append the fragmented range tombstones of every file in this Version
+  // that has any to *lists.  The lists are cached by the table cache.
+  // REQUIRES: lock is not held
+  Status AddRangeTombstones(
+      std::vector<std::shared_ptr<const RangeTombstoneList>>* lists);
+
+  // Return the number of entries of the files of this Version that are
+  // not deletion markers.  Counts missing from the manifest are read from
+  // the table properties.
+  // REQUIRES: lock is not held
+  uint64_t NumLiveEntries();
+
+  // True iff some file in this Version holds range tombstones.
+  bool HasRangeDeletions() const { return num_range_del_files_ > 0; }
+
+  // True iff some file in this Version refers to values in blob files.
+  bool HasBlobFiles() const { return num_blob_ref_files_ > 0; }
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -127,8 +160,14 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
+        deletion_file_to_compact_(nullptr),
+        deletion_file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        base_level_(1),
+        pending_compaction_bytes_(0),
+        num_range_del_files_(0),
+        num_blob_ref_files_(0) {}
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -157,17 +196,38 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
+  // File whose share of deletions calls for a compaction, or nullptr.
+  // Initialized by Finalize().
+  FileMetaData* deletion_file_to_compact_;
+  int deletion_file_to_compact_level_;
+
   // Level that should be compacted next and its compaction score.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Level that level-0 compactions write to.  Always 1 unless
+  // options.level_compaction_dynamic_level_bytes is set.  Initialized by
+  // Finalize().
+  int base_level_;
+
+  // Estimated bytes that compactions must rewrite before no level exceeds
+  // its limit.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
+
+  // Number of files with num_range_deletions > 0.
+  int num_range_del_files_;
+
+  // Number of files with a non-empty blob_files list.
+  int num_blob_ref_files_;
 };
 
 class VersionSet {
  public:
   VersionSet(const std::string& dbname, const Options* options,
-             TableCache* table_cache, const InternalKeyComparator*);
+             TableCache* table_cache, BlobFileCache* blob_cache,
+             const InternalKeyComparator*);
   VersionSet(const VersionSet&) = delete;
   VersionSet& operator=(const VersionSet&) = delete;
 
@@ -208,6 +268,12 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return the estimated number of bytes that compactions must rewrite
+  // before no level of the current version exceeds its size limit.
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -248,16 +314,30 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Recompute the compaction score of the current version after the
+  // options it depends on have changed.
+  void UpdateCompactionScore() { Finalize(current_); }
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+    return (v->compaction_score_ >= 1) ||
+           (v->file_to_compact_ != nullptr &&
+            options_->compaction_style == kLevelCompaction) ||
+           (v->deletion_file_to_compact_ != nullptr);
   }
 
-  // Add all files listed in any live version to *live.
+  // Add all files listed in any live version, including the blob files
+  // their tables refer to, to *live.
   // May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
+  // Return the number of the oldest blob file referred to by the current
+  // version that is not among the oldest "age_cutoff" fraction of them,
+  // or 0 if there are none such.  Compactions copy the values of the
+  // older files.
+  uint64_t BlobGarbageCollectionCutoff(double age_cutoff) const;
+
   // Return the approximate offset in the database of the data for
   // "key" as of version "v".
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
@@ -279,6 +359,10 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Fill in the entry and deletion counts that the manifest does not
+  // record for the files of "v", from their table properties.
+  void LoadFileCounts(Version* v);
+
   void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
                 InternalKey* largest);
 
@@ -288,6 +372,8 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  Compaction* PickUniversalCompaction();
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -297,6 +383,7 @@ class VersionSet {
   const std::string dbname_;
   const Options* const options_;
   TableCache* const table_cache_;
+  BlobFileCache* const blob_cache_;
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
@@ -321,17 +408,30 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // through "output_level" will be merged to produce a set of
+  // "output_level" files.
   int level() const { return level_; }
 
+  // Return the level the compaction writes to.  This is "level+1" except
+  // for universal compactions, which may merge sorted runs of several
+  // levels, and for level-0 compactions with dynamic level sizes, which
+  // write to the base level.  Levels in between hold no input files.
+  int output_level() const {
+    return level_ + static_cast<int>(inputs_.size()) - 1;
+  }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
 
-  // "which" must be either 0 or 1
+  // Return the number of levels read by this compaction, which is
+  // output_level() - level() + 1.
+  int num_input_levels() const { return inputs_.size(); }
+
+  // "which" must be in [0, num_input_levels())
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()+which".
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
@@ -341,14 +441,28 @@ class Compaction {
   // moving a single input file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
+  // True if the compaction was picked for the deletion markers of its
+  // input (see Options::deletion_compaction_percent).  Such a compaction
+  // is never a trivial move, which would keep the markers.
+  bool is_deletion_compaction() const { return deletion_compaction_; }
+
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Returns true if no data exists in levels greater than "output_level"
+  // for user keys in [begin, end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
+  // Returns true if no data exists in levels greater than "output_level"
+  // for the key range of the inputs, so that the compaction produces the
+  // bottommost data of all its keys.
+  bool IsBottommostLevel();
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -364,12 +478,15 @@ class Compaction {
   Compaction(const Options* options, int level);
 
   int level_;
+  bool deletion_compaction_;
   uint64_t max_output_file_size_;
+  int64_t max_grandparent_overlap_bytes_;
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
-  std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
+  // Each compaction reads inputs_[i] from "level_+i".  There are two sets
+  // of inputs ("level_" and "level_+1") except for universal compactions.
+  std::vector<std::vector<FileMetaData*>> inputs_;
 
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
@@ -384,7 +501,7 @@ class Compaction {
   // level_ptrs_ holds indices into input_version_->levels_: our state
   // is that we are positioned at one of the file ranges for each
   // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
+  // all L > output_level()).
   size_t level_ptrs_[config::kNumLevels];
 };
 
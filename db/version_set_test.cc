@@ -5,6 +5,10 @@
 #include "db/version_set.h"
 
 #include "gtest/gtest.h"
+#include "db/blob_file.h"
+#include "db/table_cache.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
 #include "util/logging.h"
 #include "util/testutil.h"
 
@@ -328,4 +332,99 @@ TEST_F(AddBoundaryInputsTest, TestDisjoinFilePointers) {
   ASSERT_EQ(f3, compaction_files_[2]);
 }
 
+class PickCompactionTest : public testing::Test {
+ public:
+  PickCompactionTest()
+      : dbname_(testing::TempDir() + "pick_compaction_test"),
+        icmp_(BytewiseComparator()) {
+    options_.env = Env::Default();
+  }
+
+  ~PickCompactionTest() { DestroyDB(dbname_, options_); }
+
+  // Return the number of the level-1 file that a compaction picks with
+  // "priority", when level 1 is over its size limit and holds:
+  //   #7 ["c","d"], the oldest, over 12MB of level 2 (ratio 3)
+  //   #8 ["a","b"], over 8MB of level 2 (ratio 2)
+  //   #9 ["e","f"], over 1MB of level 2 (ratio 0.25)
+  // If "compact_pointer" is not null, the last level-1 compaction ended
+  // at that user key.
+  uint64_t PickedFile(CompactionPriority priority,
+                      const char* compact_pointer) {
+    // Start from the manifest of an empty DB
+    DestroyDB(dbname_, options_);
+    Options options = options_;
+    options.create_if_missing = true;
+    DB* db;
+    EXPECT_LEVELDB_OK(DB::Open(options, dbname_, &db));
+    delete db;
+
+    options.compaction_priority = priority;
+    TableCache table_cache(dbname_, options, 10);
+    BlobFileCache blob_cache(dbname_, options, 10);
+    VersionSet versions(dbname_, &options, &table_cache, &blob_cache, &icmp_);
+    bool save_manifest;
+    EXPECT_LEVELDB_OK(versions.Recover(&save_manifest));
+
+    VersionEdit edit;
+    AddFile(&edit, 1, 7, 4, "c", "d");
+    AddFile(&edit, 1, 8, 4, "a", "b");
+    AddFile(&edit, 1, 9, 4, "e", "f");
+    AddFile(&edit, 2, 20, 8, "a", "b");
+    AddFile(&edit, 2, 21, 12, "c", "d");
+    AddFile(&edit, 2, 22, 1, "e", "f");
+    if (compact_pointer != nullptr) {
+      edit.SetCompactPointer(1, InternalKey(compact_pointer, 100, kTypeValue));
+    }
+    port::Mutex mu;
+    mu.Lock();
+    EXPECT_LEVELDB_OK(versions.LogAndApply(&edit, &mu));
+    mu.Unlock();
+
+    Compaction* c = versions.PickCompaction();
+    EXPECT_TRUE(c != nullptr);
+    if (c == nullptr) {
+      return 0;
+    }
+    EXPECT_EQ(1, c->level());
+    EXPECT_EQ(1, c->num_input_files(0));
+    EXPECT_EQ(1, c->num_input_files(1));
+    const uint64_t number = c->input(0, 0)->number;
+    c->ReleaseInputs();
+    delete c;
+    return number;
+  }
+
+ private:
+  static void AddFile(VersionEdit* edit, int level, uint64_t number,
+                      uint64_t megabytes, const char* smallest,
+                      const char* largest) {
+    edit->AddFile(level, number, megabytes << 20,
+                  InternalKey(smallest, 100, kTypeValue),
+                  InternalKey(largest, 100, kTypeValue));
+  }
+
+  const std::string dbname_;
+  const InternalKeyComparator icmp_;
+  Options options_;
+};
+
+TEST_F(PickCompactionTest, RoundRobin) {
+  // Starts at the beginning of the level, then after the last compaction
+  ASSERT_EQ(8, PickedFile(kRoundRobin, nullptr));
+  ASSERT_EQ(7, PickedFile(kRoundRobin, "b"));
+  ASSERT_EQ(9, PickedFile(kRoundRobin, "d"));
+  ASSERT_EQ(8, PickedFile(kRoundRobin, "f"));  // Wraps around
+}
+
+TEST_F(PickCompactionTest, MinOverlappingRatio) {
+  ASSERT_EQ(9, PickedFile(kMinOverlappingRatio, nullptr));
+  ASSERT_EQ(9, PickedFile(kMinOverlappingRatio, "b"));
+}
+
+TEST_F(PickCompactionTest, OldestFileFirst) {
+  ASSERT_EQ(7, PickedFile(kOldestFileFirst, nullptr));
+  ASSERT_EQ(7, PickedFile(kOldestFileFirst, "d"));
+}
+
 }  // namespace leveldb
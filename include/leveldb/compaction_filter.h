@@ -0,0 +1,60 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a CompactionFilter that is shown every
+// value rewritten by a compaction.  The filter can drop the entry or
+// replace its value, which lets applications expire or garbage collect
+// data as a side effect of compactions instead of scanning the database
+// and issuing deletes.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // The name of the compaction filter.  Used for logging.
+  virtual const char* Name() const = 0;
+
+  // Called for the value of "key" when a compaction rewrites it.  "level"
+  // is the compaction's first input level; its output goes to the same or
+  // a deeper level.  Only the latest value of a key is passed, and
+  // only if it was written after every live snapshot was taken, so the
+  // filter never changes what a snapshot reads.  Return true to delete
+  // the key.  Otherwise, to replace the value, store the new value in
+  // *new_value and set *value_changed to true.
+  //
+  // Filter() is called from the background compaction thread and must be
+  // thread-safe.
+  virtual bool Filter(int level, const Slice& key, const Slice& value,
+                      std::string* new_value, bool* value_changed) const = 0;
+};
+
+// Return a new filter that deletes expired values.  The last 8 bytes of a
+// value hold the time it was written, in seconds since the epoch, encoded
+// as a little-endian fixed64 (see PutFixed64() in util/coding.h).  Values
+// written more than "ttl_seconds" ago are dropped by the next compaction
+// that rewrites them; reads may return them until then.  Values shorter
+// than 8 bytes never expire.  The current time is read from "env", which
+// should be the Options::env of the databases using the filter.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const CompactionFilter* NewTTLCompactionFilter(
+    uint64_t ttl_seconds, Env* env);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
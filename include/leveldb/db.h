@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <map>
+#include <string>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -72,6 +74,21 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in the range
+  // ["begin", "end").  Returns OK on success, and a non-OK status on
+  // error.  The range is hidden from readers right away; the space it
+  // occupies is reclaimed by later compactions.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end);
+
+  // Record "operand" as an update of the value of "key", to be combined
+  // with it by options.merge_operator when "key" is read.  Returns OK on
+  // success, and a non-OK status on error.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& operand);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -121,6 +138,30 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.iterator-skipped-entries" - returns the number of hidden
+  //     internal entries DB iterators have stepped over so far.
+  //  "leveldb.iterator-reseeks" - returns the number of times a DB iterator
+  //     replaced those steps by a seek to the next user key (see
+  //     Options::max_sequential_skip_in_iterations).
+  //  "leveldb.write-amplification" - returns the number of bytes written
+  //     to tables by flushes and compactions per byte of user data
+  //     written since the DB was opened.
+  //  "leveldb.write-stalls" - returns a multi-line string with the number
+  //     of writes that were delayed or stopped and the time they waited,
+  //     by cause, since the DB was opened.
+  //  "leveldb.delayed-write-rate" - returns the rate in bytes per second
+  //     that writes are currently throttled to, or 0 if they are not.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+  //     number of bytes compactions must rewrite before every level is
+  //     within its size limit.
+  //  "leveldb.estimate-num-keys" - returns the number of entries of the
+  //     table files that are not deletion markers, an estimate of the
+  //     number of keys that ignores overwrites and recent writes.
+  //  "leveldb.compaction-bytes-read" - returns the number of bytes of table
+  //     files read by compactions since the DB was opened.
+  //  "leveldb.compaction-bytes-written" - returns the number of bytes of
+  //     table files written by flushes and compactions since the DB was
+  //     opened.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -145,6 +186,20 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Change options of the open database.  "new_options" maps option
+  // names to decimal values, e.g. {{"level0_stop_writes_trigger", "20"}}.
+  // The options that can be changed are write_buffer_size,
+  // max_file_size, level0_file_num_compaction_trigger,
+  // level0_slowdown_writes_trigger, level0_stop_writes_trigger,
+  // max_mem_compaction_level, delayed_write_rate,
+  // soft_pending_compaction_bytes_limit and
+  // hard_pending_compaction_bytes_limit.  Values are adjusted into range like the
+  // Options passed to DB::Open().  If some name or value is invalid,
+  // returns a non-OK status and changes nothing.  The new values last
+  // until the database is closed.
+  virtual Status SetOptions(
+      const std::map<std::string, std::string>& new_options);
 };
 
 // Destroy the contents of the specified database.
@@ -43,6 +43,7 @@ namespace leveldb {
 
 class FileLock;
 class Logger;
+class MmapBudget;
 class RandomAccessFile;
 class SequentialFile;
 class Slice;
@@ -110,6 +111,44 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile(), but reads bypass the operating system's
+  // page cache where the Env supports direct I/O, so that reading the
+  // file does not evict other data from it.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), but writes bypass the operating system's page
+  // cache where the Env supports direct I/O.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
+  // Return a budget of "capacity" bytes for NewMmapRandomAccessFile(), or
+  // nullptr if the Env does not read files through memory mappings.  The
+  // caller must delete the result after the files opened with it.
+  //
+  // The default implementation returns nullptr.
+  virtual MmapBudget* NewMmapBudget(uint64_t capacity);
+
+  // Like NewRandomAccessFile(), but reads go through a memory mapping of
+  // the file, without a system call, whenever the mapping fits in
+  // "budget".  Once the files opened with "budget" would map more than its
+  // capacity, the least recently read ones are unmapped; they are mapped
+  // again when next read, and read with system calls if that is not
+  // possible.  Data is copied out of the mappings into the caller's
+  // scratch space, so a mapping may be unmapped at any time.
+  //
+  // "budget" must have been returned by NewMmapBudget() of this Env and
+  // must outlive the file.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewMmapRandomAccessFile(const std::string& fname,
+                                         MmapBudget* budget,
+                                         RandomAccessFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -258,6 +297,21 @@ class LEVELDB_EXPORT RandomAccessFile {
 
   virtual ~RandomAccessFile();
 
+  // How a file is about to be read.
+  enum AccessPattern {
+    kNormal,
+    kRandom,      // Reads of single blocks in no particular order
+    kSequential,  // Reads in order, from start to end
+    kWillNeed,    // The whole file will be read soon
+  };
+
+  // Advise the implementation of how the file is about to be read, so that
+  // it can adjust its read ahead.  kWillNeed does not change the advice
+  // in effect for later reads.
+  //
+  // The default implementation does nothing.
+  virtual void Hint(AccessPattern pattern);
+
   // Read up to "n" bytes from the file starting at "offset".
   // "scratch[0..n-1]" may be written by this routine.  Sets "*result"
   // to the data that was read (including if fewer than "n" bytes were
@@ -271,6 +325,26 @@ class LEVELDB_EXPORT RandomAccessFile {
                       char* scratch) const = 0;
 };
 
+// Limits the bytes that files opened with Env::NewMmapRandomAccessFile()
+// map into memory at once.
+//
+// Safe for concurrent use by multiple threads.
+class LEVELDB_EXPORT MmapBudget {
+ public:
+  MmapBudget() = default;
+
+  MmapBudget(const MmapBudget&) = delete;
+  MmapBudget& operator=(const MmapBudget&) = delete;
+
+  virtual ~MmapBudget();
+
+  // Return the number of bytes that may be mapped at once.
+  virtual uint64_t Capacity() const = 0;
+
+  // Return the number of bytes currently mapped.
+  virtual uint64_t MappedBytes() const = 0;
+};
+
 // A file abstraction for sequential writing.  The implementation
 // must provide buffering since callers may append small fragments
 // at a time to the file.
@@ -287,6 +361,12 @@ class LEVELDB_EXPORT WritableFile {
   virtual Status Close() = 0;
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
+
+  // Start writing the bytes in [offset, offset + nbytes) back to storage
+  // without waiting for them to be durable.  Writing back a file a piece
+  // at a time keeps the final Sync() short.  The default implementation
+  // does nothing.
+  virtual Status RangeSync(uint64_t offset, uint64_t nbytes);
 };
 
 // An interface for writing log messages.
@@ -355,6 +435,21 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    return target_->NewDirectWritableFile(f, r);
+  }
+  MmapBudget* NewMmapBudget(uint64_t capacity) override {
+    return target_->NewMmapBudget(capacity);
+  }
+  Status NewMmapRandomAccessFile(const std::string& f, MmapBudget* budget,
+                                 RandomAccessFile** r) override {
+    return target_->NewMmapRandomAccessFile(f, budget, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a MergeOperator so that
+// read-modify-write updates (counters, appends to a list, ...) can be
+// written with DB::Merge() instead of a Get() followed by a Put().  A merge
+// only records its operand; the operands of a key are combined with its
+// value when the key is read and when it is compacted.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the merge operator.  Unlike the comparator name, it is not
+  // persisted; operands must however stay meaningful to the operator used
+  // when the database is reopened.
+  virtual const char* Name() const = 0;
+
+  // Combine "existing_value", the value of "key" before the operands were
+  // written (nullptr if "key" had no value), with "operands", oldest
+  // first, and store the result in *new_value.  Return false if the
+  // operands cannot be applied; the read or compaction then fails with a
+  // corruption error.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Combine two consecutive operands of "key" into a single operand with
+  // the same effect, if possible.  Compactions use this to shrink the
+  // operands of keys whose value lives in a deeper level.  The default
+  // implementation returns false, so operands are kept as they are.
+  virtual bool PartialMerge(const Slice& key, const Slice& older_operand,
+                            const Slice& newer_operand,
+                            std::string* new_operand) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
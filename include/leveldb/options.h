@@ -6,16 +6,21 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class RateLimiter;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -28,6 +33,45 @@ enum CompressionType {
   kNoCompression = 0x0,
   kSnappyCompression = 0x1,
   kZstdCompression = 0x2,
+  // LZ4HC writes the same format as LZ4, compressing slower but smaller,
+  // which suits the bottom levels.
+  kLZ4Compression = 0x3,
+  kLZ4HCCompression = 0x4,
+};
+
+// The following enum describes how the blocks of table files are
+// checksummed.
+enum ChecksumType {
+  // NOTE: do not change the values of existing entries, as these are
+  // part of the persistent format on disk.
+  kCRC32c = 0x1,
+  kXXH3 = 0x2,
+};
+
+// The following enum describes how compactions arrange the sorted runs
+// that make up the database.
+enum CompactionStyle {
+  // Each level holds one sorted run about ten times larger than the level
+  // above it.  Data is merged into every level on its way down.
+  kLevelCompaction = 0x0,
+  // Sorted runs of similar sizes are merged together.  Data is rewritten
+  // far less often, at the cost of more runs to search on reads and more
+  // space held by obsolete entries.
+  kUniversalCompaction = 0x1,
+};
+
+// The following enum describes which file of a level a leveled
+// compaction starts from.
+enum CompactionPriority {
+  // Cycle through the key space of the level, resuming after the range
+  // compacted last time.
+  kRoundRobin = 0x0,
+  // Pick the file whose key range covers the fewest bytes of the next
+  // level relative to its own size, so that the least data is rewritten
+  // per byte moved down.
+  kMinOverlappingRatio = 0x1,
+  // Pick the file that was written the longest time ago.
+  kOldestFileFirst = 0x2,
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -80,6 +124,8 @@ struct LEVELDB_EXPORT Options {
   // so you may wish to adjust this parameter to control memory usage.
   // Also, a larger write buffer will result in a longer recovery time
   // the next time the database is opened.
+  //
+  // Can be changed with DB::SetOptions().
   size_t write_buffer_size = 4 * 1024 * 1024;
 
   // Number of open files that can be used by the DB.  You may need to
@@ -113,8 +159,144 @@ struct LEVELDB_EXPORT Options {
   // compactions and hence longer latency/performance hiccups.
   // Another reason to increase this parameter might be when you are
   // initially populating a large database.
+  //
+  // Can be changed with DB::SetOptions().
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // If non-zero, table files are written back to storage every time this
+  // many bytes have been appended to them, without waiting for the
+  // writeback to complete.  Otherwise the whole file is written back when
+  // it is synced, which can hold up unrelated syncs such as those of the
+  // log.  Only has an effect where the Env implements
+  // WritableFile::RangeSync(), e.g. with sync_file_range() on Linux.
+  size_t bytes_per_sync = 0;
+
+  // Same as bytes_per_sync, for the log files.
+  size_t wal_bytes_per_sync = 0;
+
+  // If true, memtable flushes and compactions write table files, and
+  // compactions read their inputs, with direct I/O (O_DIRECT on Linux).
+  // Their data then does not push the hot data of reads out of the page
+  // cache.  Only has an effect where the Env implements
+  // NewDirectWritableFile() and NewDirectRandomAccessFile().
+  bool use_direct_io_for_flush_and_compaction = false;
+
+  // If true, table files are read with direct I/O, so that the block cache
+  // is the only cache of their data.  The block cache should then be sized
+  // to hold the working set.
+  bool use_direct_reads = false;
+
+  // If non-negative, table files are read through memory mappings of at
+  // most this many bytes in total, and reads of mapped tables make no
+  // system calls.  Past the limit the least recently read tables are
+  // unmapped.  Mapped tables are advised for random access, and the
+  // mapped inputs of a compaction are read ahead when it starts.  0 reads
+  // all tables with system calls.
+  //
+  // If negative, the Env decides which tables are mapped.  The POSIX Env
+  // maps the first 1000 tables opened on 64-bit platforms, and reads the
+  // others with system calls.
+  //
+  // Ignored if use_direct_reads is true, or if the Env does not support
+  // Env::NewMmapBudget().
+  int64_t max_mmap_read_bytes = -1;
+
+  // Number of level-0 files that triggers a compaction of level-0.  Every
+  // level-0 file may have to be searched by a read, but a higher trigger
+  // means fewer, larger level-0 compactions.
+  //
+  // Can be changed with DB::SetOptions().
+  int level0_file_num_compaction_trigger = 4;
+
+  // Soft limit on the number of level-0 files.  Once it is reached, writes
+  // are throttled to delayed_write_rate, and to a lower rate the closer
+  // level-0 gets to level0_stop_writes_trigger, to let compactions catch up.
+  //
+  // Can be changed with DB::SetOptions().
+  int level0_slowdown_writes_trigger = 8;
+
+  // Maximum number of level-0 files.  Writes wait while it is reached.
+  //
+  // Can be changed with DB::SetOptions().
+  int level0_stop_writes_trigger = 12;
+
+  // Rate, in bytes per second, that writes are throttled to once a soft
+  // limit (level0_slowdown_writes_trigger or
+  // soft_pending_compaction_bytes_limit) is reached.  It is scaled down
+  // linearly as the corresponding hard limit is approached, which turns
+  // a sudden stop into a gradual slowdown.
+  //
+  // Can be changed with DB::SetOptions().
+  uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // Writes are throttled once compactions are estimated to have this many
+  // bytes to rewrite before every level is back within its size limit.
+  // A value of 0 disables the limit.
+  //
+  // Can be changed with DB::SetOptions().
+  uint64_t soft_pending_compaction_bytes_limit = 64ull << 30;
+
+  // Writes wait while compactions are estimated to have this many bytes
+  // to rewrite.  A value of 0 disables the limit.
+  //
+  // Can be changed with DB::SetOptions().
+  uint64_t hard_pending_compaction_bytes_limit = 256ull << 30;
+
+  // Maximum level to which a new compacted memtable is pushed if it does
+  // not create overlap.  Pushing to level 2 avoids the relatively
+  // expensive level 0=>1 compactions and some manifest updates.  Pushing
+  // all the way to the largest level can waste a lot of disk space if
+  // the same key range is overwritten repeatedly.
+  //
+  // Can be changed with DB::SetOptions().
+  int max_mem_compaction_level = 2;
+
+  // How compactions arrange the data.  With kUniversalCompaction, every
+  // level-0 file and every non-empty deeper level is a sorted run, and
+  // compactions merge consecutive runs.
+  CompactionStyle compaction_style = kLevelCompaction;
+
+  // kLevelCompaction: derive the size limit of each level from the size
+  // of the largest level instead of using fixed limits of 10MB for
+  // level-1 and 10x more for every deeper level.  Each level is limited
+  // to a tenth of the level below it, levels whose limit would fall
+  // below 10MB are kept empty, and level-0 compacts directly into the
+  // first level that is not.  This keeps the deepest level holding
+  // about 90% of the data however large the database grows, which
+  // bounds space amplification.
+  bool level_compaction_dynamic_level_bytes = false;
+
+  // kLevelCompaction: which file a compaction of a level (other than
+  // level-0, whose overlapping files are compacted together) starts from.
+  CompactionPriority compaction_priority = kRoundRobin;
+
+  // kLevelCompaction: compact a file into the next level once at least
+  // this percentage of its entries are deletion markers or range
+  // tombstones, even if its level is within its size limit.  This moves
+  // the markers down to the data they delete, where both are dropped,
+  // instead of letting scans step over them until the level fills up.
+  // A value of 0 disables these compactions.
+  int deletion_compaction_percent = 0;
+
+  // kUniversalCompaction: compact once there are this many sorted runs.
+  // Reads may have to search every run, but fewer runs mean that data
+  // is rewritten more often.
+  int universal_compaction_trigger = 8;
+
+  // kUniversalCompaction: a run joins the newer runs being merged if it is
+  // at most this many percent larger than their total size.
+  int universal_size_ratio = 1;
+
+  // kUniversalCompaction: merge all runs once the runs other than the
+  // oldest one hold more than this percentage of its size.
+  int universal_max_size_amplification_percent = 200;
+
+  // An iterator stepping over more than this many consecutive hidden
+  // entries (older versions or deletion markers) of the same user key
+  // seeks directly past that key instead of calling Next() on each entry.
+  // A value of 0 disables the reseek.
+  int max_sequential_skip_in_iterations = 8;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -135,6 +317,87 @@ struct LEVELDB_EXPORT Options {
   // Currently only the range [-5,22] is supported. Default is 1.
   int zstd_compression_level = 1;
 
+  // Compression level for LZ4HC, from 1 to 12.  Default is 9.
+  int lz4hc_compression_level = 9;
+
+  // If non-empty, table files written to level i are compressed with
+  // compression_per_level[i] instead of "compression", and levels past the
+  // end use its last element.  Files of the upper levels are soon
+  // rewritten, so compressing them lightly or not at all saves CPU, while
+  // the bottom levels hold most of the data and gain the most from a
+  // better ratio.  For example {kNoCompression, kNoCompression,
+  // kLZ4Compression, kLZ4Compression, kLZ4HCCompression}.
+  //
+  // Memtable flushes use the setting of level 0, even when the new file is
+  // placed in a deeper level.
+  std::vector<CompressionType> compression_per_level;
+
+  // Same as compression_per_level, for zstd_compression_level.
+  std::vector<int> zstd_compression_level_per_level;
+
+  // If non-zero, table files compressed with kZstdCompression get a zstd
+  // dictionary of at most this many bytes, trained on their first data
+  // blocks and stored in the file.  Blocks of small values that look
+  // alike, such as short JSON documents, compress much better with a
+  // dictionary.  The data blocks used for training are held in memory
+  // until the dictionary is ready.  Files written with a dictionary cannot
+  // be read by versions of leveldb that do not support them.
+  uint32_t zstd_max_dict_bytes = 0;
+
+  // Bytes of data blocks a dictionary is trained on.  0 means 100 times
+  // zstd_max_dict_bytes, which zstd recommends.
+  uint32_t zstd_max_train_bytes = 0;
+
+  // If positive, the data blocks of the table files written by memtable
+  // flushes and compactions are compressed by this many threads, which
+  // the DB starts from "env" when it is opened and shares among all the
+  // files it writes.  The blocks are still written in order by the thread
+  // that builds each file, so a single compaction or flush can use several
+  // cores when compression is what limits it, as with zstd.  Each file
+  // holds up to twice this many blocks in memory while they wait to be
+  // compressed or written.  0 compresses the blocks on the thread that
+  // builds the file.  A TableBuilder created with this option starts
+  // threads of its own.
+  int parallel_compression_threads = 0;
+
+  // If true, compactions take reading and compression off the compaction
+  // thread.  The input files are read, and their blocks decompressed, by
+  // a thread of their own ahead of the merge, with about 1MB of entries
+  // read ahead.  The output blocks are compressed by the DB's compression
+  // threads (see parallel_compression_threads), of which there is then at
+  // least one.  The compaction thread still merges the entries, builds the
+  // output tables and appends their blocks to the files.  CPU-bound
+  // compactions finish sooner when there are cores to spare.
+  bool pipelined_compaction = false;
+
+  // Checksum of the blocks of new table files.  kXXH3 is much faster than
+  // kCRC32c where the CPU has no CRC32C instructions, as on many ARM
+  // servers, which makes reads with verify_checksums cheaper.  It needs
+  // the xxHash library; without it, files are written with kCRC32c.
+  // Files record their checksum type, so it can be changed at any time,
+  // but files checksummed with kXXH3 cannot be read by versions of
+  // leveldb that do not support it.
+  ChecksumType checksum = kCRC32c;
+
+  // If non-zero, values of at least this many bytes are moved to blob files
+  // when memtables are flushed and compactions rewrite them, and the table
+  // files keep a short reference instead.  Compactions then move the
+  // references rather than the values, which cuts the write amplification
+  // of large values, at the cost of a further read for each of them and
+  // of the space taken by overwritten and deleted values until their blob
+  // files are collected (see blob_gc_age_cutoff).
+  //
+  // Blob files cannot be read by versions of leveldb that do not support
+  // them.
+  size_t min_blob_size = 0;
+
+  // Compactions copy the values they come across in the oldest of this
+  // fraction of the blob files to new ones, so that the old files are
+  // eventually no longer referenced and are deleted with the overwritten
+  // and deleted values they hold.  Larger fractions free space sooner but
+  // copy more.  0 disables the copying.
+  double blob_gc_age_cutoff = 0.25;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -145,6 +408,43 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If not empty, table files written to level i get the filters of
+  // filter_policy_per_level[i] instead of "filter_policy", and levels past
+  // the end use its last element.  A null element means no filters for
+  // the level.  Most lookups that reach a level miss in it, and the deeper
+  // levels hold most of the keys, so giving the upper levels more bits per
+  // key buys a lower false positive rate for the same total memory.
+  //
+  // Reads use "filter_policy", so every non-null element must have the
+  // same Name() as "filter_policy", or DB::Open() fails with
+  // InvalidArgument.  Bloom filters of any bits per key qualify.  Memtable
+  // flushes use the setting of level 0, even when the new file is placed
+  // in a deeper level.
+  std::vector<const FilterPolicy*> filter_policy_per_level;
+
+  // If true, compactions write no filters when their output holds the
+  // bottommost data of its keys.  The last level is by far the largest,
+  // so this saves most of the memory of filters, at the cost of an extra
+  // read for each lookup of a key that is not in the database.  Good for
+  // workloads whose lookups mostly find their key.
+  bool optimize_filters_for_hits = false;
+
+  // If non-null, use the specified merge operator to combine the operands
+  // written with DB::Merge() with the values they update.  Required for
+  // DB::Merge().
+  const MergeOperator* merge_operator = nullptr;
+
+  // If non-null, compactions pass the values they rewrite through the
+  // specified filter, which may drop or replace them.  NewTTLCompactionFilter()
+  // returns a filter that drops expired values.
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // If non-null, memtable flushes and compactions write table files
+  // through the specified limiter, flushes with priority over compactions.
+  // This keeps background writes from starving foreground reads of disk
+  // bandwidth.  See NewGenericRateLimiter().
+  RateLimiter* rate_limiter = nullptr;
 };
 
 // Options that control read operations
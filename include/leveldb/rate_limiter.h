@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which background work writes to disk.
+// Table files written by memtable flushes and by compactions pass every
+// write through the limiter, which leaves disk bandwidth for foreground
+// reads and writes.  A limiter may be shared by several databases.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Env;
+class WritableFile;
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  // Requests of higher priority are granted before waiting requests of
+  // lower priority.  Flushes use kHigh since writes stall when they fall
+  // behind; compactions use kLow.
+  enum Priority { kLow = 0, kHigh = 1, kNumPriorities = 2 };
+
+  virtual ~RateLimiter();
+
+  // Change the rate limit.  With auto tuning this is the upper bound.
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  // Return the rate currently in effect.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Return the largest number of bytes a single Request() may ask for.
+  virtual int64_t GetSingleBurstBytes() const = 0;
+
+  // Block until "bytes" may be written at "priority".  Requests larger
+  // than GetSingleBurstBytes() are treated as requests of that size.
+  //
+  // Safe to call concurrently from multiple threads.
+  virtual void Request(int64_t bytes, Priority priority) = 0;
+
+  // Return the number of bytes granted at "priority" so far.
+  virtual int64_t GetTotalBytesThrough(Priority priority) const = 0;
+};
+
+// Return a new token-bucket rate limiter that allows "bytes_per_second",
+// adding tokens every "refill_period_micros".  A shorter period spreads
+// the writes more evenly; a longer one allows larger bursts.
+//
+// If "auto_tuned" is true, the rate is adjusted between a twentieth of
+// "bytes_per_second" and "bytes_per_second" depending on demand: it rises
+// while requests keep draining the bucket and falls while they do not,
+// so that the bandwidth is only taken while compactions are behind.
+//
+// "env" is used to read the time and to sleep.  If null, Env::Default()
+// is used.  Callers must delete the result after any database that is
+// using it has been closed.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t bytes_per_second, int64_t refill_period_micros = 100 * 1000,
+    bool auto_tuned = false, Env* env = nullptr);
+
+// Return a file that requests the size of every Append() from "limiter"
+// at "priority" before passing it on to "base".  The result takes
+// ownership of "base".  This lets an Env, or code that writes files
+// outside of leveldb, share the budget of a database's limiter.
+LEVELDB_EXPORT WritableFile* NewRateLimitedWritableFile(
+    WritableFile* base, RateLimiter* limiter, RateLimiter::Priority priority);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -19,6 +19,7 @@ struct Options;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
+struct TableProperties;
 
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
@@ -58,6 +59,11 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Return the statistics recorded in the table, or nullptr if it has none
+  // (e.g. it was written by an older version).  The result is owned by the
+  // table and valid for its lifetime.
+  const TableProperties* GetProperties() const;
+
  private:
   friend class TableCache;
   struct Rep;
@@ -73,8 +79,15 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
-  void ReadMeta(const Footer& footer);
+  // Returns a new iterator over the range tombstones stored in the table
+  // (see TableBuilder::AddRangeDeletion).
+  Iterator* NewRangeDelIterator() const;
+
+  Status ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  Status ReadRangeDeletions(const Slice& range_del_handle_value);
+  Status ReadCompressionDict(const Slice& dict_handle_value);
+  void ReadProperties(const Slice& properties_handle_value);
 
   Rep* const rep_;
 };
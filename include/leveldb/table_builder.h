@@ -23,6 +23,7 @@ namespace leveldb {
 
 class BlockBuilder;
 class BlockHandle;
+class CompressionWorkerPool;
 class WritableFile;
 
 class LEVELDB_EXPORT TableBuilder {
@@ -32,6 +33,14 @@ class LEVELDB_EXPORT TableBuilder {
   // caller to close the file after calling Finish().
   TableBuilder(const Options& options, WritableFile* file);
 
+  // Like the constructor above, except that unless it is null, the data
+  // blocks are compressed by the threads of *compression_workers rather
+  // than by threads of this builder's own.  Used by the database to share
+  // one pool among all the tables it writes.  *compression_workers must
+  // outlive this builder.
+  TableBuilder(const Options& options, WritableFile* file,
+               CompressionWorkerPool* compression_workers);
+
   TableBuilder(const TableBuilder&) = delete;
   TableBuilder& operator=(const TableBuilder&) = delete;
 
@@ -51,6 +60,13 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range tombstone to the table being constructed.  "key" is the
+  // start of the deleted range and "value" its exclusive end.  Tombstones
+  // are kept apart from the entries passed to Add() and may be added in
+  // any order.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeDeletion(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -75,13 +91,32 @@ class LEVELDB_EXPORT TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
-  // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Number of calls to AddRangeDeletion() so far.
+  uint64_t NumRangeDeletions() const;
+
+  // Record that "n" of the entries added are deletion markers, which only
+  // the caller can tell apart, for TableProperties::num_deletions.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void SetNumDeletions(uint64_t n);
+
+  // Size of the file generated so far, counting data blocks held back
+  // to train a compression dictionary or waiting to be compressed at
+  // their uncompressed size.  If
+  // invoked after a successful Finish() call, returns the size of the
+  // final generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void CompressAndWriteBlock(const Slice& raw, bool use_dict,
+                             BlockHandle* handle);
+  void WriteBufferedBlocks();
+  void WriteDataBlock(const Slice& raw);
+  void WriteCompressedBlocks(size_t max_in_flight);
+  void WriteHeldBackBlock(const Slice& raw, const Slice& block_contents,
+                          CompressionType type);
+  void ReleaseCompressionWorkers();
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
   struct Rep;
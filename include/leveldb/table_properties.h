@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+#define STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+// Statistics about the contents of a table, recorded by TableBuilder in
+// the table itself so that they can be read without reading the data
+// blocks (see Table::GetProperties).
+struct LEVELDB_EXPORT TableProperties {
+  // Size of the data blocks as stored, including their trailers
+  uint64_t data_size = 0;
+
+  // Size of the index block as stored
+  uint64_t index_size = 0;
+
+  // Size of the filter block, or 0 if the table has none
+  uint64_t filter_size = 0;
+
+  // Total size of the keys and of the values passed to TableBuilder::Add
+  uint64_t raw_key_size = 0;
+  uint64_t raw_value_size = 0;
+
+  uint64_t num_data_blocks = 0;
+
+  // Number of calls to TableBuilder::Add
+  uint64_t num_entries = 0;
+
+  // Number of those entries that are deletion markers, as reported by
+  // TableBuilder::SetNumDeletions
+  uint64_t num_deletions = 0;
+
+  // Number of calls to TableBuilder::AddRangeDeletion
+  uint64_t num_range_deletions = 0;
+
+  // The CompressionType the data blocks were written with
+  uint64_t compression = 0;
+
+  // Return a human-readable description of the properties, one per line.
+  std::string ToString() const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
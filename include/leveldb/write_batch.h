@@ -37,6 +37,10 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // Handlers that do not override this ignore range deletions.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
+    // Handlers that do not override this ignore merges.
+    virtual void Merge(const Slice& key, const Slice& operand);
   };
 
   WriteBatch();
@@ -53,6 +57,13 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in the range ["begin", "end").
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // Combine "operand" with the value of "key" using the database's
+  // merge operator (see DB::Merge()).
+  void Merge(const Slice& key, const Slice& operand);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -101,8 +101,85 @@ bool Zstd_GetUncompressedLength(const char* input, size_t length,
 // Zstd_GetUncompressedLength.
 bool Zstd_Uncompress(const char* input_data, size_t input_length, char* output);
 
+// Store the LZ4 compression of "input[0,input_length-1]" in *output.
+// Returns false if LZ4 is not supported by this port.
+bool Lz4_Compress(const char* input, size_t input_length, std::string* output);
+
+// Like Lz4_Compress(), with the slower LZ4HC compressor at "level", which
+// compresses better.  The result is uncompressed by Lz4_Uncompress().
+bool Lz4hc_Compress(int level, const char* input, size_t input_length,
+                    std::string* output);
+
+// If input[0,input_length-1] looks like a valid LZ4 compressed
+// buffer, store the size of the uncompressed data in *result and
+// return true.  Else return false.
+bool Lz4_GetUncompressedLength(const char* input, size_t length,
+                               size_t* result);
+
+// Attempt to LZ4 uncompress input[0,input_length-1] into *output.
+// Returns true if successful, false if the input is invalid LZ4
+// compressed data.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// Lz4_GetUncompressedLength.
+bool Lz4_Uncompress(const char* input_data, size_t input_length, char* output);
+
+// Train a zstd dictionary of at most "max_dict_bytes" on the samples that
+// are concatenated in "samples" and have the sizes in "sample_sizes", and
+// store it in *dict.  Returns false if zstd is not supported by this port,
+// or if the samples are too few to train on.
+bool Zstd_TrainDictionary(const std::string& samples,
+                          const std::vector<size_t>& sample_sizes,
+                          size_t max_dict_bytes, std::string* dict);
+
+// A zstd dictionary prepared once for compressing many inputs at
+// "level" with ZstdCompressionContext::Compress().  Safe for concurrent
+// use.
+class ZstdCompressionDict {
+ public:
+  ZstdCompressionDict(const char* dict, size_t dict_size, int level);
+  ~ZstdCompressionDict();
+};
+
+// A zstd compression context, kept by a thread that compresses many
+// inputs so that its buffers are allocated once rather than per input.
+// Not safe for concurrent use.
+class ZstdCompressionContext {
+ public:
+  ZstdCompressionContext();
+  ~ZstdCompressionContext();
+
+  // Like Zstd_Compress(), with this context.
+  bool Compress(int level, const char* input, size_t input_length,
+                std::string* output);
+
+  // Store the zstd compression of "input[0,input_length-1]" with "dict"
+  // in *output, using this context.  Returns false if zstd is not
+  // supported by this port.
+  bool Compress(const ZstdCompressionDict& dict, const char* input,
+                size_t input_length, std::string* output);
+};
+
+// A zstd dictionary prepared once for uncompressing many inputs, which
+// also keeps the decompression contexts of finished calls for reuse.
+// Safe for concurrent use.
+class ZstdDecompressionDict {
+ public:
+  ZstdDecompressionDict(const char* dict, size_t dict_size);
+  ~ZstdDecompressionDict();
+
+  // Like Zstd_Uncompress(), for input compressed with the dictionary.
+  bool Uncompress(const char* input_data, size_t input_length,
+                  char* output) const;
+};
+
 // ------------------ Miscellaneous -------------------
 
+// Store the XXH3 64-bit hash of "data[0,n-1]" in *result.  Returns false
+// if xxHash is not supported by this port.
+bool XXH3_Hash64(const char* data, size_t n, uint64_t* result);
+
 // If heap profiling is not supported, returns false.
 // Else repeatedly calls (*func)(arg, data, n) and then returns true.
 // The concatenation of all "data[0,n-1]" fragments is the heap profile.
@@ -30,8 +30,16 @@
 #endif  // HAVE_SNAPPY
 #if HAVE_ZSTD
 #define ZSTD_STATIC_LINKING_ONLY  // For ZSTD_compressionParameters.
+#include <zdict.h>
 #include <zstd.h>
 #endif  // HAVE_ZSTD
+#if HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif  // HAVE_LZ4
+#if HAVE_XXHASH
+#include <xxhash.h>
+#endif  // HAVE_XXHASH
 
 #include <cassert>
 #include <condition_variable>  // NOLINT
@@ -39,6 +47,7 @@
 #include <cstdint>
 #include <mutex>  // NOLINT
 #include <string>
+#include <vector>
 
 #include "port/thread_annotations.h"
 
@@ -198,6 +207,347 @@ inline bool Zstd_Uncompress(const char* input, size_t length, char* output) {
 #endif  // HAVE_ZSTD
 }
 
+inline bool Zstd_TrainDictionary(const std::string& samples,
+                                 const std::vector<size_t>& sample_sizes,
+                                 size_t max_dict_bytes, std::string* dict) {
+#if HAVE_ZSTD
+  dict->resize(max_dict_bytes);
+  size_t dict_size = ZDICT_trainFromBuffer(
+      &(*dict)[0], dict->size(), samples.data(), sample_sizes.data(),
+      static_cast<unsigned>(sample_sizes.size()));
+  if (ZDICT_isError(dict_size)) {
+    dict->clear();
+    return false;
+  }
+  dict->resize(dict_size);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)samples;
+  (void)sample_sizes;
+  (void)max_dict_bytes;
+  (void)dict;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+// LZ4 blocks do not record their uncompressed size, so the LZ4 functions
+// below prefix the compressed data with it, as 4 little-endian bytes.
+static constexpr size_t kLz4LengthPrefixSize = 4;
+
+inline bool Lz4_CompressWith(int level, bool high_compression,
+                             const char* input, size_t length,
+                             std::string* output) {
+#if HAVE_LZ4
+  if (length > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  output->resize(kLz4LengthPrefixSize + bound);
+  char* dst = &(*output)[0];
+  for (size_t i = 0; i < kLz4LengthPrefixSize; i++) {
+    dst[i] = static_cast<char>((length >> (8 * i)) & 0xff);
+  }
+  const int outlen =
+      high_compression
+          ? LZ4_compress_HC(input, dst + kLz4LengthPrefixSize,
+                            static_cast<int>(length), bound, level)
+          : LZ4_compress_default(input, dst + kLz4LengthPrefixSize,
+                                 static_cast<int>(length), bound);
+  if (outlen <= 0) {
+    return false;
+  }
+  output->resize(kLz4LengthPrefixSize + outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)level;
+  (void)high_compression;
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool Lz4_Compress(const char* input, size_t length,
+                         std::string* output) {
+  return Lz4_CompressWith(/*level=*/0, /*high_compression=*/false, input,
+                          length, output);
+}
+
+inline bool Lz4hc_Compress(int level, const char* input, size_t length,
+                           std::string* output) {
+  return Lz4_CompressWith(level, /*high_compression=*/true, input, length,
+                          output);
+}
+
+inline bool Lz4_GetUncompressedLength(const char* input, size_t length,
+                                      size_t* result) {
+#if HAVE_LZ4
+  if (length < kLz4LengthPrefixSize) {
+    return false;
+  }
+  size_t size = 0;
+  for (size_t i = 0; i < kLz4LengthPrefixSize; i++) {
+    size |= static_cast<size_t>(static_cast<unsigned char>(input[i]))
+            << (8 * i);
+  }
+  *result = size;
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool Lz4_Uncompress(const char* input, size_t length, char* output) {
+#if HAVE_LZ4
+  size_t outlen;
+  if (!Lz4_GetUncompressedLength(input, length, &outlen) ||
+      outlen > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  const int result =
+      LZ4_decompress_safe(input + kLz4LengthPrefixSize, output,
+                          static_cast<int>(length - kLz4LengthPrefixSize),
+                          static_cast<int>(outlen));
+  return result >= 0 && static_cast<size_t>(result) == outlen;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+// A zstd dictionary digested for compression at one level.  Digesting is
+// costly, so it is done once and reused for every block, which is
+// compressed with it by ZstdCompressionContext::Compress().
+//
+// Safe for concurrent use.
+class ZstdCompressionDict {
+ public:
+  ZstdCompressionDict(const char* dict, size_t dict_size, int level)
+#if HAVE_ZSTD
+      : cdict_(ZSTD_createCDict(dict, dict_size, level))
+#endif  // HAVE_ZSTD
+  {
+#if !HAVE_ZSTD
+    // Silence compiler warnings about unused arguments.
+    (void)dict;
+    (void)dict_size;
+    (void)level;
+#endif  // !HAVE_ZSTD
+  }
+
+  ZstdCompressionDict(const ZstdCompressionDict&) = delete;
+  ZstdCompressionDict& operator=(const ZstdCompressionDict&) = delete;
+
+  ~ZstdCompressionDict() {
+#if HAVE_ZSTD
+    ZSTD_freeCDict(cdict_);
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+  friend class ZstdCompressionContext;
+
+#if HAVE_ZSTD
+  ZSTD_CDict* const cdict_;
+#endif  // HAVE_ZSTD
+};
+
+// A zstd compression context, which holds the buffers and tables that
+// compressing uses.  They are costly to allocate, so a thread compressing
+// many inputs keeps one context for all of them.  The zstd context itself
+// is created by the first call.
+//
+// Not safe for concurrent use.
+class ZstdCompressionContext {
+ public:
+#if HAVE_ZSTD
+  ZstdCompressionContext() : cctx_(nullptr) {}
+#else
+  ZstdCompressionContext() = default;
+#endif  // HAVE_ZSTD
+
+  ZstdCompressionContext(const ZstdCompressionContext&) = delete;
+  ZstdCompressionContext& operator=(const ZstdCompressionContext&) = delete;
+
+  ~ZstdCompressionContext() {
+#if HAVE_ZSTD
+    ZSTD_freeCCtx(cctx_);
+#endif  // HAVE_ZSTD
+  }
+
+  // Like Zstd_Compress(), with this context.
+  bool Compress(int level, const char* input, size_t length,
+                std::string* output) {
+#if HAVE_ZSTD
+    size_t outlen = ZSTD_compressBound(length);
+    if (ZSTD_isError(outlen) || !Init()) {
+      return false;
+    }
+    output->resize(outlen);
+    ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_and_parameters);
+    ZSTD_compressionParameters parameters =
+        ZSTD_getCParams(level, std::max(length, size_t{1}), /*dictSize=*/0);
+    ZSTD_CCtx_setCParams(cctx_, parameters);
+    outlen =
+        ZSTD_compress2(cctx_, &(*output)[0], output->size(), input, length);
+    if (ZSTD_isError(outlen)) {
+      return false;
+    }
+    output->resize(outlen);
+    return true;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)level;
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+  // Store the zstd compression of "input[0,length-1]" with "dict" in
+  // *output, using this context.
+  bool Compress(const ZstdCompressionDict& dict, const char* input,
+                size_t length, std::string* output) {
+#if HAVE_ZSTD
+    if (dict.cdict_ == nullptr) {
+      return false;
+    }
+    size_t outlen = ZSTD_compressBound(length);
+    if (ZSTD_isError(outlen) || !Init()) {
+      return false;
+    }
+    output->resize(outlen);
+    outlen = ZSTD_compress_usingCDict(cctx_, &(*output)[0], output->size(),
+                                      input, length, dict.cdict_);
+    if (ZSTD_isError(outlen)) {
+      return false;
+    }
+    output->resize(outlen);
+    return true;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)dict;
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  bool Init() {
+    if (cctx_ == nullptr) {
+      cctx_ = ZSTD_createCCtx();
+    }
+    return cctx_ != nullptr;
+  }
+
+  ZSTD_CCtx* cctx_;
+#endif  // HAVE_ZSTD
+};
+
+// A zstd dictionary digested for decompression.  Decompression contexts
+// are costly to create, so the ones of finished calls are kept for the
+// next calls: as many as there were calls at the same time.
+//
+// Safe for concurrent use.
+class ZstdDecompressionDict {
+ public:
+  ZstdDecompressionDict(const char* dict, size_t dict_size)
+#if HAVE_ZSTD
+      : ddict_(ZSTD_createDDict(dict, dict_size))
+#endif  // HAVE_ZSTD
+  {
+#if !HAVE_ZSTD
+    // Silence compiler warnings about unused arguments.
+    (void)dict;
+    (void)dict_size;
+#endif  // !HAVE_ZSTD
+  }
+
+  ZstdDecompressionDict(const ZstdDecompressionDict&) = delete;
+  ZstdDecompressionDict& operator=(const ZstdDecompressionDict&) = delete;
+
+  ~ZstdDecompressionDict() {
+#if HAVE_ZSTD
+    for (ZSTD_DCtx* ctx : free_contexts_) {
+      ZSTD_freeDCtx(ctx);
+    }
+    ZSTD_freeDDict(ddict_);
+#endif  // HAVE_ZSTD
+  }
+
+  bool Uncompress(const char* input, size_t length, char* output) const {
+#if HAVE_ZSTD
+    size_t outlen;
+    if (ddict_ == nullptr ||
+        !Zstd_GetUncompressedLength(input, length, &outlen)) {
+      return false;
+    }
+    ZSTD_DCtx* ctx = nullptr;
+    mu_.Lock();
+    if (!free_contexts_.empty()) {
+      ctx = free_contexts_.back();
+      free_contexts_.pop_back();
+    }
+    mu_.Unlock();
+    if (ctx == nullptr) {
+      ctx = ZSTD_createDCtx();
+      if (ctx == nullptr) {
+        return false;
+      }
+    }
+    outlen =
+        ZSTD_decompress_usingDDict(ctx, output, outlen, input, length, ddict_);
+    mu_.Lock();
+    free_contexts_.push_back(ctx);
+    mu_.Unlock();
+    if (ZSTD_isError(outlen)) {
+      return false;
+    }
+    return true;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  ZSTD_DDict* const ddict_;
+  mutable Mutex mu_;
+  mutable std::vector<ZSTD_DCtx*> free_contexts_ GUARDED_BY(mu_);
+#endif  // HAVE_ZSTD
+};
+
+inline bool XXH3_Hash64(const char* data, size_t n, uint64_t* result) {
+#if HAVE_XXHASH
+  *result = XXH3_64bits(data, n);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)data;
+  (void)n;
+  (void)result;
+  return false;
+#endif  // HAVE_XXHASH
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   // Silence compiler warnings about unused arguments.
   (void)func;
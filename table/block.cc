@@ -88,6 +88,20 @@ class Block::Iter : public Iterator {
   Slice value_;
   Status status_;
 
+  // Entries of the restart interval preceding the most recent slow-path
+  // Prev(), decoded once so that further Prev() calls inside the same
+  // interval do not have to re-decode it from its restart point.
+  struct CachedPrevEntry {
+    uint32_t offset;      // Offset in data_ of the entry
+    uint32_t key_offset;  // Offset of the key in prev_entries_keys_
+    uint32_t key_size;
+    Slice value;
+  };
+  std::vector<CachedPrevEntry> prev_entries_;
+  std::string prev_entries_keys_;
+  uint32_t prev_entries_restart_;  // Restart index of the cached interval
+  int prev_entries_idx_;           // Index of current_ in prev_entries_ or -1
+
   inline int Compare(const Slice& a, const Slice& b) const {
     return comparator_->Compare(a, b);
   }
@@ -120,7 +134,9 @@ class Block::Iter : public Iterator {
         restarts_(restarts),
         num_restarts_(num_restarts),
         current_(restarts_),
-        restart_index_(num_restarts_) {
+        restart_index_(num_restarts_),
+        prev_entries_restart_(0),
+        prev_entries_idx_(-1) {
     assert(num_restarts_ > 0);
   }
 
@@ -143,6 +159,19 @@ class Block::Iter : public Iterator {
   void Prev() override {
     assert(Valid());
 
+    // Fast path: the previous entry was decoded by an earlier Prev().
+    if (prev_entries_idx_ > 0 &&
+        prev_entries_[prev_entries_idx_].offset == current_) {
+      prev_entries_idx_--;
+      const CachedPrevEntry& entry = prev_entries_[prev_entries_idx_];
+      current_ = entry.offset;
+      restart_index_ = prev_entries_restart_;
+      key_.assign(prev_entries_keys_.data() + entry.key_offset,
+                  entry.key_size);
+      value_ = entry.value;
+      return;
+    }
+
     // Scan backwards to a restart point before current_
     const uint32_t original = current_;
     while (GetRestartPoint(restart_index_) >= original) {
@@ -150,15 +179,33 @@ class Block::Iter : public Iterator {
         // No more entries
         current_ = restarts_;
         restart_index_ = num_restarts_;
+        prev_entries_idx_ = -1;
         return;
       }
       restart_index_--;
     }
 
+    // Decode forward to the entry before original, remembering every
+    // entry of the interval on the way.
     SeekToRestartPoint(restart_index_);
-    do {
-      // Loop until end of current entry hits the start of original entry
-    } while (ParseNextKey() && NextEntryOffset() < original);
+    prev_entries_.clear();
+    prev_entries_keys_.clear();
+    prev_entries_restart_ = restart_index_;
+    prev_entries_idx_ = -1;
+    while (ParseNextKey()) {
+      CachedPrevEntry entry;
+      entry.offset = current_;
+      entry.key_offset = prev_entries_keys_.size();
+      entry.key_size = key_.size();
+      entry.value = value_;
+      prev_entries_keys_.append(key_);
+      prev_entries_.push_back(entry);
+      if (NextEntryOffset() >= original) {
+        // End of current entry hits the start of original entry
+        prev_entries_idx_ = static_cast<int>(prev_entries_.size()) - 1;
+        break;
+      }
+    }
   }
 
   void Seek(const Slice& target) override {
@@ -0,0 +1,115 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/compression_worker_pool.h"
+
+#include <cassert>
+
+#include "leveldb/env.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+CompressionType CompressBlock(CompressionType type, int level,
+                              const port::ZstdCompressionDict* dict,
+                              port::ZstdCompressionContext* zstd_ctx,
+                              const Slice& raw, std::string* compressed) {
+  // TODO(postrelease): Support more compression options: zlib?
+  bool compressed_ok = false;
+  switch (type) {
+    case kNoCompression:
+      return kNoCompression;
+
+    case kSnappyCompression:
+      compressed_ok = port::Snappy_Compress(raw.data(), raw.size(), compressed);
+      break;
+
+    case kZstdCompression:
+      compressed_ok =
+          (dict != nullptr)
+              ? zstd_ctx->Compress(*dict, raw.data(), raw.size(), compressed)
+              : zstd_ctx->Compress(level, raw.data(), raw.size(), compressed);
+      break;
+
+    case kLZ4Compression:
+      compressed_ok = port::Lz4_Compress(raw.data(), raw.size(), compressed);
+      break;
+
+    case kLZ4HCCompression:
+      compressed_ok =
+          port::Lz4hc_Compress(level, raw.data(), raw.size(), compressed);
+      break;
+  }
+  if (compressed_ok && compressed->size() < raw.size() - (raw.size() / 8u)) {
+    return type;
+  }
+  // Compression not supported, or compressed less than 12.5%, so just
+  // store uncompressed form
+  return kNoCompression;
+}
+
+CompressionWorkerPool::CompressionWorkerPool(Env* env, int num_threads)
+    : num_threads_(num_threads),
+      cv_(&mu_),
+      num_running_(num_threads),
+      shutting_down_(false) {
+  assert(num_threads > 0);
+  for (int i = 0; i < num_threads; i++) {
+    env->StartThread(&CompressionWorkerPool::WorkerMain, this);
+  }
+}
+
+CompressionWorkerPool::~CompressionWorkerPool() {
+  MutexLock l(&mu_);
+  assert(queue_.empty());
+  shutting_down_ = true;
+  cv_.SignalAll();
+  while (num_running_ > 0) {
+    cv_.Wait();
+  }
+}
+
+void CompressionWorkerPool::Schedule(CompressionJob* job) {
+  MutexLock l(&mu_);
+  job->done = false;
+  queue_.push_back(job);
+  cv_.SignalAll();
+}
+
+bool CompressionWorkerPool::Done(CompressionJob* job, bool wait) {
+  MutexLock l(&mu_);
+  while (wait && !job->done) {
+    cv_.Wait();
+  }
+  return job->done;
+}
+
+void CompressionWorkerPool::WorkerMain(void* arg) {
+  reinterpret_cast<CompressionWorkerPool*>(arg)->Run();
+}
+
+void CompressionWorkerPool::Run() {
+  port::ZstdCompressionContext zstd_ctx;
+  MutexLock l(&mu_);
+  while (true) {
+    while (!shutting_down_ && queue_.empty()) {
+      cv_.Wait();
+    }
+    if (shutting_down_) {
+      break;
+    }
+    CompressionJob* job = queue_.front();
+    queue_.pop_front();
+    mu_.Unlock();
+    job->type = CompressBlock(job->type, job->level, job->dict, &zstd_ctx,
+                              job->raw, &job->compressed);
+    mu_.Lock();
+    job->done = true;
+    cv_.SignalAll();
+  }
+  num_running_--;
+  cv_.SignalAll();
+}
+
+}  // namespace leveldb
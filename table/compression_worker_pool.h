@@ -0,0 +1,81 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_COMPRESSION_WORKER_POOL_H_
+#define STORAGE_LEVELDB_TABLE_COMPRESSION_WORKER_POOL_H_
+
+#include <deque>
+#include <string>
+
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+class Env;
+
+// Compress "raw" as "type" at "level" into *compressed, with "dict" if it
+// is not null and with the zstd context *zstd_ctx.  Returns "type" if
+// *compressed holds the block contents, or kNoCompression if "raw" should
+// be stored instead.
+CompressionType CompressBlock(CompressionType type, int level,
+                              const port::ZstdCompressionDict* dict,
+                              port::ZstdCompressionContext* zstd_ctx,
+                              const Slice& raw, std::string* compressed);
+
+// A data block handed to a CompressionWorkerPool.
+struct CompressionJob {
+  std::string raw;
+  CompressionType type;  // Set to the type of the result when done
+  int level;
+  const port::ZstdCompressionDict* dict;  // nullptr if no dictionary
+  std::string compressed;
+  bool done;
+};
+
+// Threads that compress data blocks for any number of table builders at
+// the same time.  Each thread keeps its own zstd context for all the
+// blocks it compresses.
+//
+// Safe for concurrent use.
+class CompressionWorkerPool {
+ public:
+  // Start "num_threads" threads from "env".
+  // REQUIRES: num_threads > 0
+  CompressionWorkerPool(Env* env, int num_threads);
+
+  CompressionWorkerPool(const CompressionWorkerPool&) = delete;
+  CompressionWorkerPool& operator=(const CompressionWorkerPool&) = delete;
+
+  // Stops the threads.
+  // REQUIRES: No job is scheduled and not yet done.
+  ~CompressionWorkerPool();
+
+  int num_threads() const { return num_threads_; }
+
+  // Compress *job on one of the threads, which sets job->done when
+  // finished.  The caller keeps ownership of *job.
+  void Schedule(CompressionJob* job);
+
+  // Wait until *job is done, or return right away if "wait" is false.
+  // Returns job->done.
+  bool Done(CompressionJob* job, bool wait);
+
+ private:
+  static void WorkerMain(void* arg);
+  void Run();
+
+  const int num_threads_;
+  port::Mutex mu_;
+  port::CondVar cv_;  // Signalled when any of the fields below change
+  std::deque<CompressionJob*> queue_ GUARDED_BY(mu_);  // Not yet started
+  int num_running_ GUARDED_BY(mu_);
+  bool shutting_down_ GUARDED_BY(mu_);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_COMPRESSION_WORKER_POOL_H_
@@ -31,12 +31,21 @@ Status BlockHandle::DecodeFrom(Slice* input) {
 
 void Footer::EncodeTo(std::string* dst) const {
   const size_t original_size = dst->size();
+  uint64_t magic = kTableMagicNumber;
+  if (checksum_type_ != kCRC32c) {
+    // Tables checksummed with crc32c keep the original format, which
+    // every version of leveldb reads.
+    dst->push_back(static_cast<char>(checksum_type_));
+    magic = kTableMagicNumberWithChecksum;
+  }
+  const size_t handles_start = dst->size();
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
-  dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
-  assert(dst->size() == original_size + kEncodedLength);
+  dst->resize(handles_start + 2 * BlockHandle::kMaxEncodedLength);  // Padding
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
+  assert(dst->size() == original_size + kEncodedLength +
+                            (checksum_type_ != kCRC32c ? 1 : 0));
   (void)original_size;  // Disable unused variable warning.
 }
 
@@ -45,29 +54,67 @@ Status Footer::DecodeFrom(Slice* input) {
     return Status::Corruption("not an sstable (footer too short)");
   }
 
-  const char* magic_ptr = input->data() + kEncodedLength - 8;
+  const char* magic_ptr = input->data() + input->size() - 8;
   const uint32_t magic_lo = DecodeFixed32(magic_ptr);
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  const char* footer_start = magic_ptr + 8 - kEncodedLength;
+  if (magic == kTableMagicNumber) {
+    checksum_type_ = kCRC32c;
+  } else if (magic == kTableMagicNumberWithChecksum &&
+             input->size() >= kMaxEncodedLength) {
+    // The checksum type precedes the handles
+    const unsigned char type = static_cast<unsigned char>(footer_start[-1]);
+    if (type != kCRC32c && type != kXXH3) {
+      return Status::Corruption("unknown sstable checksum type");
+    }
+    checksum_type_ = static_cast<ChecksumType>(type);
+  } else {
     return Status::Corruption("not an sstable (bad magic number)");
   }
 
-  Status result = metaindex_handle_.DecodeFrom(input);
+  Slice handles(footer_start, magic_ptr - footer_start);
+  Status result = metaindex_handle_.DecodeFrom(&handles);
   if (result.ok()) {
-    result = index_handle_.DecodeFrom(input);
+    result = index_handle_.DecodeFrom(&handles);
   }
   if (result.ok()) {
-    // We skip over any leftover data (just padding for now) in "input"
-    const char* end = magic_ptr + 8;
-    *input = Slice(end, input->data() + input->size() - end);
+    // The footer ends the file
+    *input = Slice(magic_ptr + 8, 0);
   }
   return result;
 }
 
+bool ComputeBlockChecksum(ChecksumType checksum, const char* data, size_t n,
+                          char type, uint32_t* result) {
+  switch (checksum) {
+    case kCRC32c: {
+      uint32_t crc = crc32c::Value(data, n);
+      crc = crc32c::Extend(crc, &type, 1);  // Extend crc to cover block type
+      *result = crc32c::Mask(crc);
+      return true;
+    }
+    case kXXH3: {
+      uint64_t hash;
+      if (!port::XXH3_Hash64(data, n, &hash)) {
+        return false;
+      }
+      // Mix in the block type, multiplied by a large prime to spread it
+      // over the word.
+      *result = static_cast<uint32_t>(hash) +
+                static_cast<uint32_t>(static_cast<unsigned char>(type)) *
+                    0x6b9083d9u;
+      return true;
+    }
+  }
+  return false;
+}
+
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+                 const BlockHandle& handle, BlockContents* result,
+                 ChecksumType checksum,
+                 const port::ZstdDecompressionDict* dict) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
@@ -87,12 +134,16 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     return Status::Corruption("truncated block read");
   }
 
-  // Check the crc of the type and the block contents
+  // Check the checksum of the type and the block contents
   const char* data = contents.data();  // Pointer to where Read put the data
   if (options.verify_checksums) {
-    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
-    const uint32_t actual = crc32c::Value(data, n + 1);
-    if (actual != crc) {
+    const uint32_t expected = DecodeFixed32(data + n + 1);
+    uint32_t actual;
+    if (!ComputeBlockChecksum(checksum, data, n, data[n], &actual)) {
+      delete[] buf;
+      return Status::NotSupported("block checksum type not supported");
+    }
+    if (actual != expected) {
       delete[] buf;
       s = Status::Corruption("block checksum mismatch");
       return s;
@@ -142,7 +193,8 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
         return Status::Corruption("corrupted zstd compressed block length");
       }
       char* ubuf = new char[ulength];
-      if (!port::Zstd_Uncompress(data, n, ubuf)) {
+      if (!(dict != nullptr ? dict->Uncompress(data, n, ubuf)
+                            : port::Zstd_Uncompress(data, n, ubuf))) {
         delete[] buf;
         delete[] ubuf;
         return Status::Corruption("corrupted zstd compressed block contents");
@@ -153,6 +205,25 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
       result->cachable = true;
       break;
     }
+    case kLZ4Compression:
+    case kLZ4HCCompression: {
+      size_t ulength = 0;
+      if (!port::Lz4_GetUncompressedLength(data, n, &ulength)) {
+        delete[] buf;
+        return Status::Corruption("corrupted lz4 compressed block length");
+      }
+      char* ubuf = new char[ulength];
+      if (!port::Lz4_Uncompress(data, n, ubuf)) {
+        delete[] buf;
+        delete[] ubuf;
+        return Status::Corruption("corrupted lz4 compressed block contents");
+      }
+      delete[] buf;
+      result->data = Slice(ubuf, ulength);
+      result->heap_allocated = true;
+      result->cachable = true;
+      break;
+    }
     default:
       delete[] buf;
       return Status::Corruption("bad block type");
@@ -18,6 +18,10 @@ class Block;
 class RandomAccessFile;
 struct ReadOptions;
 
+namespace port {
+class ZstdDecompressionDict;
+}  // namespace port
+
 // BlockHandle is a pointer to the extent of a file that stores a data
 // block or a meta block.
 class BlockHandle {
@@ -47,12 +51,21 @@ class BlockHandle {
 // end of every table file.
 class Footer {
  public:
-  // Encoded length of a Footer.  Note that the serialization of a
-  // Footer will always occupy exactly this many bytes.  It consists
-  // of two block handles and a magic number.
-  enum { kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8 };
-
-  Footer() = default;
+  // Encoded length of a Footer of a table checksummed with kCRC32c.  Note
+  // that the serialization of such a Footer will always occupy exactly
+  // this many bytes.  It consists of two block handles and a magic number.
+  // The Footer of a table checksummed otherwise starts with one more byte
+  // holding the ChecksumType, and ends with kTableMagicNumberWithChecksum.
+  enum {
+    kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8,
+    kMaxEncodedLength = 1 + kEncodedLength
+  };
+
+  Footer() : checksum_type_(kCRC32c) {}
+
+  // The checksum of the blocks of the table
+  ChecksumType checksum_type() const { return checksum_type_; }
+  void set_checksum_type(ChecksumType t) { checksum_type_ = t; }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -63,9 +76,14 @@ class Footer {
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
   void EncodeTo(std::string* dst) const;
+
+  // Decode the Footer at the end of *input, which holds the last bytes of
+  // a table file: at least kEncodedLength of them, and kMaxEncodedLength
+  // if the file is that long.
   Status DecodeFrom(Slice* input);
 
  private:
+  ChecksumType checksum_type_;
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
 };
@@ -75,19 +93,42 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
-// 1-byte type + 32-bit crc
+// Magic number of the tables whose Footer records their checksum type,
+// picked by running
+//    echo http://code.google.com/p/leveldb/checksum | sha1sum
+// and taking the leading 64 bits.
+static const uint64_t kTableMagicNumberWithChecksum = 0xf7dfb4a5ff62746full;
+
+// 1-byte type + 32-bit checksum
 static const size_t kBlockTrailerSize = 5;
 
+// Name of the metaindex entry pointing at the block of range tombstones.
+static const char kRangeDelBlockName[] = "leveldb.RangeDeletion";
+
+// Name of the metaindex entry pointing at the zstd dictionary that the
+// data blocks are compressed with.
+static const char kCompressionDictBlockName[] = "leveldb.CompressionDict";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
-// Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// Compute the checksum stored in the trailer of a block whose contents
+// are "data[0,n-1]" and whose compression type is "type".  Returns false
+// if "checksum" is not supported by this build.
+bool ComputeBlockChecksum(ChecksumType checksum, const char* data, size_t n,
+                          char type, uint32_t* result);
+
+// Read the block identified by "handle" from "file", whose blocks are
+// checksummed with "checksum".  On failure return non-OK.  On success
+// fill *result and return OK.  zstd compressed blocks are uncompressed
+// with "dict" if it is not null.
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result);
+                 const BlockHandle& handle, BlockContents* result,
+                 ChecksumType checksum = kCRC32c,
+                 const port::ZstdDecompressionDict* dict = nullptr);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -0,0 +1,217 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/prefetching_iterator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// Entries read ahead, with their keys and values stored back to back.
+struct Batch {
+  struct Entry {
+    size_t offset;  // Of the key; the value follows it
+    size_t key_size;
+    size_t value_size;
+  };
+
+  std::string data;
+  std::vector<Entry> entries;
+};
+
+class PrefetchingIterator : public Iterator {
+ public:
+  PrefetchingIterator(Iterator* input, Env* env, size_t max_buffered_bytes)
+      : input_(input),
+        env_(env),
+        max_buffered_bytes_(std::max<size_t>(max_buffered_bytes, 1)),
+        batch_bytes_(std::max<size_t>(max_buffered_bytes / 4, 1)),
+        started_(false),
+        current_(nullptr),
+        index_(0),
+        cv_(&mu_),
+        buffered_bytes_(0),
+        stopping_(false),
+        done_(false) {}
+
+  PrefetchingIterator(const PrefetchingIterator&) = delete;
+  PrefetchingIterator& operator=(const PrefetchingIterator&) = delete;
+
+  ~PrefetchingIterator() override {
+    if (started_) {
+      MutexLock l(&mu_);
+      stopping_ = true;
+      cv_.SignalAll();
+      while (!done_) {
+        cv_.Wait();
+      }
+    }
+    delete current_;
+    for (Batch* batch : queue_) {
+      delete batch;
+    }
+    delete input_;
+  }
+
+  bool Valid() const override { return current_ != nullptr; }
+
+  void SeekToFirst() override {
+    if (started_) {
+      status_ = Status::NotSupported("prefetching iterator rewound");
+      return;
+    }
+    started_ = true;
+    env_->StartThread(&PrefetchingIterator::ReadAheadMain, this);
+    NextBatch();
+  }
+
+  void SeekToLast() override { NotSupported(); }
+  void Seek(const Slice& target) override { NotSupported(); }
+  void Prev() override { NotSupported(); }
+
+  void Next() override {
+    assert(Valid());
+    index_++;
+    if (index_ == current_->entries.size()) {
+      NextBatch();
+    }
+  }
+
+  Slice key() const override {
+    assert(Valid());
+    const Batch::Entry& e = current_->entries[index_];
+    return Slice(current_->data.data() + e.offset, e.key_size);
+  }
+
+  Slice value() const override {
+    assert(Valid());
+    const Batch::Entry& e = current_->entries[index_];
+    return Slice(current_->data.data() + e.offset + e.key_size, e.value_size);
+  }
+
+  Status status() const override {
+    if (!status_.ok()) {
+      return status_;
+    }
+    MutexLock l(&mu_);
+    return input_status_;
+  }
+
+ private:
+  static void ReadAheadMain(void* arg) {
+    reinterpret_cast<PrefetchingIterator*>(arg)->ReadAhead();
+  }
+
+  // Runs on the read-ahead thread, which is the only user of input_.
+  void ReadAhead() {
+    input_->SeekToFirst();
+    Batch* batch = new Batch;
+    while (input_->Valid()) {
+      const Slice key = input_->key();
+      const Slice value = input_->value();
+      batch->entries.push_back(
+          Batch::Entry{batch->data.size(), key.size(), value.size()});
+      batch->data.append(key.data(), key.size());
+      batch->data.append(value.data(), value.size());
+      input_->Next();
+      if (batch->data.size() >= batch_bytes_) {
+        if (!Hand(batch)) {
+          batch = nullptr;
+          break;
+        }
+        batch = new Batch;
+      }
+    }
+    if (batch != nullptr && !batch->entries.empty()) {
+      Hand(batch);
+    } else {
+      delete batch;
+    }
+
+    MutexLock l(&mu_);
+    input_status_ = input_->status();
+    done_ = true;
+    cv_.SignalAll();
+  }
+
+  // Queue "batch" once there is room for it.  Returns false, after
+  // deleting "batch", if the iterator is being deleted.
+  bool Hand(Batch* batch) {
+    const Status s = input_->status();
+    MutexLock l(&mu_);
+    while (!stopping_ && buffered_bytes_ >= max_buffered_bytes_) {
+      cv_.Wait();
+    }
+    input_status_ = s;
+    if (stopping_) {
+      delete batch;
+      return false;
+    }
+    queue_.push_back(batch);
+    buffered_bytes_ += batch->data.size();
+    cv_.SignalAll();
+    return true;
+  }
+
+  // Make the next queued batch current, waiting for it if necessary.
+  void NextBatch() {
+    delete current_;
+    current_ = nullptr;
+    index_ = 0;
+    MutexLock l(&mu_);
+    while (queue_.empty() && !done_) {
+      cv_.Wait();
+    }
+    if (!queue_.empty()) {
+      current_ = queue_.front();
+      queue_.pop_front();
+      buffered_bytes_ -= current_->data.size();
+      cv_.SignalAll();
+    }
+  }
+
+  void NotSupported() {
+    status_ = Status::NotSupported("prefetching iterator only moves forward");
+  }
+
+  Iterator* const input_;
+  Env* const env_;
+  const size_t max_buffered_bytes_;
+  const size_t batch_bytes_;
+
+  // Accessed only by the thread using the iterator
+  bool started_;
+  Batch* current_;  // nullptr at the end
+  size_t index_;    // Of the current entry in current_
+  Status status_;
+
+  mutable port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  std::deque<Batch*> queue_ GUARDED_BY(mu_);
+  size_t buffered_bytes_ GUARDED_BY(mu_);  // Data bytes of queue_
+  bool stopping_ GUARDED_BY(mu_);          // The iterator is being deleted
+  bool done_ GUARDED_BY(mu_);              // The read-ahead thread finished
+  Status input_status_ GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+Iterator* NewPrefetchingIterator(Iterator* input, Env* env,
+                                 size_t max_buffered_bytes) {
+  return new PrefetchingIterator(input, env, max_buffered_bytes);
+}
+
+}  // namespace leveldb
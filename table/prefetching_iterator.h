@@ -0,0 +1,31 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_PREFETCHING_ITERATOR_H_
+#define STORAGE_LEVELDB_TABLE_PREFETCHING_ITERATOR_H_
+
+#include <cstddef>
+
+namespace leveldb {
+
+class Env;
+class Iterator;
+
+// Return an iterator over the entries of "input" that reads them on a
+// thread of its own, started from "env" by the first SeekToFirst().  The
+// entries are copied in batches that are handed over while the next ones
+// are read, so the reads and block decompression of "input" overlap with
+// the work of the caller.  At most about "max_buffered_bytes" of entries
+// are read ahead.
+//
+// The result only moves forward: SeekToFirst() may be called once,
+// followed by Next(), and the other positioning methods fail with a
+// NotSupported status.  Takes ownership of "input" and deletes it when the
+// result is deleted.
+Iterator* NewPrefetchingIterator(Iterator* input, Env* env,
+                                 size_t max_buffered_bytes);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PREFETCHING_ITERATOR_H_
@@ -0,0 +1,118 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/properties_block.h"
+
+#include <cstdio>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+struct PropertyField {
+  const char* name;
+  uint64_t TableProperties::*field;
+};
+
+// Sorted by name, the order in which they are stored
+const PropertyField kPropertyFields[] = {
+    {"leveldb.compression", &TableProperties::compression},
+    {"leveldb.data.size", &TableProperties::data_size},
+    {"leveldb.filter.size", &TableProperties::filter_size},
+    {"leveldb.index.size", &TableProperties::index_size},
+    {"leveldb.num.data.blocks", &TableProperties::num_data_blocks},
+    {"leveldb.num.deletions", &TableProperties::num_deletions},
+    {"leveldb.num.entries", &TableProperties::num_entries},
+    {"leveldb.num.range.deletions", &TableProperties::num_range_deletions},
+    {"leveldb.raw.key.size", &TableProperties::raw_key_size},
+    {"leveldb.raw.value.size", &TableProperties::raw_value_size},
+};
+
+}  // namespace
+
+std::string EncodePropertiesBlock(const TableProperties& props) {
+  Options options;
+  options.comparator = BytewiseComparator();
+  BlockBuilder block(&options);
+  std::string value;
+  for (const PropertyField& f : kPropertyFields) {
+    value.clear();
+    PutVarint64(&value, props.*f.field);
+    block.Add(f.name, value);
+  }
+  return block.Finish().ToString();
+}
+
+Status DecodePropertiesBlock(const Slice& contents, TableProperties* props) {
+  *props = TableProperties();
+  BlockContents block_contents;
+  block_contents.data = contents;
+  block_contents.cachable = false;
+  block_contents.heap_allocated = false;
+  Block block(block_contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+  Status s;
+  for (iter->SeekToFirst(); iter->Valid() && s.ok(); iter->Next()) {
+    for (const PropertyField& f : kPropertyFields) {
+      if (iter->key() == Slice(f.name)) {
+        Slice input = iter->value();
+        if (!GetVarint64(&input, &(props->*f.field))) {
+          s = Status::Corruption("bad table property", f.name);
+        }
+        break;
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+  return s;
+}
+
+std::string TableProperties::ToString() const {
+  std::string result;
+  char buf[200];
+  const uint64_t raw_size = raw_key_size + raw_value_size;
+  std::snprintf(buf, sizeof(buf),
+                "entries: %llu\n"
+                "deletions: %llu\n"
+                "range deletions: %llu\n"
+                "data blocks: %llu\n",
+                static_cast<unsigned long long>(num_entries),
+                static_cast<unsigned long long>(num_deletions),
+                static_cast<unsigned long long>(num_range_deletions),
+                static_cast<unsigned long long>(num_data_blocks));
+  result.append(buf);
+  std::snprintf(buf, sizeof(buf),
+                "raw key size: %llu\n"
+                "raw value size: %llu\n"
+                "data size: %llu\n"
+                "index size: %llu\n"
+                "filter size: %llu\n",
+                static_cast<unsigned long long>(raw_key_size),
+                static_cast<unsigned long long>(raw_value_size),
+                static_cast<unsigned long long>(data_size),
+                static_cast<unsigned long long>(index_size),
+                static_cast<unsigned long long>(filter_size));
+  result.append(buf);
+  std::snprintf(buf, sizeof(buf),
+                "compression: %llu\n"
+                "compression ratio: %.2f\n",
+                static_cast<unsigned long long>(compression),
+                data_size == 0 ? 1.0 : static_cast<double>(raw_size) /
+                                           data_size);
+  result.append(buf);
+  return result;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,32 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The properties block of a table holds its TableProperties.  It is a
+// block whose entries map property names to varint64 values, sorted by
+// name.  Readers skip the names they do not know, so that properties can
+// be added without changing the format.
+
+#ifndef STORAGE_LEVELDB_TABLE_PROPERTIES_BLOCK_H_
+#define STORAGE_LEVELDB_TABLE_PROPERTIES_BLOCK_H_
+
+#include <string>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "leveldb/table_properties.h"
+
+namespace leveldb {
+
+// Name of the metaindex entry pointing at the properties block.
+static const char kPropertiesBlockName[] = "leveldb.properties";
+
+// Return the contents of the properties block that holds "props".
+std::string EncodePropertiesBlock(const TableProperties& props);
+
+// Parse the properties block "contents" into *props.
+Status DecodePropertiesBlock(const Slice& contents, TableProperties* props);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PROPERTIES_BLOCK_H_
@@ -4,14 +4,19 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/table_properties.h"
+#include "port/port.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/properties_block.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
@@ -22,6 +27,9 @@ struct Table::Rep {
     delete filter;
     delete[] filter_data;
     delete index_block;
+    delete range_del_block;
+    delete compression_dict;
+    delete properties;
   }
 
   Options options;
@@ -31,8 +39,15 @@ struct Table::Rep {
   FilterBlockReader* filter;
   const char* filter_data;
 
+  ChecksumType checksum;         // Of the blocks: saved from footer
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;  // nullptr if the table has no range tombstones
+
+  // nullptr unless the data blocks were compressed with a dictionary
+  port::ZstdDecompressionDict* compression_dict;
+
+  TableProperties* properties;  // nullptr if the table has none
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -42,10 +57,13 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     return Status::Corruption("file is too short to be an sstable");
   }
 
-  char footer_space[Footer::kEncodedLength];
+  // Footers with a checksum type are one byte longer
+  const size_t footer_size =
+      std::min<uint64_t>(size, Footer::kMaxEncodedLength);
+  char footer_space[Footer::kMaxEncodedLength];
   Slice footer_input;
-  Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
-                        &footer_input, footer_space);
+  Status s = file->Read(size - footer_size, footer_size, &footer_input,
+                        footer_space);
   if (!s.ok()) return s;
 
   Footer footer;
@@ -58,7 +76,8 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   if (options.paranoid_checks) {
     opt.verify_checksums = true;
   }
-  s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
+  s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents,
+                footer.checksum_type());
 
   if (s.ok()) {
     // We've successfully read the footer and the index block: we're
@@ -67,45 +86,74 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     Rep* rep = new Table::Rep;
     rep->options = options;
     rep->file = file;
+    rep->checksum = footer.checksum_type();
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->range_del_block = nullptr;
+    rep->compression_dict = nullptr;
+    rep->properties = nullptr;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
+Status Table::ReadMeta(const Footer& footer) {
+  // An empty metaindex block only holds its restart array.
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return Status::OK();  // No metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents,
+                       rep_->checksum);
+  if (!s.ok()) {
+    // Filters are optional, but the metaindex may point at range
+    // tombstones that are needed for correct reads.
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  iter->Seek(kCompressionDictBlockName);
+  if (iter->Valid() && iter->key() == Slice(kCompressionDictBlockName)) {
+    s = ReadCompressionDict(iter->value());
+  }
+  if (s.ok()) {
+    iter->Seek(kRangeDelBlockName);
+    if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+      s = ReadRangeDeletions(iter->value());
+    }
+  }
+  if (s.ok()) {
+    iter->Seek(kPropertiesBlockName);
+    if (iter->Valid() && iter->key() == Slice(kPropertiesBlockName)) {
+      ReadProperties(iter->value());
+    }
   }
   delete iter;
   delete meta;
+  return s;
 }
 
 void Table::ReadFilter(const Slice& filter_handle_value) {
@@ -122,7 +170,8 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
     opt.verify_checksums = true;
   }
   BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  Status s = ReadBlock(rep_->file, opt, filter_handle, &block, rep_->checksum);
+  if (!s.ok()) {
     return;
   }
   if (block.heap_allocated) {
@@ -131,6 +180,91 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+Status Table::ReadRangeDeletions(const Slice& range_del_handle_value) {
+  Slice v = range_del_handle_value;
+  BlockHandle range_del_handle;
+  Status s = range_del_handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Unlike filters, range tombstones are needed for correct reads, so
+  // failures are propagated and the block is always checksummed.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, range_del_handle, &block, rep_->checksum);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(block);
+  }
+  return s;
+}
+
+Status Table::ReadCompressionDict(const Slice& dict_handle_value) {
+  Slice v = dict_handle_value;
+  BlockHandle dict_handle;
+  Status s = dict_handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // The data blocks cannot be read without the dictionary.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, dict_handle, &block, rep_->checksum);
+  if (s.ok()) {
+    // The digested dictionary keeps its own copy
+    rep_->compression_dict =
+        new port::ZstdDecompressionDict(block.data.data(), block.data.size());
+    if (block.heap_allocated) {
+      delete[] block.data.data();
+    }
+  }
+  return s;
+}
+
+void Table::ReadProperties(const Slice& properties_handle_value) {
+  Slice v = properties_handle_value;
+  BlockHandle properties_handle;
+  if (!properties_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // Like filters, properties are optional, so failures are ignored.
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  Status s =
+      ReadBlock(rep_->file, opt, properties_handle, &block, rep_->checksum);
+  if (!s.ok()) {
+    return;
+  }
+  TableProperties* props = new TableProperties;
+  s = DecodePropertiesBlock(block.data, props);
+  if (block.heap_allocated) {
+    delete[] block.data.data();
+  }
+  if (s.ok()) {
+    rep_->properties = props;
+  } else {
+    delete props;
+  }
+}
+
+const TableProperties* Table::GetProperties() const {
+  return rep_->properties;
+}
+
+Iterator* Table::NewRangeDelIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
 Table::~Table() { delete rep_; }
 
 static void DeleteBlock(void* arg, void* ignored) {
@@ -174,7 +308,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(table->rep_->file, options, handle, &contents,
+                      table->rep_->checksum, table->rep_->compression_dict);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
@@ -184,7 +319,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(table->rep_->file, options, handle, &contents,
+                    table->rep_->checksum, table->rep_->compression_dict);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -258,6 +394,10 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
       // close to the whole file size for this case.
       result = rep_->metaindex_handle.offset();
     }
+  } else if (rep_->properties != nullptr) {
+    // key is past the last key in the file, so its data would begin
+    // right after the data blocks.
+    result = rep_->properties->data_size;
   } else {
     // key is past the last key in the file.  Approximate the offset
     // by returning the offset of the metaindex block (which is
@@ -4,26 +4,57 @@
 
 #include "leveldb/table_builder.h"
 
+#include <algorithm>
 #include <cassert>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/table_properties.h"
+#include "port/port.h"
+#include "table/block.h"
 #include "table/block_builder.h"
+#include "table/compression_worker_pool.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/properties_block.h"
 #include "util/coding.h"
-#include "util/crc32c.h"
 
 namespace leveldb {
 
+namespace {
+
+// Return the compression level of options.compression, if it has levels.
+int CompressionLevel(const Options& options) {
+  return options.compression == kLZ4HCCompression
+             ? options.lz4hc_compression_level
+             : options.zstd_compression_level;
+}
+
+// Return the checksum to write the blocks of a table with: the one of
+// "options" if this build supports it, else kCRC32c.
+ChecksumType SupportedChecksum(const Options& options) {
+  uint32_t unused;
+  return ComputeBlockChecksum(options.checksum, "", 0, kNoCompression, &unused)
+             ? options.checksum
+             : kCRC32c;
+}
+
+}  // namespace
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
         file(f),
         offset(0),
+        checksum(SupportedChecksum(opt)),
         data_block(&options),
         index_block(&index_block_options),
         num_entries(0),
@@ -31,14 +62,28 @@ struct TableBuilder::Rep {
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        buffering(opt.compression == kZstdCompression &&
+                  opt.zstd_max_dict_bytes > 0),
+        zstd_dict(nullptr),
+        workers(nullptr),
+        owns_workers(false),
+        in_flight_bytes(0) {
     index_block_options.block_restart_interval = 1;
   }
 
+  // True if data blocks are written later than Flush() finishes them, in
+  // which case their index entries and filter keys are added when they
+  // are written rather than by Add().
+  bool holding_back_blocks() const {
+    return buffering || workers != nullptr;
+  }
+
   Options options;
   Options index_block_options;
   WritableFile* file;
   uint64_t offset;
+  const ChecksumType checksum;
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
@@ -46,6 +91,7 @@ struct TableBuilder::Rep {
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  TableProperties props;  // Written to the properties block by Finish()
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -55,23 +101,71 @@ struct TableBuilder::Rep {
   // entries in the first block and < all entries in subsequent
   // blocks.
   //
-  // Invariant: r->pending_index_entry is true only if data_block is empty.
+  // Invariant: r->pending_index_entry is true only if data_block is empty,
+  // unless the blocks are held back, in which case it refers to the last
+  // block written and is only used by WriteHeldBackBlock() and Finish().
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
   std::string compressed_output;
+  port::ZstdCompressionContext zstd_ctx;  // For blocks compressed inline
+
+  // Range tombstones, sorted and written out by Finish().
+  std::vector<std::pair<std::string, std::string>> range_dels;
+
+  // While "buffering", the data blocks are held back uncompressed in
+  // buffered_data until there are enough of them to train the zstd
+  // dictionary that all of them are compressed with.  Their index entries
+  // and filter keys are added when they are written.
+  bool buffering;
+  std::string buffered_data;
+  std::vector<size_t> buffered_block_sizes;
+  std::string compression_dict;          // Empty if no dictionary
+  port::ZstdCompressionDict* zstd_dict;  // nullptr if no dictionary
+
+  // Last key of the data blocks written after they were held back
+  std::string held_back_last_key;
+
+  // With parallel compression, the data blocks handed to "workers" that
+  // have not been written yet, in order.
+  CompressionWorkerPool* workers;  // nullptr if blocks are compressed inline
+  bool owns_workers;               // Whether started for this builder
+  std::deque<CompressionJob*> in_flight;
+  size_t in_flight_bytes;  // Sum of their uncompressed sizes
 };
 
+// Return the number of bytes of data blocks to train a dictionary on.
+static size_t MaxTrainBytes(const Options& options) {
+  return options.zstd_max_train_bytes != 0
+             ? options.zstd_max_train_bytes
+             : size_t{100} * options.zstd_max_dict_bytes;
+}
+
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
+    : TableBuilder(options, file, nullptr) {}
+
+TableBuilder::TableBuilder(const Options& options, WritableFile* file,
+                           CompressionWorkerPool* compression_workers)
     : rep_(new Rep(options, file)) {
   if (rep_->filter_block != nullptr) {
     rep_->filter_block->StartBlock(0);
   }
+  if (options.compression == kNoCompression) {
+    return;
+  }
+  if (compression_workers != nullptr) {
+    rep_->workers = compression_workers;
+  } else if (options.parallel_compression_threads > 0) {
+    rep_->workers = new CompressionWorkerPool(
+        options.env, options.parallel_compression_threads);
+    rep_->owns_workers = true;
+  }
 }
 
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->zstd_dict;
   delete rep_;
 }
 
@@ -99,7 +193,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
 
-  if (r->pending_index_entry) {
+  if (r->pending_index_entry && !r->holding_back_blocks()) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
     std::string handle_encoding;
@@ -108,12 +202,14 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_index_entry = false;
   }
 
-  if (r->filter_block != nullptr) {
+  if (r->filter_block != nullptr && !r->holding_back_blocks()) {
     r->filter_block->AddKey(key);
   }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
+  r->props.raw_key_size += key.size();
+  r->props.raw_value_size += value.size();
   r->data_block.Add(key, value);
 
   const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
@@ -127,9 +223,25 @@ void TableBuilder::Flush() {
   assert(!r->closed);
   if (!ok()) return;
   if (r->data_block.empty()) return;
-  assert(!r->pending_index_entry);
+  assert(!r->pending_index_entry || r->holding_back_blocks());
+  if (r->buffering) {
+    Slice raw = r->data_block.Finish();
+    r->buffered_data.append(raw.data(), raw.size());
+    r->buffered_block_sizes.push_back(raw.size());
+    r->data_block.Reset();
+    if (r->buffered_data.size() >= MaxTrainBytes(r->options)) {
+      WriteBufferedBlocks();
+    }
+    return;
+  }
+  if (r->workers != nullptr) {
+    WriteDataBlock(r->data_block.Finish());
+    r->data_block.Reset();
+    return;
+  }
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
+    r->props.num_data_blocks++;
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
@@ -145,48 +257,157 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
-
-  Slice block_contents;
-  CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
+  // Only data blocks use the dictionary, since reading it takes the
+  // other blocks.
+  CompressAndWriteBlock(block->Finish(), block == &r->data_block, handle);
+  block->Reset();
+}
 
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
+void TableBuilder::CompressAndWriteBlock(const Slice& raw, bool use_dict,
+                                         BlockHandle* handle) {
+  Rep* r = rep_;
+  const CompressionType type = CompressBlock(
+      r->options.compression, CompressionLevel(r->options),
+      use_dict ? r->zstd_dict : nullptr, &r->zstd_ctx, raw,
+      &r->compressed_output);
+  WriteRawBlock(type == kNoCompression ? raw : Slice(r->compressed_output),
+                type, handle);
+  r->compressed_output.clear();
+}
+
+void TableBuilder::WriteBufferedBlocks() {
+  Rep* r = rep_;
+  assert(r->buffering);
+  r->buffering = false;
+  if (port::Zstd_TrainDictionary(r->buffered_data, r->buffered_block_sizes,
+                                 r->options.zstd_max_dict_bytes,
+                                 &r->compression_dict)) {
+    r->zstd_dict = new port::ZstdCompressionDict(
+        r->compression_dict.data(), r->compression_dict.size(),
+        r->options.zstd_compression_level);
+  }
+
+  size_t offset = 0;
+  for (size_t i = 0; i < r->buffered_block_sizes.size() && ok(); i++) {
+    WriteDataBlock(
+        Slice(r->buffered_data.data() + offset, r->buffered_block_sizes[i]));
+    offset += r->buffered_block_sizes[i];
+  }
+  if (ok() && !r->holding_back_blocks() && r->pending_index_entry) {
+    // From now on Add() takes care of the index entries, starting with
+    // the one of the last block.
+    assert(r->held_back_last_key == r->last_key);
+    r->status = r->file->Flush();
+  }
+  std::string().swap(r->buffered_data);
+  std::vector<size_t>().swap(r->buffered_block_sizes);
+}
+
+void TableBuilder::WriteDataBlock(const Slice& raw) {
+  Rep* r = rep_;
+  if (r->workers == nullptr) {
+    const CompressionType type = CompressBlock(
+        r->options.compression, CompressionLevel(r->options), r->zstd_dict,
+        &r->zstd_ctx, raw, &r->compressed_output);
+    WriteHeldBackBlock(
+        raw, type == kNoCompression ? raw : Slice(r->compressed_output), type);
+    r->compressed_output.clear();
+    return;
+  }
+
+  CompressionJob* job = new CompressionJob;
+  job->raw.assign(raw.data(), raw.size());
+  job->type = r->options.compression;
+  job->level = CompressionLevel(r->options);
+  job->dict = r->zstd_dict;
+  r->in_flight.push_back(job);
+  r->in_flight_bytes += raw.size();
+  r->workers->Schedule(job);
+  WriteCompressedBlocks(2 * r->workers->num_threads());
+}
+
+void TableBuilder::WriteCompressedBlocks(size_t max_in_flight) {
+  Rep* r = rep_;
+  bool written = false;
+  while (ok() && !r->in_flight.empty()) {
+    CompressionJob* job = r->in_flight.front();
+    if (!r->workers->Done(job, r->in_flight.size() > max_in_flight)) {
       break;
     }
+    r->in_flight.pop_front();
+    r->in_flight_bytes -= job->raw.size();
+    WriteHeldBackBlock(job->raw,
+                       job->type == kNoCompression ? Slice(job->raw)
+                                                   : Slice(job->compressed),
+                       job->type);
+    delete job;
+    written = true;
+  }
+  if (ok() && written) {
+    r->status = r->file->Flush();
+  }
+}
 
-    case kZstdCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Zstd_Compress(r->options.zstd_compression_level, raw.data(),
-                              raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Zstd not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
-      break;
+void TableBuilder::WriteHeldBackBlock(const Slice& raw,
+                                      const Slice& block_contents,
+                                      CompressionType type) {
+  Rep* r = rep_;
+  assert(ok());
+
+  // Add the index entry of the previous block and the filter keys that
+  // Add() held back, reading the keys from the block.
+  BlockContents contents;
+  contents.data = raw;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewIterator(r->options.comparator);
+  iter->SeekToFirst();
+  if (r->pending_index_entry) {
+    r->options.comparator->FindShortestSeparator(&r->held_back_last_key,
+                                                 iter->key());
+    std::string handle_encoding;
+    r->pending_handle.EncodeTo(&handle_encoding);
+    r->index_block.Add(r->held_back_last_key, Slice(handle_encoding));
+    r->pending_index_entry = false;
+  }
+  for (; iter->Valid(); iter->Next()) {
+    if (r->filter_block != nullptr) {
+      r->filter_block->AddKey(iter->key());
     }
+    r->held_back_last_key.assign(iter->key().data(), iter->key().size());
+  }
+  delete iter;
+
+  WriteRawBlock(block_contents, type, &r->pending_handle);
+  if (ok()) {
+    // Like after Flush(), the index entry of the block waits for the
+    // first key of the next one.
+    r->props.num_data_blocks++;
+    r->pending_index_entry = true;
+  }
+  if (r->filter_block != nullptr) {
+    r->filter_block->StartBlock(r->offset);
   }
-  WriteRawBlock(block_contents, type, handle);
-  r->compressed_output.clear();
-  block->Reset();
+}
+
+void TableBuilder::ReleaseCompressionWorkers() {
+  Rep* r = rep_;
+  if (r->workers == nullptr) {
+    return;
+  }
+  // The blocks that are not written are dropped, but the workers may
+  // still be compressing them.
+  for (CompressionJob* job : r->in_flight) {
+    r->workers->Done(job, /*wait=*/true);
+    delete job;
+  }
+  r->in_flight.clear();
+  r->in_flight_bytes = 0;
+  if (r->owns_workers) {
+    delete r->workers;
+  }
+  r->workers = nullptr;
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -198,9 +419,13 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   if (r->status.ok()) {
     char trailer[kBlockTrailerSize];
     trailer[0] = type;
-    uint32_t crc = crc32c::Value(block_contents.data(), block_contents.size());
-    crc = crc32c::Extend(crc, trailer, 1);  // Extend crc to cover block type
-    EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+    uint32_t checksum = 0;
+    const bool supported =
+        ComputeBlockChecksum(r->checksum, block_contents.data(),
+                             block_contents.size(), trailer[0], &checksum);
+    assert(supported);  // Checked by SupportedChecksum()
+    (void)supported;
+    EncodeFixed32(trailer + 1, checksum);
     r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
     if (r->status.ok()) {
       r->offset += block_contents.size() + kBlockTrailerSize;
@@ -208,39 +433,68 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   }
 }
 
+void TableBuilder::AddRangeDeletion(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_dels.emplace_back(key.ToString(), value.ToString());
+}
+
 Status TableBuilder::status() const { return rep_->status; }
 
 Status TableBuilder::Finish() {
   Rep* r = rep_;
   Flush();
   assert(!r->closed);
+  if (ok() && r->buffering) {
+    WriteBufferedBlocks();
+  }
+  if (ok() && r->workers != nullptr) {
+    WriteCompressedBlocks(0);
+  }
+  ReleaseCompressionWorkers();
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      range_del_block_handle, compression_dict_handle, properties_handle;
+
+  // The data blocks come first
+  r->props.data_size = r->offset;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+    r->props.filter_size = filter_block_handle.size();
   }
 
-  // Write metaindex block
-  if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
-      key.append(r->options.filter_policy->Name());
-      std::string handle_encoding;
-      filter_block_handle.EncodeTo(&handle_encoding);
-      meta_index_block.Add(key, handle_encoding);
-    }
+  // Write compression dictionary block
+  if (ok() && !r->compression_dict.empty()) {
+    WriteRawBlock(r->compression_dict, kNoCompression,
+                  &compression_dict_handle);
+  }
 
-    // TODO(postrelease): Add stats and other meta blocks
-    WriteBlock(&meta_index_block, &metaindex_block_handle);
+  // Write range deletion block
+  if (ok() && !r->range_dels.empty()) {
+    const Comparator* cmp = r->options.comparator;
+    std::sort(r->range_dels.begin(), r->range_dels.end(),
+              [cmp](const std::pair<std::string, std::string>& a,
+                    const std::pair<std::string, std::string>& b) {
+                return cmp->Compare(a.first, b.first) < 0;
+              });
+    BlockBuilder range_del_block(&r->options);
+    for (size_t i = 0; i < r->range_dels.size(); i++) {
+      if (i > 0 && cmp->Compare(r->range_dels[i - 1].first,
+                                r->range_dels[i].first) == 0) {
+        continue;  // Same start and sequence number: same tombstone
+      }
+      range_del_block.Add(r->range_dels[i].first, r->range_dels[i].second);
+      r->props.num_range_deletions++;
+    }
+    WriteBlock(&range_del_block, &range_del_block_handle);
   }
 
-  // Write index block
+  // Write index block, ahead of the properties block that records its size
   if (ok()) {
     if (r->pending_index_entry) {
       r->options.comparator->FindShortSuccessor(&r->last_key);
@@ -250,11 +504,56 @@ Status TableBuilder::Finish() {
       r->pending_index_entry = false;
     }
     WriteBlock(&r->index_block, &index_block_handle);
+    r->props.index_size = index_block_handle.size();
+  }
+
+  // Write properties block
+  if (ok()) {
+    r->props.num_entries = r->num_entries;
+    r->props.compression = r->options.compression;
+    WriteRawBlock(EncodePropertiesBlock(r->props), kNoCompression,
+                  &properties_handle);
+  }
+
+  // Write metaindex block
+  if (ok()) {
+    // Readers look up the metaindex with the bytewise comparator
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
+    if (r->filter_block != nullptr) {
+      // Add mapping from "filter.Name" to location of filter data
+      std::string key = "filter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (!r->compression_dict.empty()) {
+      // "leveldb.CompressionDict" sorts after every "filter.Name" key
+      std::string handle_encoding;
+      compression_dict_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kCompressionDictBlockName, handle_encoding);
+    }
+    if (!r->range_dels.empty()) {
+      // "leveldb.RangeDeletion" sorts after the keys above
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+    }
+    {
+      // "leveldb.properties" sorts after every other key
+      std::string handle_encoding;
+      properties_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kPropertiesBlockName, handle_encoding);
+    }
+    WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
   // Write footer
   if (ok()) {
     Footer footer;
+    footer.set_checksum_type(r->checksum);
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
     std::string footer_encoding;
@@ -270,11 +569,23 @@ Status TableBuilder::Finish() {
 void TableBuilder::Abandon() {
   Rep* r = rep_;
   assert(!r->closed);
+  ReleaseCompressionWorkers();
   r->closed = true;
 }
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
-uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+uint64_t TableBuilder::NumRangeDeletions() const {
+  return rep_->range_dels.size();
+}
+
+void TableBuilder::SetNumDeletions(uint64_t n) {
+  assert(!rep_->closed);
+  rep_->props.num_deletions = n;
+}
+
+uint64_t TableBuilder::FileSize() const {
+  return rep_->offset + rep_->buffered_data.size() + rep_->in_flight_bytes;
+}
 
 }  // namespace leveldb
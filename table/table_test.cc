@@ -5,7 +5,9 @@
 #include "leveldb/table.h"
 
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/dbformat.h"
@@ -13,11 +15,14 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/block_builder.h"
+#include "table/compression_worker_pool.h"
 #include "table/format.h"
 #include "util/random.h"
 #include "util/testutil.h"
@@ -639,6 +644,63 @@ TEST_F(Harness, ZeroRestartPointsInBlock) {
   delete iter;
 }
 
+// Reverse scans reuse the entries decoded for the current restart
+// interval; make sure mixing directions and seeks keeps them consistent.
+TEST(BlockTest, ReverseScanAcrossRestartIntervals) {
+  Options options;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 37; i++) {
+    char buf[20];
+    std::snprintf(buf, sizeof(buf), "key%06d", i * 3);
+    keys.push_back(buf);
+    builder.Add(keys.back(), "v" + keys.back());
+  }
+  std::string data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+
+  int i = static_cast<int>(keys.size()) - 1;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev(), i--) {
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    ASSERT_EQ("v" + keys[i], iter->value().ToString());
+  }
+  ASSERT_EQ(-1, i);
+
+  Random rnd(test::RandomSeed());
+  iter->Seek(keys[20]);
+  i = 20;
+  for (int step = 0; step < 1000; step++) {
+    switch (rnd.Uniform(4)) {
+      case 0:
+        i = rnd.Uniform(keys.size());
+        iter->Seek(keys[i]);
+        break;
+      case 1:
+        if (i + 1 < static_cast<int>(keys.size())) {
+          iter->Next();
+          i++;
+        }
+        break;
+      default:
+        if (i > 0) {
+          iter->Prev();
+          i--;
+        }
+        break;
+    }
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    ASSERT_EQ("v" + keys[i], iter->value().ToString());
+  }
+  delete iter;
+}
+
 // Test the empty key
 TEST_F(Harness, SimpleEmptyKey) {
   for (int i = 0; i < kNumTestArgs; i++) {
@@ -785,6 +847,173 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+// Return the contents of a table of "n" compressible entries built with
+// "options".
+static std::string BuildTableContents(const Options& options, int n) {
+  Random rnd(301);
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  std::string value;
+  for (int i = 0; i < n; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    builder.Add(key, test::CompressibleString(&rnd, 0.5, 100, &value));
+  }
+  EXPECT_LEVELDB_OK(builder.Finish());
+  EXPECT_EQ(sink.contents().size(), builder.FileSize());
+  return sink.contents();
+}
+
+TEST(TableTest, ParallelCompression) {
+  std::unique_ptr<const FilterPolicy> filter_policy(NewBloomFilterPolicy(10));
+  for (int use_dict = 0; use_dict < 2; use_dict++) {
+    Options options;
+    options.block_size = 256;
+    options.compression = kZstdCompression;
+    options.filter_policy = filter_policy.get();
+    options.zstd_max_dict_bytes = use_dict ? 1024 : 0;
+    options.zstd_max_train_bytes = 16 << 10;
+    const std::string serial = BuildTableContents(options, 2000);
+    for (int threads : {1, 4}) {
+      options.parallel_compression_threads = threads;
+      const std::string parallel = BuildTableContents(options, 2000);
+
+      // The blocks are compressed alike and written in the same order,
+      // with the same index entries and filters.
+      ASSERT_EQ(serial.size(), parallel.size());
+      ASSERT_TRUE(serial == parallel);
+    }
+  }
+}
+
+TEST(TableTest, SharedCompressionWorkers) {
+  Options options;
+  options.block_size = 256;
+  options.compression = kZstdCompression;
+  const std::string serial = BuildTableContents(options, 2000);
+
+  // Builders interleave their blocks on the threads of one pool, and one
+  // of them is abandoned with blocks still being compressed.
+  CompressionWorkerPool workers(options.env, 2);
+  StringSink sinks[2], abandoned_sink;
+  TableBuilder builder0(options, &sinks[0], &workers);
+  TableBuilder builder1(options, &sinks[1], &workers);
+  TableBuilder abandoned(options, &abandoned_sink, &workers);
+  TableBuilder* builders[] = {&builder0, &builder1, &abandoned};
+  Random rnd(301);
+  std::string value;
+  for (int i = 0; i < 2000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    test::CompressibleString(&rnd, 0.5, 100, &value);
+    for (TableBuilder* builder : builders) {
+      builder->Add(key, value);
+    }
+  }
+  abandoned.Abandon();
+  ASSERT_LEVELDB_OK(builder0.Finish());
+  ASSERT_LEVELDB_OK(builder1.Finish());
+  for (const StringSink& sink : sinks) {
+    ASSERT_TRUE(serial == sink.contents());
+  }
+}
+
+static bool ChecksumSupported(ChecksumType type) {
+  uint32_t unused;
+  return ComputeBlockChecksum(type, "", 0, kNoCompression, &unused);
+}
+
+TEST(TableTest, ChecksumType) {
+  for (ChecksumType checksum : {kCRC32c, kXXH3}) {
+    Options options;
+    options.block_size = 256;
+    options.compression = kNoCompression;
+    options.checksum = checksum;
+    std::string contents = BuildTableContents(options, 200);
+
+    // Unsupported checksums fall back to crc32c, whose tables keep the
+    // original footer.
+    const ChecksumType expected =
+        ChecksumSupported(checksum) ? checksum : kCRC32c;
+    Footer footer;
+    Slice input(contents);
+    ASSERT_LEVELDB_OK(footer.DecodeFrom(&input));
+    ASSERT_EQ(expected, footer.checksum_type());
+    ASSERT_EQ(expected == kCRC32c ? Footer::kEncodedLength
+                                  : Footer::kMaxEncodedLength,
+              contents.size() - footer.metaindex_handle().offset() -
+                  footer.metaindex_handle().size() - kBlockTrailerSize);
+
+    ReadOptions read_options;
+    read_options.verify_checksums = true;
+    for (int corrupt = 0; corrupt < 2; corrupt++) {
+      if (corrupt) {
+        contents[10] ^= 0x80;  // Inside the first data block
+      }
+      StringSource* source = new StringSource(contents);
+      Table* table = nullptr;
+      ASSERT_LEVELDB_OK(
+          Table::Open(options, source, contents.size(), &table));
+      Iterator* iter = table->NewIterator(read_options);
+      int count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+      }
+      if (corrupt) {
+        // The entries of the corrupted block are skipped
+        ASSERT_TRUE(iter->status().IsCorruption());
+        ASSERT_LT(count, 200);
+      } else {
+        ASSERT_LEVELDB_OK(iter->status());
+        ASSERT_EQ(200, count);
+      }
+      delete iter;
+      delete table;
+      delete source;
+    }
+  }
+}
+
+TEST(TableTest, Properties) {
+  std::unique_ptr<const FilterPolicy> filter_policy(NewBloomFilterPolicy(10));
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.filter_policy = filter_policy.get();
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < 100; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    builder.Add(key, std::string(50, 'v'));
+  }
+  builder.AddRangeDeletion("key000010", "key000020");
+  builder.SetNumDeletions(7);
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  StringSource source(sink.contents());
+  Table* table = nullptr;
+  ASSERT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &table));
+  const TableProperties* props = table->GetProperties();
+  ASSERT_TRUE(props != nullptr);
+  ASSERT_EQ(100, props->num_entries);
+  ASSERT_EQ(7, props->num_deletions);
+  ASSERT_EQ(1, props->num_range_deletions);
+  ASSERT_EQ(900, props->raw_key_size);
+  ASSERT_EQ(5000, props->raw_value_size);
+  ASSERT_EQ(kNoCompression, props->compression);
+  ASSERT_GT(props->num_data_blocks, 1);
+  ASSERT_GT(props->data_size, props->raw_value_size);
+  ASSERT_GT(props->index_size, 0);
+  ASSERT_GT(props->filter_size, 0);
+  ASSERT_LT(props->data_size, sink.contents().size());
+
+  // Keys past the end of the table start at the end of the data blocks
+  ASSERT_EQ(props->data_size, table->ApproximateOffsetOf("zzz"));
+  delete table;
+}
+
 static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -792,6 +1021,10 @@ static bool CompressionSupported(CompressionType type) {
     return port::Snappy_Compress(in.data(), in.size(), &out);
   } else if (type == kZstdCompression) {
     return port::Zstd_Compress(/*level=*/1, in.data(), in.size(), &out);
+  } else if (type == kLZ4Compression) {
+    return port::Lz4_Compress(in.data(), in.size(), &out);
+  } else if (type == kLZ4HCCompression) {
+    return port::Lz4hc_Compress(/*level=*/9, in.data(), in.size(), &out);
   }
   return false;
 }
@@ -801,7 +1034,8 @@ class CompressionTableTest
 
 INSTANTIATE_TEST_SUITE_P(CompressionTests, CompressionTableTest,
                          ::testing::Values(kSnappyCompression,
-                                           kZstdCompression));
+                                           kZstdCompression, kLZ4Compression,
+                                           kLZ4HCCompression));
 
 TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
   CompressionType type = ::testing::get<0>(GetParam());
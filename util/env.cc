@@ -22,6 +22,24 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+MmapBudget* Env::NewMmapBudget(uint64_t capacity) { return nullptr; }
+
+Status Env::NewMmapRandomAccessFile(const std::string& fname,
+                                    MmapBudget* budget,
+                                    RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
 Status Env::RemoveDir(const std::string& dirname) { return DeleteDir(dirname); }
 Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 
@@ -32,8 +50,16 @@ SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+void RandomAccessFile::Hint(AccessPattern pattern) {}
+
+MmapBudget::~MmapBudget() = default;
+
 WritableFile::~WritableFile() = default;
 
+Status WritableFile::RangeSync(uint64_t offset, uint64_t nbytes) {
+  return Status::OK();
+}
+
 Logger::~Logger() = default;
 
 FileLock::~FileLock() = default;
@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -58,6 +59,18 @@ constexpr const int kOpenBaseFlags = 0;
 
 constexpr const size_t kWritableFileBufferSize = 65536;
 
+// Offsets, sizes and buffer addresses of direct I/O must be multiples of
+// the logical block size of the device, which is at most this.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+// Bytes buffered by files written with direct I/O.
+constexpr const size_t kDirectWritableFileBufferSize = 1 << 20;
+
+// Returns |n| rounded up to a multiple of kDirectIOAlignment.
+uint64_t RoundUpToDirectIOAlignment(uint64_t n) {
+  return (n + kDirectIOAlignment - 1) & ~uint64_t{kDirectIOAlignment - 1};
+}
+
 Status PosixError(const std::string& context, int error_number) {
   if (error_number == ENOENT) {
     return Status::NotFound(context, std::strerror(error_number));
@@ -230,6 +243,119 @@ class PosixRandomAccessFile final : public RandomAccessFile {
   const std::string filename_;
 };
 
+#if defined(O_DIRECT)
+// Implements random read access in a file opened with O_DIRECT.
+//
+// Reads are widened to kDirectIOAlignment boundaries and go through an
+// aligned buffer, since the kernel transfers the data straight into it.
+//
+// Instances of this class are thread-safe, as required by the RandomAccessFile
+// API. Instances are immutable and Read() only calls thread-safe library
+// functions.
+class PosixDirectRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
+  // instance, and will be used to determine if the file is kept open.
+  PosixDirectRandomAccessFile(std::string filename, int fd,
+                              Limiter* fd_limiter)
+      : has_permanent_fd_(fd_limiter->Acquire()),
+        fd_(has_permanent_fd_ ? fd : -1),
+        fd_limiter_(fd_limiter),
+        filename_(std::move(filename)) {
+    if (!has_permanent_fd_) {
+      assert(fd_ == -1);
+      ::close(fd);  // The file will be opened on every read.
+    }
+  }
+
+  ~PosixDirectRandomAccessFile() override {
+    if (has_permanent_fd_) {
+      assert(fd_ != -1);
+      ::close(fd_);
+      fd_limiter_->Release();
+    }
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    *result = Slice(scratch, 0);
+    const uint64_t aligned_offset =
+        offset & ~uint64_t{kDirectIOAlignment - 1};
+    const size_t aligned_size =
+        RoundUpToDirectIOAlignment(offset + n) - aligned_offset;
+    void* buf;
+    if (::posix_memalign(&buf, kDirectIOAlignment, aligned_size) != 0) {
+      return Status::IOError(filename_, "cannot allocate read buffer");
+    }
+
+    int fd = fd_;
+    if (!has_permanent_fd_) {
+      fd = ::open(filename_.c_str(), O_RDONLY | O_DIRECT | kOpenBaseFlags);
+      if (fd < 0) {
+        std::free(buf);
+        return PosixError(filename_, errno);
+      }
+    }
+
+    assert(fd != -1);
+
+    Status status;
+    size_t read_size = 0;
+    while (read_size < aligned_size) {
+      ssize_t read_result =
+          ::pread(fd, reinterpret_cast<char*>(buf) + read_size,
+                  aligned_size - read_size,
+                  static_cast<off_t>(aligned_offset + read_size));
+      if (read_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        status = PosixError(filename_, errno);
+        break;
+      }
+      if (read_result == 0) {
+        break;  // End of file
+      }
+      read_size += read_result;
+    }
+    if (status.ok()) {
+      const size_t skip = offset - aligned_offset;
+      const size_t size = read_size > skip ? std::min(n, read_size - skip) : 0;
+      std::memcpy(scratch, reinterpret_cast<char*>(buf) + skip, size);
+      *result = Slice(scratch, size);
+    }
+    std::free(buf);
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+    return status;
+  }
+
+ private:
+  const bool has_permanent_fd_;  // If false, the file is opened on every read.
+  const int fd_;                 // -1 if has_permanent_fd_ is false.
+  Limiter* const fd_limiter_;
+  const std::string filename_;
+};
+#endif  // defined(O_DIRECT)
+
+// Returns the madvise() advice for reading a mapping with |pattern|.
+int MadviseAdvice(RandomAccessFile::AccessPattern pattern) {
+  switch (pattern) {
+    case RandomAccessFile::kRandom:
+      return MADV_RANDOM;
+    case RandomAccessFile::kSequential:
+      return MADV_SEQUENTIAL;
+    case RandomAccessFile::kWillNeed:
+      return MADV_WILLNEED;
+    case RandomAccessFile::kNormal:
+      break;
+  }
+  return MADV_NORMAL;
+}
+
 // Implements random read access in a file using mmap().
 //
 // Instances of this class are thread-safe, as required by the RandomAccessFile
@@ -267,6 +393,10 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  void Hint(AccessPattern pattern) override {
+    ::madvise(static_cast<void*>(mmap_base_), length_, MadviseAdvice(pattern));
+  }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -274,6 +404,259 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   const std::string filename_;
 };
 
+class PosixBudgetedMmapFile;
+
+// Number of reads of an unmapped file, made with system calls, before it
+// may take the place of mapped files.  Without this, a working set larger
+// than the budget would map and unmap files on almost every read, which
+// costs several times more than reading with system calls.
+constexpr const int kUnmappedReadsBeforeEviction = 64;
+
+// Maps the files opened with it while their total size fits in the
+// capacity, unmapping the least recently read files to make room.
+//
+// Recency is tracked with a clock that advances every time a file is
+// mapped, so that reads of mapped files only write to the file they read.
+class PosixMmapBudget final : public MmapBudget {
+ public:
+  explicit PosixMmapBudget(uint64_t capacity)
+      : capacity_(capacity), mapped_bytes_(0), clock_(0) {}
+
+  ~PosixMmapBudget() override { assert(mapped_files_.empty()); }
+
+  uint64_t Capacity() const override { return capacity_; }
+
+  uint64_t MappedBytes() const override LOCKS_EXCLUDED(mu_) {
+    mu_.Lock();
+    const uint64_t result = mapped_bytes_;
+    mu_.Unlock();
+    return result;
+  }
+
+ private:
+  friend class PosixBudgetedMmapFile;
+
+  // Maps |file| unless it is mapped already or cannot fit.  Other files
+  // are only unmapped to make room if |file| was read enough times since
+  // it was last mapped.
+  void Map(const PosixBudgetedMmapFile* file) LOCKS_EXCLUDED(mu_);
+
+  // Sets the advice for later reads of |file|, or, for kWillNeed, starts
+  // reading its mapping ahead.
+  void Advise(const PosixBudgetedMmapFile* file,
+              RandomAccessFile::AccessPattern pattern) LOCKS_EXCLUDED(mu_);
+
+  // Unmaps |file| if it is mapped.  Called when |file| is destroyed.
+  void Release(const PosixBudgetedMmapFile* file) LOCKS_EXCLUDED(mu_);
+
+  void Unmap(const PosixBudgetedMmapFile* file) EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const uint64_t capacity_;
+
+  mutable port::Mutex mu_;
+  uint64_t mapped_bytes_ GUARDED_BY(mu_);
+  std::set<const PosixBudgetedMmapFile*> mapped_files_ GUARDED_BY(mu_);
+  std::atomic<uint64_t> clock_;
+};
+
+// Implements random read access in a file through a mapping that its
+// PosixMmapBudget maps on demand and may unmap at any time.
+//
+// Reads pin the mapping while they copy out of it, and unmapping waits for
+// the pins to go away.  Reads that find the file unmapped, and that cannot
+// map it, fall back to pread().
+class PosixBudgetedMmapFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|. |budget| and |fd_limiter|
+  // must outlive this instance, and |fd_limiter| will be used to determine
+  // if the file is kept open.
+  PosixBudgetedMmapFile(std::string filename, int fd, uint64_t length,
+                        PosixMmapBudget* budget, Limiter* fd_limiter)
+      : mmap_base_(nullptr),
+        pins_(0),
+        last_read_(0),
+        unmapped_reads_(0),
+        advice_(kNormal),
+        has_permanent_fd_(fd_limiter->Acquire()),
+        fd_(has_permanent_fd_ ? fd : -1),
+        length_(length),
+        budget_(budget),
+        fd_limiter_(fd_limiter),
+        filename_(std::move(filename)) {
+    if (!has_permanent_fd_) {
+      assert(fd_ == -1);
+      ::close(fd);  // The file will be opened on every unmapped read.
+    }
+  }
+
+  ~PosixBudgetedMmapFile() override {
+    budget_->Release(this);
+    if (has_permanent_fd_) {
+      assert(fd_ != -1);
+      ::close(fd_);
+      fd_limiter_->Release();
+    }
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (offset + n > length_) {
+      *result = Slice();
+      return PosixError(filename_, EINVAL);
+    }
+
+    if (!ReadMapped(offset, n, scratch)) {
+      unmapped_reads_.fetch_add(1, std::memory_order_relaxed);
+      budget_->Map(this);
+      if (!ReadMapped(offset, n, scratch)) {
+        return ReadUnmapped(offset, n, result, scratch);
+      }
+    }
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+  // Only reads map the file: a hint that the whole file will be read
+  // soon, as for a compaction input, is no reason to take the place of
+  // the files that serve lookups.
+  void Hint(AccessPattern pattern) override { budget_->Advise(this, pattern); }
+
+ private:
+  friend class PosixMmapBudget;
+
+  // Copies [offset, offset + n) into |scratch| if the file is mapped.
+  bool ReadMapped(uint64_t offset, size_t n, char* scratch) const {
+    pins_.fetch_add(1);
+    const char* mmap_base = mmap_base_.load();
+    if (mmap_base != nullptr) {
+      std::memcpy(scratch, mmap_base + offset, n);
+      last_read_.store(budget_->clock_.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    }
+    pins_.fetch_sub(1);
+    return mmap_base != nullptr;
+  }
+
+  // Returns a descriptor of the file, opening it if it is not kept open.
+  // Returns -1 on failure.
+  int OpenFd() const {
+    return has_permanent_fd_
+               ? fd_
+               : ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+  }
+
+  // Closes a descriptor returned by OpenFd().
+  void CloseFd(int fd) const {
+    if (!has_permanent_fd_) {
+      assert(fd != fd_);
+      ::close(fd);
+    }
+  }
+
+  Status ReadUnmapped(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    int fd = OpenFd();
+    if (fd < 0) {
+      return PosixError(filename_, errno);
+    }
+    Status status;
+    ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
+    *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
+    if (read_size < 0) {
+      // An error: return a non-ok status.
+      status = PosixError(filename_, errno);
+    }
+    CloseFd(fd);
+    return status;
+  }
+
+  // The fields below are mutable since reads map the file on demand.
+  mutable std::atomic<char*> mmap_base_;  // nullptr while not mapped.
+  mutable std::atomic<int> pins_;         // Reads copying from mmap_base_.
+  mutable std::atomic<uint64_t> last_read_;  // Budget clock at last read.
+  mutable std::atomic<int> unmapped_reads_;  // Reads since last mapped.
+  mutable AccessPattern advice_;             // Guarded by budget_->mu_.
+
+  const bool has_permanent_fd_;  // If false, the file is opened when needed.
+  const int fd_;                 // -1 if has_permanent_fd_ is false.
+  const uint64_t length_;
+  PosixMmapBudget* const budget_;
+  Limiter* const fd_limiter_;
+  const std::string filename_;
+};
+
+void PosixMmapBudget::Map(const PosixBudgetedMmapFile* file) {
+  mu_.Lock();
+  if (file->mmap_base_.load() == nullptr && file->length_ > 0 &&
+      file->length_ <= capacity_ &&
+      (mapped_bytes_ + file->length_ <= capacity_ ||
+       file->unmapped_reads_.load(std::memory_order_relaxed) >=
+           kUnmappedReadsBeforeEviction)) {
+    clock_.fetch_add(1, std::memory_order_relaxed);
+    while (mapped_bytes_ + file->length_ > capacity_) {
+      const PosixBudgetedMmapFile* victim = *std::min_element(
+          mapped_files_.begin(), mapped_files_.end(),
+          [](const PosixBudgetedMmapFile* a, const PosixBudgetedMmapFile* b) {
+            return a->last_read_.load(std::memory_order_relaxed) <
+                   b->last_read_.load(std::memory_order_relaxed);
+          });
+      Unmap(victim);
+    }
+
+    int fd = file->OpenFd();
+    if (fd >= 0) {
+      void* mmap_base = ::mmap(/*addr=*/nullptr, file->length_, PROT_READ,
+                               MAP_SHARED, fd, 0);
+      file->CloseFd(fd);
+      if (mmap_base != MAP_FAILED) {
+        ::madvise(mmap_base, file->length_, MadviseAdvice(file->advice_));
+        file->last_read_.store(clock_.load(std::memory_order_relaxed),
+                               std::memory_order_relaxed);
+        file->unmapped_reads_.store(0, std::memory_order_relaxed);
+        file->mmap_base_.store(reinterpret_cast<char*>(mmap_base));
+        mapped_files_.insert(file);
+        mapped_bytes_ += file->length_;
+      }
+    }
+  }
+  mu_.Unlock();
+}
+
+void PosixMmapBudget::Advise(const PosixBudgetedMmapFile* file,
+                             RandomAccessFile::AccessPattern pattern) {
+  mu_.Lock();
+  if (pattern != RandomAccessFile::kWillNeed) {
+    file->advice_ = pattern;
+  }
+  char* mmap_base = file->mmap_base_.load();
+  if (mmap_base != nullptr) {
+    ::madvise(static_cast<void*>(mmap_base), file->length_,
+              MadviseAdvice(pattern));
+  }
+  mu_.Unlock();
+}
+
+void PosixMmapBudget::Release(const PosixBudgetedMmapFile* file) {
+  mu_.Lock();
+  if (file->mmap_base_.load() != nullptr) {
+    Unmap(file);
+  }
+  mu_.Unlock();
+}
+
+void PosixMmapBudget::Unmap(const PosixBudgetedMmapFile* file) {
+  char* mmap_base = file->mmap_base_.exchange(nullptr);
+  assert(mmap_base != nullptr);
+  // Reads that pinned the mapping before it was taken away may still be
+  // copying from it.  Later reads see it gone.
+  while (file->pins_.load() != 0) {
+    std::this_thread::yield();
+  }
+  ::munmap(static_cast<void*>(mmap_base), file->length_);
+  mapped_files_.erase(file);
+  mapped_bytes_ -= file->length_;
+}
+
 class PosixWritableFile final : public WritableFile {
  public:
   PosixWritableFile(std::string filename, int fd)
@@ -350,6 +733,19 @@ class PosixWritableFile final : public WritableFile {
     return SyncFd(fd_, filename_);
   }
 
+  Status RangeSync(uint64_t offset, uint64_t nbytes) override {
+#if HAVE_SYNC_FILE_RANGE
+    Status status = FlushBuffer();
+    if (!status.ok()) {
+      return status;
+    }
+    if (::sync_file_range(fd_, offset, nbytes, SYNC_FILE_RANGE_WRITE) != 0) {
+      return PosixError(filename_, errno);
+    }
+#endif  // HAVE_SYNC_FILE_RANGE
+    return Status::OK();
+  }
+
  private:
   Status FlushBuffer() {
     Status status = WriteUnbuffered(buf_, pos_);
@@ -462,8 +858,138 @@ class PosixWritableFile final : public WritableFile {
   const bool is_manifest_;  // True if the file's name starts with MANIFEST.
   const std::string filename_;
   const std::string dirname_;  // The directory of filename_.
+
+  friend class PosixDirectWritableFile;
 };
 
+#if defined(O_DIRECT)
+// Writes a file opened with O_DIRECT.
+//
+// Direct writes must cover whole aligned blocks at aligned offsets, so the
+// data is staged in an aligned buffer and written out a block at a time.
+// The partial block at the end of the file is written padded with zeros
+// when the file is synced or closed, and the padding is then truncated.
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  // |buf| must be aligned to kDirectIOAlignment and hold
+  // kDirectWritableFileBufferSize bytes.  The new instance takes ownership
+  // of |fd| and |buf|.
+  PosixDirectWritableFile(std::string filename, int fd, char* buf)
+      : buf_(buf), pos_(0), buf_offset_(0), fd_(fd),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      const size_t copy_size =
+          std::min(write_size, kDirectWritableFileBufferSize - pos_);
+      std::memcpy(buf_ + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == kDirectWritableFileBufferSize) {
+        Status status = FlushBlocks();
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WriteTail();
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  // Only whole blocks can be written without padding; the partial block
+  // at the end stays buffered.
+  Status Flush() override { return FlushBlocks(); }
+
+  Status Sync() override {
+    Status status = WriteTail();
+    if (!status.ok()) {
+      return status;
+    }
+    return PosixWritableFile::SyncFd(fd_, filename_);
+  }
+
+ private:
+  // Write the whole blocks of buf_ and keep the partial block.
+  Status FlushBlocks() {
+    const size_t size = pos_ & ~(kDirectIOAlignment - 1);
+    if (size == 0) {
+      return Status::OK();
+    }
+    Status status = WriteAligned(size);
+    if (status.ok()) {
+      std::memmove(buf_, buf_ + size, pos_ - size);
+      pos_ -= size;
+      buf_offset_ += size;
+    }
+    return status;
+  }
+
+  // Write everything buffered, padding the partial block, and truncate
+  // the file to the bytes appended.  The partial block stays buffered to
+  // be rewritten once it grows.
+  Status WriteTail() {
+    Status status = FlushBlocks();
+    if (!status.ok() || pos_ == 0) {
+      return status;
+    }
+    const size_t padded_size = RoundUpToDirectIOAlignment(pos_);
+    std::memset(buf_ + pos_, 0, padded_size - pos_);
+    status = WriteAligned(padded_size);
+    if (status.ok() &&
+        ::ftruncate(fd_, static_cast<off_t>(buf_offset_ + pos_)) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    return status;
+  }
+
+  Status WriteAligned(size_t size) {
+    size_t written = 0;
+    while (written < size) {
+      ssize_t write_result =
+          ::pwrite(fd_, buf_ + written, size - written,
+                   static_cast<off_t>(buf_offset_ + written));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      written += write_result;
+    }
+    return Status::OK();
+  }
+
+  // buf_[0, pos_ - 1] holds the data of the file from buf_offset_ on,
+  // which is a multiple of kDirectIOAlignment.
+  char* const buf_;
+  size_t pos_;
+  uint64_t buf_offset_;
+  int fd_;
+
+  const std::string filename_;
+};
+#endif  // defined(O_DIRECT)
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -583,6 +1109,84 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  MmapBudget* NewMmapBudget(uint64_t capacity) override {
+    return new PosixMmapBudget(capacity);
+  }
+
+  Status NewMmapRandomAccessFile(const std::string& filename,
+                                 MmapBudget* budget,
+                                 RandomAccessFile** result) override {
+    if (budget == nullptr) {
+      return NewRandomAccessFile(filename, result);
+    }
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_RDONLY | kOpenBaseFlags);
+    if (fd < 0) {
+      return PosixError(filename, errno);
+    }
+    uint64_t file_size;
+    Status status = GetFileSize(filename, &file_size);
+    if (!status.ok()) {
+      ::close(fd);
+    } else if (file_size > budget->Capacity()) {
+      // The file can never be mapped, so it is only read with pread().
+      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_);
+    } else {
+      // The file is mapped when first read.
+      *result = new PosixBudgetedMmapFile(filename, fd, file_size,
+                                          static_cast<PosixMmapBudget*>(budget),
+                                          &fd_limiter_);
+    }
+    return status;
+  }
+
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+#if defined(O_DIRECT)
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT | kOpenBaseFlags);
+    if (fd < 0) {
+      if (errno == EINVAL) {
+        // The file system does not support direct I/O.
+        return NewRandomAccessFile(filename, result);
+      }
+      return PosixError(filename, errno);
+    }
+    *result = new PosixDirectRandomAccessFile(filename, fd, &fd_limiter_);
+    return Status::OK();
+#else
+    return NewRandomAccessFile(filename, result);
+#endif  // defined(O_DIRECT)
+  }
+
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+#if defined(O_DIRECT)
+    *result = nullptr;
+    int fd = ::open(filename.c_str(),
+                    O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT | kOpenBaseFlags,
+                    0644);
+    if (fd < 0) {
+      if (errno == EINVAL) {
+        // The file system does not support direct I/O.
+        return NewWritableFile(filename, result);
+      }
+      return PosixError(filename, errno);
+    }
+    void* buf;
+    if (::posix_memalign(&buf, kDirectIOAlignment,
+                         kDirectWritableFileBufferSize) != 0) {
+      ::close(fd);
+      return Status::IOError(filename, "cannot allocate write buffer");
+    }
+    *result = new PosixDirectWritableFile(filename, fd,
+                                          reinterpret_cast<char*>(buf));
+    return Status::OK();
+#else
+    return NewWritableFile(filename, result);
+#endif  // defined(O_DIRECT)
+  }
+
   Status NewAppendableFile(const std::string& filename,
                            WritableFile** result) override {
     int fd = ::open(filename.c_str(),
@@ -6,9 +6,11 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -212,6 +214,118 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestDirectIO) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+
+  // Appends of odd sizes that cross block and buffer boundaries, with a
+  // sync in the middle that writes out a partial block.
+  Random rnd(301);
+  std::string data;
+  WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(test_file, &writable_file));
+  for (int i = 0; i < 300; i++) {
+    std::string piece;
+    test::RandomString(&rnd, rnd.Uniform(10000), &piece);
+    ASSERT_LEVELDB_OK(writable_file->Append(piece));
+    data += piece;
+    if (i == 100) {
+      ASSERT_LEVELDB_OK(writable_file->Sync());
+    } else if (i % 10 == 0) {
+      ASSERT_LEVELDB_OK(writable_file->Flush());
+    }
+  }
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  uint64_t file_size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(test_file, &file_size));
+  ASSERT_EQ(data.size(), file_size);
+
+  // Unaligned reads, including ones that run past the end of the file.
+  RandomAccessFile* random_access_file;
+  ASSERT_LEVELDB_OK(
+      env_->NewDirectRandomAccessFile(test_file, &random_access_file));
+  std::string scratch(20000, '\0');
+  for (int i = 0; i < 100; i++) {
+    const uint64_t offset = rnd.Uniform(data.size());
+    const size_t n = rnd.Uniform(scratch.size());
+    Slice result;
+    ASSERT_LEVELDB_OK(
+        random_access_file->Read(offset, n, &result, &scratch[0]));
+    ASSERT_EQ(data.substr(offset, n), result.ToString());
+  }
+  delete random_access_file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, TestMmapBudget) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+
+  // Room for two of the three files.
+  const int kNumFiles = 3;
+  const int kFileSize = 10000;
+  std::unique_ptr<MmapBudget> budget(env_->NewMmapBudget(2 * kFileSize + 1));
+  ASSERT_TRUE(budget != nullptr);
+  Random rnd(301);
+  std::string data[kNumFiles];
+  RandomAccessFile* files[kNumFiles];
+  for (int i = 0; i < kNumFiles; i++) {
+    const std::string file_path =
+        test_dir + "/mmap_budget" + std::to_string(i) + ".txt";
+    test::RandomString(&rnd, kFileSize, &data[i]);
+    ASSERT_LEVELDB_OK(WriteStringToFile(env_, data[i], file_path));
+    ASSERT_LEVELDB_OK(
+        env_->NewMmapRandomAccessFile(file_path, budget.get(), &files[i]));
+  }
+  ASSERT_EQ(0, budget->MappedBytes());
+
+  char scratch[100];
+  Slice result;
+  for (int i = 0; i < kNumFiles; i++) {
+    files[i]->Hint(RandomAccessFile::kRandom);
+    ASSERT_LEVELDB_OK(files[i]->Read(i * 100, 100, &result, scratch));
+    ASSERT_EQ(data[i].substr(i * 100, 100), result.ToString());
+    ASSERT_EQ(std::min(i + 1, 2) * kFileSize, budget->MappedBytes());
+  }
+
+  // The third file is read with system calls until it is read often
+  // enough to take the place of the least recently read file.  Being
+  // about to be read whole does not map it.  All files remain readable.
+  files[2]->Hint(RandomAccessFile::kWillNeed);
+  ASSERT_EQ(2 * kFileSize, budget->MappedBytes());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(files[0]->Read(i * 10, 100, &result, scratch));
+    ASSERT_EQ(data[0].substr(i * 10, 100), result.ToString());
+  }
+  ASSERT_EQ(2 * kFileSize, budget->MappedBytes());
+  ASSERT_LEVELDB_OK(files[1]->Read(kFileSize - 100, 100, &result, scratch));
+  ASSERT_EQ(data[1].substr(kFileSize - 100), result.ToString());
+  ASSERT_TRUE(
+      files[1]->Read(kFileSize - 50, 100, &result, scratch).IsIOError());
+
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_EQ(0, budget->MappedBytes());
+
+  // A budget that fits no file reads with system calls.
+  budget.reset(env_->NewMmapBudget(0));
+  ASSERT_LEVELDB_OK(env_->NewMmapRandomAccessFile(
+      test_dir + "/mmap_budget0.txt", budget.get(), &files[0]));
+  ASSERT_LEVELDB_OK(files[0]->Read(500, 100, &result, scratch));
+  ASSERT_EQ(data[0].substr(500, 100), result.ToString());
+  ASSERT_EQ(0, budget->MappedBytes());
+  delete files[0];
+
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->RemoveFile(test_dir + "/mmap_budget" +
+                                       std::to_string(i) + ".txt"));
+  }
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/range_sync_file.h"
+
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+namespace {
+
+class RangeSyncWritableFile : public WritableFile {
+ public:
+  RangeSyncWritableFile(WritableFile* base, uint64_t bytes_per_sync,
+                        uint64_t offset)
+      : base_(base),
+        bytes_per_sync_(bytes_per_sync),
+        offset_(offset),
+        synced_offset_(offset) {}
+
+  ~RangeSyncWritableFile() override { delete base_; }
+
+  Status Append(const Slice& data) override {
+    Status s = base_->Append(data);
+    offset_ += data.size();
+    if (s.ok() && offset_ - synced_offset_ >= bytes_per_sync_) {
+      s = base_->RangeSync(synced_offset_, offset_ - synced_offset_);
+      synced_offset_ = offset_;
+    }
+    return s;
+  }
+
+  Status Close() override { return base_->Close(); }
+  Status Flush() override { return base_->Flush(); }
+
+  Status Sync() override {
+    synced_offset_ = offset_;
+    return base_->Sync();
+  }
+
+  Status RangeSync(uint64_t offset, uint64_t nbytes) override {
+    return base_->RangeSync(offset, nbytes);
+  }
+
+ private:
+  WritableFile* const base_;
+  const uint64_t bytes_per_sync_;
+  uint64_t offset_;         // Size of the file
+  uint64_t synced_offset_;  // Bytes before this offset are written back
+};
+
+}  // namespace
+
+WritableFile* NewRangeSyncWritableFile(WritableFile* base,
+                                       uint64_t bytes_per_sync,
+                                       uint64_t offset) {
+  if (bytes_per_sync == 0) {
+    return base;
+  }
+  return new RangeSyncWritableFile(base, bytes_per_sync, offset);
+}
+
+}  // namespace leveldb
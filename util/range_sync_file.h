@@ -0,0 +1,26 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Wrapper that writes a file back to storage incrementally as it grows
+
+#ifndef STORAGE_LEVELDB_UTIL_RANGE_SYNC_FILE_H_
+#define STORAGE_LEVELDB_UTIL_RANGE_SYNC_FILE_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+class WritableFile;
+
+// Return a file that calls base->RangeSync() on the bytes appended since
+// the previous call whenever they reach "bytes_per_sync".  "offset" is the
+// size of the file when "base" was opened.  The result takes ownership of
+// "base".  Returns "base" itself if "bytes_per_sync" is 0.
+WritableFile* NewRangeSyncWritableFile(WritableFile* base,
+                                       uint64_t bytes_per_sync,
+                                       uint64_t offset = 0);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RANGE_SYNC_FILE_H_
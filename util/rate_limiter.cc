@@ -0,0 +1,228 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() = default;
+
+namespace {
+
+// With auto tuning, the rate is reconsidered after this many refill
+// periods.
+constexpr int kTunePeriods = 100;
+
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t bytes_per_second, int64_t refill_period_micros,
+                     bool auto_tuned, Env* env)
+      : env_(env),
+        refill_period_micros_(std::max<int64_t>(refill_period_micros, 1)),
+        auto_tuned_(auto_tuned),
+        cv_(&mu_),
+        max_bytes_per_second_(0),
+        bytes_per_second_(0),
+        refill_bytes_per_period_(0),
+        available_bytes_(0),
+        next_refill_micros_(env->NowMicros()),
+        tune_periods_(0),
+        drained_periods_(0),
+        drained_(false),
+        total_bytes_through_{0, 0} {
+    MutexLock l(&mu_);
+    max_bytes_per_second_ = std::max<int64_t>(bytes_per_second, 1);
+    SetRate(max_bytes_per_second_);
+    available_bytes_ = refill_bytes_per_period_;
+  }
+
+  void SetBytesPerSecond(int64_t bytes_per_second) override {
+    MutexLock l(&mu_);
+    max_bytes_per_second_ = std::max<int64_t>(bytes_per_second, 1);
+    SetRate(max_bytes_per_second_);
+  }
+
+  int64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return bytes_per_second_;
+  }
+
+  int64_t GetSingleBurstBytes() const override {
+    MutexLock l(&mu_);
+    return refill_bytes_per_period_;
+  }
+
+  void Request(int64_t bytes, Priority priority) override {
+    assert(priority >= 0 && priority < kNumPriorities);
+    MutexLock l(&mu_);
+    bytes = std::min(bytes, refill_bytes_per_period_);
+    total_bytes_through_[priority] += bytes;
+
+    // Requests are granted in order within a priority, and only while no
+    // request of higher priority waits.  The request whose turn it is
+    // sleeps until the next refill; the others wait for it to be granted.
+    int64_t* const ticket = &bytes;
+    queue_[priority].push_back(ticket);
+    while (true) {
+      const uint64_t now_micros = env_->NowMicros();
+      Refill(now_micros);
+      bool turn = (queue_[priority].front() == ticket);
+      for (int p = priority + 1; p < kNumPriorities; p++) {
+        turn = turn && queue_[p].empty();
+      }
+      if (!turn) {
+        cv_.Wait();
+      } else if (available_bytes_ >= bytes) {
+        available_bytes_ -= bytes;
+        queue_[priority].pop_front();
+        cv_.SignalAll();
+        break;
+      } else {
+        drained_ = true;
+        const uint64_t wait_micros = next_refill_micros_ - now_micros;
+        mu_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(wait_micros));
+        mu_.Lock();
+      }
+    }
+  }
+
+  int64_t GetTotalBytesThrough(Priority priority) const override {
+    assert(priority >= 0 && priority < kNumPriorities);
+    MutexLock l(&mu_);
+    return total_bytes_through_[priority];
+  }
+
+ private:
+  void SetRate(int64_t bytes_per_second) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    bytes_per_second_ = bytes_per_second;
+    refill_bytes_per_period_ = std::max<int64_t>(
+        bytes_per_second * refill_period_micros_ / 1000000, 1);
+  }
+
+  // Add the tokens of the refill periods that ended by "now_micros".
+  void Refill(uint64_t now_micros) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (now_micros < next_refill_micros_) {
+      return;
+    }
+    const int64_t periods =
+        (now_micros - next_refill_micros_) / refill_period_micros_ + 1;
+    next_refill_micros_ += periods * refill_period_micros_;
+    // Tokens unused for a whole period are dropped to bound bursts
+    available_bytes_ = std::min(
+        available_bytes_ + periods * refill_bytes_per_period_,
+        refill_bytes_per_period_);
+
+    if (auto_tuned_) {
+      tune_periods_ += periods;
+      if (drained_) {
+        drained_periods_++;
+        drained_ = false;
+      }
+      if (tune_periods_ >= kTunePeriods) {
+        Tune();
+      }
+    }
+  }
+
+  // Raise the rate by 5% if requests had to wait in most periods, and
+  // lower it by 5% if they rarely did.
+  void Tune() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const int64_t drained_percent = drained_periods_ * 100 / tune_periods_;
+    int64_t rate = bytes_per_second_;
+    if (drained_percent > 90) {
+      rate = std::max(rate * 105 / 100, rate + 1);
+    } else if (drained_percent < 50) {
+      rate = rate * 100 / 105;
+    }
+    rate = std::max(rate, std::max<int64_t>(max_bytes_per_second_ / 20, 1));
+    rate = std::min(rate, max_bytes_per_second_);
+    if (rate != bytes_per_second_) {
+      SetRate(rate);
+    }
+    tune_periods_ = 0;
+    drained_periods_ = 0;
+  }
+
+  Env* const env_;
+  const int64_t refill_period_micros_;
+  const bool auto_tuned_;
+
+  mutable port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+
+  int64_t max_bytes_per_second_ GUARDED_BY(mu_);
+  int64_t bytes_per_second_ GUARDED_BY(mu_);
+  int64_t refill_bytes_per_period_ GUARDED_BY(mu_);
+  int64_t available_bytes_ GUARDED_BY(mu_);
+  uint64_t next_refill_micros_ GUARDED_BY(mu_);
+
+  // Refill periods since the rate was last tuned, and how many of them
+  // ended with a request waiting for tokens.
+  int64_t tune_periods_ GUARDED_BY(mu_);
+  int64_t drained_periods_ GUARDED_BY(mu_);
+  bool drained_ GUARDED_BY(mu_);
+
+  // Waiting requests of each priority, oldest first
+  std::deque<int64_t*> queue_[kNumPriorities] GUARDED_BY(mu_);
+  int64_t total_bytes_through_[kNumPriorities] GUARDED_BY(mu_);
+};
+
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* base, RateLimiter* limiter,
+                          RateLimiter::Priority priority)
+      : base_(base), limiter_(limiter), priority_(priority) {}
+
+  ~RateLimitedWritableFile() override { delete base_; }
+
+  Status Append(const Slice& data) override {
+    int64_t left = data.size();
+    while (left > 0) {
+      const int64_t bytes = std::min(left, limiter_->GetSingleBurstBytes());
+      limiter_->Request(bytes, priority_);
+      left -= bytes;
+    }
+    return base_->Append(data);
+  }
+
+  Status Close() override { return base_->Close(); }
+  Status Flush() override { return base_->Flush(); }
+  Status Sync() override { return base_->Sync(); }
+  Status RangeSync(uint64_t offset, uint64_t nbytes) override {
+    return base_->RangeSync(offset, nbytes);
+  }
+
+ private:
+  WritableFile* const base_;
+  RateLimiter* const limiter_;
+  const RateLimiter::Priority priority_;
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(int64_t bytes_per_second,
+                                   int64_t refill_period_micros,
+                                   bool auto_tuned, Env* env) {
+  return new GenericRateLimiter(bytes_per_second, refill_period_micros,
+                                auto_tuned,
+                                env != nullptr ? env : Env::Default());
+}
+
+WritableFile* NewRateLimitedWritableFile(WritableFile* base,
+                                         RateLimiter* limiter,
+                                         RateLimiter::Priority priority) {
+  return new RateLimitedWritableFile(base, limiter, priority);
+}
+
+}  // namespace leveldb
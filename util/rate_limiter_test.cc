@@ -0,0 +1,99 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+TEST(RateLimiterTest, Rate) {
+  Env* env = Env::Default();
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(100 << 10, 10 * 1000));
+  ASSERT_EQ(100 << 10, limiter->GetBytesPerSecond());
+  ASSERT_EQ(1024, limiter->GetSingleBurstBytes());
+
+  // The first burst is available at once; the other 20 take 200ms
+  const uint64_t start_micros = env->NowMicros();
+  for (int i = 0; i < 21; i++) {
+    limiter->Request(1024, RateLimiter::kLow);
+  }
+  const uint64_t elapsed_micros = env->NowMicros() - start_micros;
+  ASSERT_GE(elapsed_micros, 190 * 1000);
+  ASSERT_EQ(21 * 1024, limiter->GetTotalBytesThrough(RateLimiter::kLow));
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(RateLimiter::kHigh));
+
+  // Oversized requests are charged one burst
+  limiter->Request(1 << 20, RateLimiter::kHigh);
+  ASSERT_EQ(1024, limiter->GetTotalBytesThrough(RateLimiter::kHigh));
+}
+
+namespace {
+
+struct PriorityState {
+  RateLimiter* limiter;
+  port::Mutex mu;
+  port::CondVar cv{&mu};
+  int num_running = 0;
+  uint64_t finish_micros[RateLimiter::kNumPriorities] = {0, 0};
+};
+
+template <RateLimiter::Priority priority>
+void RequestBody(void* arg) {
+  PriorityState* state = reinterpret_cast<PriorityState*>(arg);
+  for (int i = 0; i < 20; i++) {
+    state->limiter->Request(1024, priority);
+  }
+  MutexLock l(&state->mu);
+  state->finish_micros[priority] = Env::Default()->NowMicros();
+  state->num_running--;
+  state->cv.SignalAll();
+}
+
+}  // namespace
+
+TEST(RateLimiterTest, Priority) {
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(100 << 10, 10 * 1000));
+  PriorityState state;
+  state.limiter = limiter.get();
+  state.num_running = 2;
+  Env::Default()->StartThread(&RequestBody<RateLimiter::kLow>, &state);
+  Env::Default()->StartThread(&RequestBody<RateLimiter::kHigh>, &state);
+
+  MutexLock l(&state.mu);
+  while (state.num_running > 0) {
+    state.cv.Wait();
+  }
+  ASSERT_LT(state.finish_micros[RateLimiter::kHigh],
+            state.finish_micros[RateLimiter::kLow]);
+}
+
+TEST(RateLimiterTest, AutoTuned) {
+  Env* env = Env::Default();
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(10 << 20, 1000, true));
+  ASSERT_EQ(10 << 20, limiter->GetBytesPerSecond());
+
+  // Little demand lowers the rate
+  env->SleepForMicroseconds(150 * 1000);
+  limiter->Request(1, RateLimiter::kLow);
+  const int64_t lowered_rate = limiter->GetBytesPerSecond();
+  ASSERT_LT(lowered_rate, 10 << 20);
+
+  // Requests that keep the bucket drained raise it again
+  const uint64_t start_micros = env->NowMicros();
+  while (env->NowMicros() - start_micros < 300 * 1000) {
+    limiter->Request(limiter->GetSingleBurstBytes(), RateLimiter::kLow);
+  }
+  ASSERT_GT(limiter->GetBytesPerSecond(), lowered_rate);
+}
+
+}  // namespace leveldb